@@ -0,0 +1,92 @@
+/*
+  Arduino.h - Minimal Arduino core shim for building MD_MIDIFile on a desktop.
+  Copyright (C) 2012 Marco Colli
+  All rights reserved.
+
+  See MD_MIDIFile.h for complete comments
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+#ifndef _BENCH_ARDUINO_H
+#define _BENCH_ARDUINO_H
+
+// Only the parts of the Arduino core used by the library are provided.
+// micros() and millis() are the host monotonic clock.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+
+#define F(s)  (s)
+#define HEX   16
+#define DEC   10
+
+#define PROGMEM
+#define pgm_read_byte(p)  (*(const uint8_t *)(p))
+#define memcpy_P          memcpy
+
+#define noInterrupts()
+#define interrupts()
+
+inline uint32_t micros(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return((uint32_t)((uint64_t)ts.tv_sec * 1000000UL + ts.tv_nsec / 1000));
+}
+
+inline uint32_t millis(void) { return(micros() / 1000); }
+
+// Debug output (DUMP_DATA) goes to stderr so it does not mix with the results
+class HostSerial
+{
+public:
+  void print(const char *s) { fputs(s, stderr); }
+  void print(long v, int base = DEC) { fprintf(stderr, base == HEX ? "%lX" : "%ld", v); }
+  void write(uint8_t c) { fputc(c, stderr); }
+  void write(const uint8_t *p, size_t n) { fwrite(p, 1, n, stderr); }
+  int availableForWrite(void) { return(64); }
+};
+
+extern HostSerial Serial;
+
+// Output for the library methods that write data, eg compile()
+class Print
+{
+public:
+  virtual ~Print(void) {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t *p, size_t n) 
+  { 
+    size_t i;
+
+    for (i = 0; (i < n) && (write(p[i]) == 1); i++)
+      ;
+    return(i); 
+  }
+  virtual int availableForWrite(void) { return(0); }  // as the Arduino core, unknown unless overridden
+};
+
+#endif
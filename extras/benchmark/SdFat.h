@@ -0,0 +1,215 @@
+/*
+  SdFat.h - Minimal SdFat shim for building MD_MIDIFile on a desktop.
+  Copyright (C) 2012 Marco Colli
+  All rights reserved.
+
+  See MD_MIDIFile.h for complete comments
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+#ifndef _BENCH_SDFAT_H
+#define _BENCH_SDFAT_H
+
+// SDFAT, SDFILE and SDDIR (SD_FAT_TYPE 0) mapped onto host stdio files and 
+// folders. Every read and seek is counted so the access pattern of the library
+// can be measured. Files can also be written, and folders listed, for the
+// catalog (MIDI_CATALOG_NAME_SIZE).
+
+#include <Arduino.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
+
+typedef int oflag_t;
+
+#define O_READ    0
+#define O_RDONLY  0
+#define O_WRITE   0x01
+#define O_RDWR    0x02
+#define O_CREAT   0x10
+#define O_TRUNC   0x20
+
+/**
+ * Counters for the data source access, cleared by the benchmark for each file
+ */
+struct HostFileStats
+{
+  uint32_t reads;   ///< the number of read() calls
+  uint32_t bytes;   ///< the number of bytes read
+  uint32_t seeks;   ///< the number of seekSet() calls
+};
+
+extern HostFileStats fileStats;
+
+class File : public Print
+{
+public:
+  File(void) : _f(nullptr), _d(nullptr) {}
+  ~File(void) { close(); }
+
+  bool open(const char *name, oflag_t oflag = O_READ) 
+  { 
+    struct stat st;
+
+    close(); 
+    if ((stat(name, &st) == 0) && S_ISDIR(st.st_mode))   // a folder to list
+    {
+      char path[PATH_MAX];
+
+      // the full path, so the files can still be opened after a chdir()
+      if ((realpath(name, path) == nullptr) || ((_d = opendir(path)) == nullptr))
+        return(false);
+      setPath(path, &st);
+      return(true);
+    }
+
+    if (oflag & O_TRUNC)
+      _f = fopen(name, "w+b");
+    else if (oflag & (O_WRITE | O_RDWR))
+    {
+      _f = fopen(name, "r+b");
+      if ((_f == nullptr) && (oflag & O_CREAT))
+        _f = fopen(name, "w+b");
+    }
+    else
+      _f = fopen(name, "rb");
+    if (_f == nullptr)
+      return(false);
+
+    stat(name, &st);
+    setPath(name, &st);
+    fseek(_f, 0, SEEK_END);
+    _size = ftell(_f);
+    fseek(_f, 0, SEEK_SET);
+    return(true); 
+  }
+
+  bool openNext(File *dir, oflag_t oflag = O_READ)
+  {
+    struct dirent *de;
+
+    close();
+    while ((dir->_d != nullptr) && ((de = readdir(dir->_d)) != nullptr))
+    {
+      char path[2 * sizeof(_path)];
+
+      if ((strcmp(de->d_name, ".") == 0) || (strcmp(de->d_name, "..") == 0))
+        continue;
+      snprintf(path, sizeof(path), "%s/%s", dir->_path, de->d_name);
+      if (open(path, oflag))
+        return(true);
+    }
+    return(false);
+  }
+
+  bool close(void) 
+  { 
+    if (_f != nullptr) fclose(_f); 
+    if (_d != nullptr) closedir(_d);
+    _f = nullptr; 
+    _d = nullptr;
+    return(true); 
+  }
+  bool isOpen(void) { return(_f != nullptr || _d != nullptr); }
+  bool isFile(void) { return(_f != nullptr); }
+  bool isHidden(void) { return(_name[0] == '.'); }
+
+  size_t getName(char *name, size_t size)
+  {
+    size_t len = strlen(_name);
+
+    if (len >= size)
+      return(0);
+    strcpy(name, _name);
+    return(len);
+  }
+
+  bool getModifyDateTime(uint16_t *pdate, uint16_t *ptime)
+  {
+    struct tm *t = localtime(&_mtime);
+
+    // FAT date and time encoding
+    *pdate = ((t->tm_year - 80) << 9) | ((t->tm_mon + 1) << 5) | t->tm_mday;
+    *ptime = (t->tm_hour << 11) | (t->tm_min << 5) | (t->tm_sec / 2);
+    return(true);
+  }
+
+  int read(void) 
+  { 
+    int c = fgetc(_f); 
+
+    fileStats.reads++;
+    if (c == EOF) return(-1);
+    fileStats.bytes++;
+    return(c);
+  }
+
+  int read(void *buf, size_t n) 
+  { 
+    size_t r = fread(buf, 1, n, _f); 
+
+    fileStats.reads++;
+    fileStats.bytes += r;
+    return((int)r); 
+  }
+
+  size_t write(uint8_t c) { return(write(&c, 1)); }
+  size_t write(const uint8_t *p, size_t n) { return(write((const void *)p, n)); }
+  size_t write(const void *buf, size_t n)
+  {
+    size_t w = fwrite(buf, 1, n, _f);
+    uint32_t pos = ftell(_f);
+
+    if (pos > _size) _size = pos;
+    return(w);
+  }
+
+  bool seekSet(uint32_t pos) { fileStats.seeks++; return(pos <= _size && fseek(_f, pos, SEEK_SET) == 0); }
+  uint32_t curPosition(void) { return(ftell(_f)); }
+  uint32_t fileSize(void) { return(_size); }
+
+private:
+  void setPath(const char *name, const struct stat *st)
+  {
+    const char *p = strrchr(name, '/');
+
+    strncpy(_path, name, sizeof(_path) - 1);
+    _path[sizeof(_path) - 1] = '\0';
+    strncpy(_name, (p != nullptr ? p + 1 : name), sizeof(_name) - 1);
+    _name[sizeof(_name) - 1] = '\0';
+    _mtime = st->st_mtime;
+  }
+
+  FILE *_f;
+  DIR *_d;
+  uint32_t _size;
+  time_t _mtime;
+  char _path[PATH_MAX];
+  char _name[256];
+};
+
+class SdFat
+{
+public:
+  bool chdir(const char *path) { return(::chdir(path) == 0); }
+  void chvol(void) {}
+  bool remove(const char *path) { return(::remove(path) == 0); }
+  bool rename(const char *oldPath, const char *newPath) { return(::rename(oldPath, newPath) == 0); }
+};
+
+#endif
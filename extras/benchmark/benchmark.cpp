@@ -0,0 +1,184 @@
+/*
+  benchmark.cpp - Desktop benchmark for the MD_MIDIFile parser.
+  Copyright (C) 2012 Marco Colli
+  All rights reserved.
+
+  See MD_MIDIFile.h for complete comments
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+// Plays every SMF found in the folders (or files) given on the command line
+// as fast as possible with render(), and reports for each file
+// - the number of events and events per second,
+// - the number read() and seekSet() calls and bytes read from the data source,
+// - the peak stack used below the benchmark loop.
+// See README.md for how to build and run the benchmark.
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <MD_MIDIFile.h>
+
+HostSerial Serial;
+HostFileStats fileStats;
+
+static SDFAT SD;
+static MD_MIDIFile SMF;
+
+static uint32_t eventCount;     // events passed to the callbacks
+static uintptr_t stackTop;      // stack address at the benchmark loop
+static uintptr_t stackLow;      // lowest stack address seen
+
+#define BENCH_REPEAT   5        // play each file this many times and take the best
+
+static inline void stackProbe(void)
+// Record how deep the stack is. Called from the deepest points of the
+// library, the callbacks, so this is the peak for the processing.
+{
+  uint8_t marker;
+  uintptr_t p = (uintptr_t)&marker;
+
+  if (p < stackLow) stackLow = p;
+}
+
+static void midiCallback(midi_event *) { eventCount++; stackProbe(); }
+static void sysexCallback(sysex_event *) { eventCount++; stackProbe(); }
+static void metaCallback(const meta_event *) { eventCount++; stackProbe(); }
+
+static bool isSMF(const char *name)
+{
+  size_t len = strlen(name);
+
+  return(len > 4 && (strcasecmp(name + len - 4, ".mid") == 0 || strcasecmp(name + len - 4, ".mfs") == 0));
+}
+
+static void __attribute__((noinline)) playFile(const char *path, uint32_t *us)
+// Load and play the SMF once as fast as possible
+{
+  uint32_t start = micros();
+
+  if (SMF.load(path) != MD_MIDIFile::E_OK)
+  {
+    *us = 0;
+    return;
+  }
+
+  SMF.render();
+
+  *us = micros() - start;
+  SMF.close();
+}
+
+static void benchFile(const char *path)
+{
+  uint32_t best = 0xffffffff;
+  uint32_t events = 0;
+  HostFileStats fs = { 0, 0, 0 };
+  uint8_t marker;
+
+  stackTop = stackLow = (uintptr_t)&marker;
+
+  for (uint8_t i = 0; i < BENCH_REPEAT; i++)
+  {
+    uint32_t us;
+
+    eventCount = 0;
+    memset(&fileStats, 0, sizeof(fileStats));
+
+    playFile(path, &us);
+    if (us == 0)
+    {
+      printf("%-60s load error\n", path);
+      return;
+    }
+
+    if (us < best) best = us;
+    events = eventCount;
+    fs = fileStats;
+  }
+
+  if (best == 0) best = 1;
+  printf("%-60s %8u %10.0f %8u %8u %8u %6u\n", path, events,
+    (double)events * 1000000.0 / best, fs.bytes, fs.reads, fs.seeks,
+    (unsigned)(stackTop - stackLow));
+}
+
+static void benchPath(const char *path)
+// Benchmark a file, or all the SMF in a folder and its sub-folders
+{
+  struct stat st;
+  DIR *d;
+  struct dirent *de;
+
+  if (stat(path, &st) != 0)
+  {
+    printf("%-60s not found\n", path);
+    return;
+  }
+
+  if (!S_ISDIR(st.st_mode))
+  {
+    benchFile(path);
+    return;
+  }
+
+  if ((d = opendir(path)) == nullptr)
+    return;
+
+  while ((de = readdir(d)) != nullptr)
+  {
+    char name[512];
+
+    if (de->d_name[0] == '.')
+      continue;
+
+    snprintf(name, sizeof(name), "%s/%s", path, de->d_name);
+    if (stat(name, &st) != 0)
+      continue;
+    if (S_ISDIR(st.st_mode) || isSMF(de->d_name))
+      benchPath(name);
+  }
+
+  closedir(d);
+}
+
+int main(int argc, char *argv[])
+{
+  static const char *corpus[] =
+  {
+    "../../examples/SD_Card_Files",
+    "../../examples/Groove Monkee Free MIDI GM"
+  };
+
+  SMF.begin(&SD);
+  SMF.setMidiHandler(midiCallback);
+  SMF.setSysexHandler(sysexCallback);
+  SMF.setMetaHandler(metaCallback);
+
+  printf("%-60s %8s %10s %8s %8s %8s %6s\n", "File", "Events", "Events/s", "Bytes", "Reads", "Seeks", "Stack");
+
+  if (argc > 1)
+  {
+    for (int i = 1; i < argc; i++)
+      benchPath(argv[i]);
+  }
+  else
+  {
+    for (uint8_t i = 0; i < ARRAY_SIZE(corpus); i++)
+      benchPath(corpus[i]);
+  }
+
+  return(0);
+}
@@ -0,0 +1,96 @@
+/*
+  smfcompile.cpp - Desktop converter from SMF to MD_MIDIFile compiled stream.
+  Copyright (C) 2012 Marco Colli
+  All rights reserved.
+
+  See MD_MIDIFile.h for complete comments
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+// Converts a SMF to a compiled stream with MD_MIDIFile::compile(), so the 
+// stream can be copied to the SD card or built into a sketch and played with
+// load(). The library must be built with MIDI_COMPILED_STREAM set to 1.
+// See README.md for how to build and run the converter.
+
+#include <MD_MIDIFile.h>
+
+#if !MIDI_COMPILED_STREAM
+#error "MIDI_COMPILED_STREAM must be set to 1 to build smfcompile"
+#endif
+
+HostSerial Serial;
+HostFileStats fileStats;
+
+static SDFAT SD;
+static MD_MIDIFile SMF;
+
+class FilePrint : public Print
+// Print output to a host file
+{
+public:
+  FilePrint(FILE *f) : _f(f) {}
+  size_t write(uint8_t c) { return(fputc(c, _f) == EOF ? 0 : 1); }
+  size_t write(const uint8_t *p, size_t n) { return(fwrite(p, 1, n, _f)); }
+
+private:
+  FILE *_f;
+};
+
+int main(int argc, char *argv[])
+{
+  FILE *f;
+  uint32_t size;
+  uint8_t tracks;
+  int err;
+
+  if (argc != 3)
+  {
+    printf("usage: smfcompile <SMF file> <stream file>\n");
+    return(1);
+  }
+
+  SMF.begin(&SD);
+  if ((err = SMF.load(argv[1])) != MD_MIDIFile::E_OK)
+  {
+    printf("%s load error %d\n", argv[1], err);
+    return(1);
+  }
+
+  if ((f = fopen(argv[2], "wb")) == nullptr)
+  {
+    printf("%s cannot be created\n", argv[2]);
+    return(1);
+  }
+
+  {
+    FilePrint out(f);
+
+    size = SMF.compile(&out);
+  }
+  fclose(f);
+  tracks = SMF.getTrackCount();
+  SMF.close();
+
+  if (size == 0)
+  {
+    printf("%s compile failed\n", argv[1]);
+    remove(argv[2]);
+    return(1);
+  }
+
+  printf("%s: %u tracks, %u bytes\n", argv[2], tracks, size);
+  return(0);
+}
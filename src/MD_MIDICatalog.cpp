@@ -0,0 +1,270 @@
+/*
+  MD_MIDICatalog.cpp - An Arduino library for processing Standard MIDI Files (SMF).
+  Copyright (C) 2012 Marco Colli
+  All rights reserved.
+
+  See MD_MIDIFile.h for complete comments
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+#include "MD_MIDIFile.h"
+
+
+/**
+ * \file
+ * \brief Main file for the MD_MIDICatalog class implementation
+ */
+
+#if MIDI_CATALOG_NAME_SIZE
+
+static const char catalogTemp[] = "MIDICAT.TMP";  // the new index while it is built
+
+MD_MIDICatalog::MD_MIDICatalog(void) :
+  _mf(nullptr), _count(0), _hint(0), _loads(0)
+{
+}
+
+void MD_MIDICatalog::begin(MD_MIDIFile *pmf)
+{
+  close();
+  _mf = pmf;
+}
+
+void MD_MIDICatalog::close(void)
+{
+  _fd.close();
+  _count = _hint = 0;
+}
+
+bool MD_MIDICatalog::openIndex(const char *index)
+{
+  catalog_header h;
+
+  close();
+  if (!_fd.open(index, O_READ))
+    return(false);
+
+  // a different configuration, or a partly written file, is not used
+  if ((_fd.read(&h, sizeof(h)) != sizeof(h)) || (h.magic != CATALOG_MAGIC) ||
+      (h.entrySize != sizeof(catalog_entry)) ||
+      (_fd.fileSize() != sizeof(h) + ((uint32_t)h.count * sizeof(catalog_entry))))
+  {
+    _fd.close();
+    return(false);
+  }
+
+  _count = h.count;
+
+  return(true);
+}
+
+bool MD_MIDICatalog::open(const char *folder, const char *index)
+{
+  if (_mf == nullptr)
+    return(false);
+
+  _mf->setFileFolder(folder);
+
+  return(openIndex(index));
+}
+
+bool MD_MIDICatalog::readEntry(SDFILE *pf, uint16_t idx, catalog_entry *pe)
+{
+  if (!pf->seekSet(sizeof(catalog_header) + ((uint32_t)idx * sizeof(catalog_entry))))
+    return(false);
+
+  return(pf->read(pe, sizeof(catalog_entry)) == sizeof(catalog_entry));
+}
+
+bool MD_MIDICatalog::getEntry(uint16_t idx, catalog_entry *pe)
+{
+  if (idx >= _count)
+    return(false);
+
+  return(readEntry(&_fd, idx, pe));
+}
+
+int32_t MD_MIDICatalog::findEntry(catalog_entry *pe)
+// The folder is normally listed in the same order as when the index was built,
+// so the search starts at the entry after the last one found and is usually 
+// only one read.
+{
+  catalog_entry e;
+
+  for (uint16_t n = 0; n < _count; n++)
+  {
+    uint16_t i = (_hint + n) % _count;
+
+    if (!readEntry(&_fd, i, &e))
+      break;
+
+    if ((e.size == pe->size) && (e.modified == pe->modified) && (strcmp(e.name, pe->name) == 0))
+    {
+      memcpy(pe, &e, sizeof(e));
+      _hint = i + 1;
+      return(i);
+    }
+  }
+
+  return(-1);
+}
+
+void MD_MIDICatalog::loadEntry(catalog_entry *pe)
+{
+  _mf->close();
+  pe->error = _mf->load(pe->name);
+
+  if (pe->error == MD_MIDIFile::E_OK)
+  {
+    pe->format = _mf->getFormat();
+    pe->tracks = _mf->getTrackCount();
+    pe->ticksPerQuarterNote = _mf->getTicksPerQuarterNote();
+#if MIDI_TEMPO_MAP_SIZE
+    pe->duration = (_mf->getDuration() + 500) / 1000;
+#endif
+    _mf->_track[0].scanTitle(_mf, pe->title, sizeof(pe->title));
+  }
+
+  _mf->close();
+}
+
+bool MD_MIDICatalog::startIndex(SDFILE *pf, uint16_t count)
+// The header is left empty until the index is finished, so a partly 
+// written index is never used.
+{
+  catalog_header h;
+  bool ok;
+
+  memset(&h, 0, sizeof(h));
+  ok = pf->open(catalogTemp, O_WRITE | O_CREAT | O_TRUNC) && (pf->write(&h, sizeof(h)) == sizeof(h));
+
+  for (uint16_t i = 0; ok && (i < count); i++)
+  {
+    catalog_entry e;
+
+    ok = readEntry(&_fd, i, &e) && (pf->write(&e, sizeof(e)) == sizeof(e));
+  }
+
+  return(ok);
+}
+
+bool MD_MIDICatalog::build(const char *folder, const char *index)
+// Each SMF in the folder is looked for in the old index. While they are all the 
+// same, in the same order, nothing is written. At the first difference the new 
+// index is started with the entries before it, and all the entries after that 
+// are written to the new index as they are found.
+{
+  SDDIR  dir;
+  SDFILE file;          // the file listed
+  SDFILE tmp;           // the new index
+  uint16_t count = 0;   // entries for the new index
+  uint16_t matched = 0; // entries found in the old index
+  bool changed = false;
+  bool ok = true;
+
+  _loads = 0;
+  close();
+  if ((_mf == nullptr) || !dir.open(folder, O_READ))
+    return(false);
+
+  _mf->setFileFolder(folder);
+  openIndex(index);     // no index is the same as an empty one
+
+  while (ok && (count < 0xffff) && file.openNext(&dir, O_READ))
+  {
+    catalog_entry e;
+    char name[MIDI_CATALOG_NAME_SIZE + 1];
+    size_t len = 0;
+    uint16_t fdate = 0, ftime = 0;
+    int32_t idx = -1;
+
+    memset(&e, 0, sizeof(e));
+    if (file.isFile() && !file.isHidden())
+    {
+      len = file.getName(name, sizeof(name));
+      e.size = file.fileSize();
+      file.getModifyDateTime(&fdate, &ftime);
+    }
+    file.close();
+
+    // only SMF with names that fit in the entry
+    if ((len <= 4) || (len >= MIDI_CATALOG_NAME_SIZE) || (strcasecmp(&name[len - 4], ".mid") != 0))
+      continue;
+
+    strcpy(e.name, name);
+    e.modified = ((uint32_t)fdate << 16) | ftime;
+
+    // once all the old entries are used the rest of the SMF must be new
+    if (matched < _count)
+      idx = findEntry(&e);
+
+    if (idx >= 0)
+      matched++;
+    else
+    {
+      DUMP("\nCatalog load ", e.name);
+      loadEntry(&e);
+      _loads++;
+    }
+
+    if (!changed && (idx != count))
+    {
+      changed = true;
+      ok = startIndex(&tmp, count);
+    }
+
+    if (changed && ok)
+      ok = (tmp.write(&e, sizeof(e)) == sizeof(e));
+
+    count++;
+  }
+  dir.close();
+
+  if (!changed)
+  {
+    if (count == _count)    // the old index is still right
+      return(true);
+
+    // SMF have gone from the end of the folder
+    ok = startIndex(&tmp, count);
+  }
+
+  if (ok)
+  {
+    catalog_header h;
+
+    h.magic = CATALOG_MAGIC;
+    h.entrySize = sizeof(catalog_entry);
+    h.count = count;
+    ok = tmp.seekSet(0) && (tmp.write(&h, sizeof(h)) == sizeof(h));
+  }
+  ok = tmp.close() && ok;
+  close();
+
+  if (ok)
+  {
+    _mf->_sd->remove(index);    // there may be no old index
+    ok = _mf->_sd->rename(catalogTemp, index);
+  }
+  else
+    _mf->_sd->remove(catalogTemp);
+
+  // the old index is kept if the new one failed
+  openIndex(index);
+
+  return(ok);
+}
+
+#endif // MIDI_CATALOG_NAME_SIZE
@@ -34,16 +34,93 @@ void MD_MIDIFile::initialise(void)
   _trackCount = 0;            // number of tracks in file
   _format = 0;
   _tickTime = _lastTickError = 0;
+  _tickFrac = _tickPhase = 0;
+  _usPerQN = 500000;
+  _tempo = 120;
+  _tempoDelta = 0;
+  _timeSignature[0] = _timeSignature[1] = 4;
+  _tickCount = _tickBase = 0;
+  _heapCount = 0;
+#if MIDI_TRACK_ARENA
+  _arena = nullptr;
+  _arenaSize = 0;
+  _track = nullptr;
+  _heap = nullptr;
+#endif
   _synchDone = false;
   _paused =_looping = false;
+#if MIDI_QUEUE_SIZE
+  _queueMode = false;
+  _queueTime = _queueBase = _queuePauseTime = 0;
+  _queuePhase = 0;
+#endif
+#if MIDI_PIPELINE
+  _pipeRun = _pipeHold = false;
+  _pipeReadIdle = _pipeSendIdle = true;
+  _pipeReadDone = _pipeSendDone = true;
+#endif
+#if MIDI_SEEK_CHECKPOINTS
+  _seeking = false;
+  _cpCount = 0;
+#endif
+#if MIDI_TEMPO_MAP_SIZE
+  _tempoMapCount = 0;
+  _endTick = 0;
+#endif
+#if MIDI_LOOP_REGION
+  clearLoopRegion();
+#endif
   
   setMidiHandler(nullptr);
+#if MIDI_BATCH_SIZE
+  setMidiBatchHandler(nullptr);
+  _batchCount = 0;
+  _batchTick = 0;
+  _midiBatchCtx = nullptr;
+#endif
   setSysexHandler(nullptr);
   setMetaHandler(nullptr);
+  _midiCtx = _sysexCtx = _metaCtx = nullptr;
+#if MIDI_STREAM_CHUNK_SIZE
+  setStreamHandler(nullptr);
+  _streamCtx = nullptr;
+#endif
+#if MIDI_CLOCK_OUT
+  setClockHandler(nullptr);
+  _clockCtx = nullptr;
+  _clockState = CLOCK_IDLE;
+  _clockAcc = 0;
+#endif
+#if MIDI_EVENT_FILTER
+  clearFilters();
+#endif
+  setEventOrder(ORDER_TIME);
+  setProcessBudget(0, 0);
+  _carryOver = false;
+  _renderTime = 0;
+  _renderPhase = 0;
+#if MIDI_CLOCK_SYNC
+  _syncMode = _syncRunning = _syncLocked = false;
+  _syncPeriod = _syncLast = _syncRaw = 0;
+  _syncBase = _syncTick = 0;
+  _syncClock = 0;
+  _syncFirst = true;
+#endif
+#if MIDI_ACTIVE_NOTES
+  memset(_activeNotes, 0, sizeof(_activeNotes));
+#endif
+#if MIDI_PLAYLIST_SIZE
+  _scanDefer = false;
+#endif
+#if MIDI_TIMING_STATS
+  resetTimingStats();
+  _statsTimed = false;
+#endif
 
   // File handling
   setFilename("");
   _sd = nullptr;
+  _src = &_srcSD;
 
   // Set MIDI specified standard defaults
   setTicksPerQuarterNote(48); // 48 ticks per quarter note
@@ -56,10 +133,15 @@ void MD_MIDIFile::initialise(void)
 void MD_MIDIFile::synchTracks(void)
 {
   for (uint8_t i = 0; i < _trackCount; i++)
-    _track[i].syncTime();
+    _track[i].syncTime(_tickCount);
 
+  _tickBase += _tickCount;
+  _tickCount = 0;
   _lastTickCheckTime = micros();
   _lastTickError = 0;
+  _tickPhase = 0;
+
+  heapBuild();
 }
 
 MD_MIDIFile::MD_MIDIFile(void) 
@@ -80,27 +162,66 @@ void MD_MIDIFile::begin(SDFAT *psd)
 void MD_MIDIFile::close()
 // Close out - should be ready for the next file
 {
+#if MIDI_ACTIVE_NOTES
+  silenceActiveNotes();
+#endif
+#if MIDI_CLOCK_OUT
+  clockStop(CLOCK_IDLE);
+#endif
   for (uint8_t i = 0; i<_trackCount; i++)
   {
     _track[i].close();
   }
   _trackCount = 0;
+  _heapCount = 0;
+  _tickCount = _tickBase = 0;
+  _renderTime = 0;
+  _renderPhase = 0;
   _synchDone = false;
   _paused = false;
+#if MIDI_QUEUE_SIZE
+  noInterrupts();
+  _queue.clear();
+  interrupts();
+#endif
+#if MIDI_SEEK_CHECKPOINTS
+  _cpCount = 0;
+#endif
+#if MIDI_LOOP_REGION
+  clearLoopRegion();
+#endif
+#if MIDI_TEMPO_MAP_SIZE
+  _tempoMapCount = 0;
+  _endTick = 0;
+#endif
+#if MIDI_CLOCK_SYNC
+  // the next SMF starts on the next clock
+  _syncBase = 0;
+  _syncClock = 0;
+  _syncFirst = true;
+  syncPosition();
+#endif
 
   setFilename("");
-  _fd.close();
+  _src->close();
 }
 
 void MD_MIDIFile::setTempoAdjust(int16_t t)
 {
   if ((t + _tempo) > 0) _tempoDelta = t;
   calcTickTime();
+#if MIDI_TEMPO_MAP_SIZE
+  tempoMapCalc();
+#endif
 }
 
 void MD_MIDIFile::setTempo(uint16_t t)
 {
-  if ((_tempoDelta + t) > 0) _tempo = t;
+  if ((t != 0) && ((_tempoDelta + t) > 0))
+  {
+    _tempo = t;
+    _usPerQN = (60 * 1000000L) / t;
+  }
   calcTickTime();
 }
 
@@ -115,13 +236,20 @@ void MD_MIDIFile::setTicksPerQuarterNote(uint16_t ticks)
 {
   _ticksPerQuarterNote = ticks;
   calcTickTime();
+#if MIDI_TEMPO_MAP_SIZE
+  tempoMapCalc();
+#endif
 }
 
 void MD_MIDIFile::setMicrosecondPerQuarterNote(uint32_t m)
 // This is the value given in the META message setting tempo
 {
-  // work out the tempo from the delta by reversing the calcs in
-  // calctickTime - m is already per quarter note
+  if (m == 0)
+    return;
+
+  // The tick time is worked out directly from this value. The tempo in 
+  // beats per minute is kept for getTempo() and the tempo adjustment.
+  _usPerQN = m;
   _tempo = (60 * 1000000L) / m;
   calcTickTime();
 }
@@ -133,14 +261,52 @@ void MD_MIDIFile::calcTickTime(void)
 // by default, which is equivalent to 120 beats per minute. 
 // If the MIDI time division is 60 ticks per beat and if the microseconds per beat 
 // is 500,000, then 1 tick = 500,000 / 60 = 8333.33 microseconds.
+// The tick time is kept as 16.16 fixed point microseconds so the fraction is not
+// lost, and is only worked out here when the tempo changes.
 {
-  if ((_tempo + _tempoDelta != 0) && _ticksPerQuarterNote != 0 && _timeSignature[1] != 0)
+  if (_ticksPerQuarterNote != 0 && _timeSignature[1] != 0)
+    tickTimeFor(_usPerQN, &_tickTime, &_tickFrac);
+}
+
+void MD_MIDIFile::tickTimeFor(uint32_t m, uint32_t *tt, uint16_t *frac)
+// work out the 16.16 fixed point microseconds per tick for m microseconds 
+// per quarter note, including the tempo adjustment
+{
+  if (m == 0 || _ticksPerQuarterNote == 0)
+    return;
+
+  if (_tempoDelta != 0)   // the adjustment is in beats per minute
   {
-    _tickTime = (60 * 1000000L) / (_tempo + _tempoDelta); // microseconds per beat
-//    _tickTime = (_tickTime * 4) / (_timeSignature[1] * _ticksPerQuarterNote); // microseconds per tick
-    _tickTime /= _ticksPerQuarterNote;
+    int32_t bpm = ((60 * 1000000L) / m) + _tempoDelta;
+
+    if (bpm > 0) m = (60 * 1000000L) / bpm;
   }
+
+//  m = (m * 4) / _timeSignature[1]; // microseconds per beat
+  *tt = m / _ticksPerQuarterNote;
+  *frac = ((m % _ticksPerQuarterNote) << 16) / _ticksPerQuarterNote;
+}
+
+static uint32_t ticksToSpan(uint32_t ticks, uint32_t tt, uint16_t frac, uint16_t phase)
+// Time in microseconds for a number of ticks with the 16.16 fixed point tick time, 
+// starting with a fraction (phase) of a microsecond already carried. The ticks are 
+// split into 16 bit halves to keep the fraction in 32 bits without a division.
+{
+  return((ticks * tt) + ((ticks >> 16) * frac) + ((phase + ((ticks & 0xffff) * frac)) >> 16));
+}
+
+#if (MIDI_TEMPO_MAP_SIZE || MIDI_SEEK_CHECKPOINTS)
+static uint32_t spanToTicks(uint32_t us, uint32_t tt, uint16_t frac, uint16_t phase)
+// The number of whole ticks in the time, the reverse of ticksToSpan()
+{
+  uint64_t p = ((uint64_t)tt << 16) | frac;
+
+  if (p == 0)
+    return(0);
+
+  return(((((uint64_t)us + 1) << 16) - phase - 1) / p);
 }
+#endif
 
 bool MD_MIDIFile::isEOF(void)
 {
@@ -160,6 +326,15 @@ bool MD_MIDIFile::isEOF(void)
     restart();
     bEof = false;
   }
+#if MIDI_QUEUE_SIZE
+  else if (bEof && _queueMode)  // not finished until all the queue is played
+    bEof = _queue.isEmpty();
+#endif
+
+#if MIDI_CLOCK_OUT
+  if (bEof)
+    clockStop(CLOCK_IDLE);
+#endif
 
   return(bEof);
 }
@@ -167,8 +342,33 @@ bool MD_MIDIFile::isEOF(void)
 void MD_MIDIFile::pause(bool bMode)
 // Start pause when true and restart when false
 {
+#if MIDI_QUEUE_SIZE
+  // move the queued events out by the time we were paused
+  if (bMode && !_paused)
+    _queuePauseTime = micros();
+  else if (!bMode && _paused)
+  {
+    noInterrupts();
+    _queueBase += micros() - _queuePauseTime;
+    interrupts();
+  }
+#endif
+
+#if MIDI_ACTIVE_NOTES || MIDI_CLOCK_OUT
+  bool stopping = (bMode && !_paused);
+#endif
+
   _paused = bMode;
 
+#if MIDI_ACTIVE_NOTES
+  if (stopping)
+    silenceActiveNotes();
+#endif
+#if MIDI_CLOCK_OUT
+  if (stopping)
+    clockStop(CLOCK_STOP);
+#endif
+
   if (!_paused)         // restarting so adjust the time last checked to now
     _lastTickCheckTime = micros();
 }
@@ -176,32 +376,123 @@ void MD_MIDIFile::pause(bool bMode)
 void MD_MIDIFile::restart(void)
 // Reset the file to the start of all tracks
 {
+#if MIDI_QUEUE_SIZE
+  bool allEOT = true;
+
+  for (uint8_t i = 0; i < _trackCount && allEOT; i++)
+    allEOT = _track[i].getEndOfTrack();
+#endif
+
   // track 0 contains information that does not need to be reloaded every time, 
   // so if we are looping, ignore restarting that track. The file may have one 
   // track only and in this case always sync from track 0.
   for (uint8_t i=(_looping && _trackCount>1 ? 1 : 0); i<_trackCount; i++)
     _track[i].restart();
 
+#if MIDI_ACTIVE_NOTES
+  silenceActiveNotes();
+#endif
+#if MIDI_CLOCK_OUT
+  _clockState = CLOCK_IDLE;   // Start again from the beginning
+#endif
+
+#if MIDI_QUEUE_SIZE
+  // Throw away anything read ahead of the restart point. When looping at the 
+  // end of all tracks the queue is kept so the loop continues without a gap.
+  if (!allEOT)
+  {
+    noInterrupts();
+    _queue.clear();
+    interrupts();
+  }
+#endif
+
+  // restart the tick count now in case the caller is generating the ticks
+  synchTracks();
+  _tickBase = 0;
+  _renderTime = 0;
+  _renderPhase = 0;
   _synchDone = false;   // force a time resych as well
 }
 
 uint16_t MD_MIDIFile::tickClock(void)
 // check if enough time has passed for a MIDI tick and work out how many!
+// Normally called often enough that there is no more than one tick, so ticks are 
+// counted off one at a time to avoid a divide. The fraction of a microsecond in 
+// each tick is carried in _tickPhase so there is no long term drift.
 {
-  uint32_t  elapsedTime;
+  uint32_t  now = micros();
   uint16_t  ticks = 0;
 
-  elapsedTime = _lastTickError + micros() - _lastTickCheckTime;
-  if (elapsedTime >= _tickTime)
+  _lastTickError += now - _lastTickCheckTime;
+  _lastTickCheckTime = now;    // save for next round of checks
+
+  // catch up in one go if the main loop has been held up for a while
+  if ((_lastTickError >> 3) > _tickTime)
   {
-    ticks = elapsedTime/_tickTime;
-    _lastTickError = elapsedTime - (_tickTime * ticks);
-    _lastTickCheckTime = micros();    // save for next round of checks
+    uint32_t n = _lastTickError / (_tickTime + 1);  // never more than the ticks due
+
+    if (n > 0xff00) n = 0xff00;
+    _lastTickError -= ticksToSpan(n, _tickTime, _tickFrac, _tickPhase);
+    _tickPhase += n * _tickFrac;
+    ticks = n;
+  }
+
+  while (ticks < 0xffff)
+  {
+    uint32_t f = (uint32_t)_tickPhase + _tickFrac;
+    uint32_t t = _tickTime + (f >> 16);   // this tick, including any carry
+
+    if (_lastTickError < t)
+      break;
+
+    _lastTickError -= t;
+    _tickPhase = f;
+    ticks++;
   }
 
+#if MIDI_TIMING_STATS
+  if (ticks > _stats.catchUpMax)
+    _stats.catchUpMax = ticks;
+#endif
+
   return(ticks);
 }
 
+uint16_t MD_MIDIFile::pollTicks(void)
+// start the time line if needed and work out the ticks due from the clock
+{
+  // sync start all the tracks if we need to
+  if (!_synchDone)
+  {
+    synchTracks();
+    _synchDone = true;
+  }
+
+#if MIDI_CLOCK_SYNC
+  return(_syncMode ? syncClock() : tickClock());
+#else
+  return(tickClock());
+#endif
+}
+
+void MD_MIDIFile::processTimed(uint16_t ticks)
+// process the events for ticks counted by pollTicks()
+{
+#if MIDI_TIMING_STATS
+  _statsTickDue = _lastTickCheckTime - _lastTickError;
+#if MIDI_CLOCK_SYNC
+  _statsTimed = !_syncMode;
+#else
+  _statsTimed = true;
+#endif
+  processEvents(ticks);
+  _statsTimed = false;
+#else
+  processEvents(ticks);
+#endif
+}
+
 boolean MD_MIDIFile::getNextEvent(void)
 {
   uint16_t  ticks;
@@ -210,174 +501,1939 @@ boolean MD_MIDIFile::getNextEvent(void)
   if (_paused) 
     return false;
 
-  // sync start all the tracks if we need to
-  if (!_synchDone)
+  // check if enough time has passed for a MIDI tick, or if events 
+  // were left over from the last call
+  ticks = pollTicks();
+  if ((ticks == 0) && !_carryOver)
+    return false;
+
+  processTimed(ticks);
+
+  return(true);
+}
+
+#if MIDI_MULTI_SONGS
+bool MD_MIDIFile::eventDue(uint16_t ticks, uint16_t *step, uint32_t *late)
+// Check if the next event is due within the ticks counted but not yet processed.
+// If it is, step is the ticks to move on to the event and late is the number of 
+// ticks since it was due.
+{
+  uint32_t t = _tickCount + ticks;
+  uint32_t next;
+
+  if (_paused || (_heapCount == 0) || !_track[_heap[0]].isEventDue(t))
+    return(false);
+
+  // a track that has not read its first delta time is due straight away
+  next = _track[_heap[0]].getNextEventTick();
+  if (next < _tickCount) next = _tickCount;
+
+  *step = next - _tickCount;
+  *late = t - next;
+
+  return(true);
+}
+#endif
+
+uint32_t MD_MIDIFile::getMicrosToNextEvent(void)
+// work out how long before getNextEvent() has something to do
+{
+  uint32_t ticks, elapsedTime;
+
+  if (_paused || (_heapCount == 0))
+    return(0xffffffff);
+
+  // not yet synchronized, so needs to be done now
+  if (!_synchDone || _track[_heap[0]].isEventDue(_tickCount))
+    return(0);
+
+  ticks = _track[_heap[0]].getNextEventTick() - _tickCount;
+#if MIDI_LOOP_REGION
+  // wake up in time to wrap at the end of the loop region
+  if ((_loopEnd != 0) && (getTickPosition() < _loopEnd) && (_loopEnd - getTickPosition() < ticks))
+    ticks = _loopEnd - getTickPosition();
+#endif
+#if MIDI_CLOCK_OUT
+  // wake up in time to send the next clock, on the first tick that takes 
+  // _clockAcc to _ticksPerQuarterNote. Start and Continue go on the next tick.
+  if (isClockOut())
   {
-    synchTracks();
-    _synchDone = true;
+    int32_t need = (int32_t)_ticksPerQuarterNote - _clockAcc;
+    uint32_t clk = ((_clockState != CLOCK_RUN) || (need <= 0) ? 1 : (need + 23) / 24);
+
+    if (clk < ticks)
+      ticks = clk;
   }
+#endif
+#if MIDI_CLOCK_SYNC
+  if (_syncMode)
+  {
+    // whole clocks to the next event at the smoothed clock period, so never late
+    uint32_t p = _syncPeriod >> 8;
 
-  // check if enough time has passed for a MIDI tick
-  if ((ticks = tickClock()) == 0)
-    return false;
+    if (!_syncRunning || (ticks > 0xffffffff / 24))
+      return(0xffffffff);
+    ticks = (ticks * 24) / _ticksPerQuarterNote;
 
-  processEvents(ticks);
+    return(ticks > 0xffffffff / (p + 1) ? 0xffffffff : ticks * p);
+  }
+#endif
+  if (ticks > 0xffffffff / (_tickTime + 1))
+    return(0xffffffff);
+  ticks = ticksToSpan(ticks, _tickTime, _tickFrac, _tickPhase);
 
-  return(true);
+  // take off the time already elapsed towards the next tick
+  elapsedTime = _lastTickError + micros() - _lastTickCheckTime;
+
+  return(elapsedTime >= ticks ? 0 : ticks - elapsedTime);
 }
 
-void MD_MIDIFile::processEvents(uint16_t ticks)
+void MD_MIDIFile::handleMidi(midi_event *pev)
+// pass the MIDI event on to the user code or queue it for later
 {
-  uint8_t n;
+#if MIDI_SEEK_CHECKPOINTS
+  if (_seeking)
+  {
+    chaseEvent(pev);
+    return;
+  }
+#endif
 
-  if (_format != 0) 
+#if MIDI_QUEUE_SIZE
+  if (_queueMode)
   {
-    DUMP("\n-- [", ticks); 
-    DUMPS("] TRK "); 
+    _queue.push(_queueTime, pev);
+    return;
   }
+#endif
 
-#if TRACK_PRIORITY
-  // process all events from each track first - TRACK PRIORITY
-  for (uint8_t i = 0; i < _trackCount; i++)
+  sendMidi(pev);
+}
+
+void MD_MIDIFile::sendMidi(midi_event *pev)
+// pass the MIDI event on to the user code, or collect it in the batch
+{
+#if MIDI_ACTIVE_NOTES
+  noteActive(pev);    // the notes sounding are those actually sent
+#endif
+
+#if MIDI_BATCH_SIZE
+  if (isBatch())
   {
-    if (_format != 0) DUMPX("", i);
-    // Limit n to be a sensible number of events in the loop counter
-    // When there are no more events, just break out
-    // Other than the first event, the others have an elapsed time of 0 (ie occur simultaneously)
-    for (n=0; n < 100; n++)
-    {
-      if (!_track[i].getNextEvent(this, (n==0 ? ticks : 0)))
-        break;
-    }
+    _batch[_batchCount++] = *pev;
+    if (_batchCount >= MIDI_BATCH_SIZE)
+      flushBatch();
+    return;
+  }
+#endif
+
+  callMidi(pev);
+}
+
+void MD_MIDIFile::sendSysex(sysex_event *pev)
+// pass the SYSEX event on to the user code
+{
+  if (isSeeking())
+    return;
 
-    if ((n > 0) && (_format != 0))
-      DUMPS("\n-- TRK "); 
+  if (_sysexHandler != nullptr)
+  {
+    flushBatch();   // keep the event order
+    (_sysexHandler)(pev);
+  }
+  else if (_sysexHandlerCtx != nullptr)
+  {
+    flushBatch();
+    (_sysexHandlerCtx)(pev, _sysexCtx);
   }
-#else // EVENT_PRIORITY
-  // process one event from each track round-robin style - EVENT PRIORITY
-  bool doneEvents;
+}
 
-  // Limit n to be a sensible number of events in the loop counter
-  for (n = 0; (n < 100) && (!doneEvents); n++)
+void MD_MIDIFile::sendMeta(const meta_event *pev)
+// pass the META event on to the user code
+{
+  if (isSeeking())
+    return;
+
+  if (_metaHandler != nullptr)
+  {
+    flushBatch();   // keep the event order
+    (_metaHandler)(pev);
+  }
+  else if (_metaHandlerCtx != nullptr)
   {
-    doneEvents = false;
+    flushBatch();
+    (_metaHandlerCtx)(pev, _metaCtx);
+  }
+}
 
-    for (uint8_t i = 0; i < _trackCount; i++) // cycle through all
-    {
-      bool b;
+#if MIDI_STREAM_CHUNK_SIZE
+void MD_MIDIFile::sendStream(const stream_event *pev)
+// pass the SYSEX or META chunk on to the user code
+{
+  if (isSeeking())
+    return;
+
+  flushBatch();   // keep the event order
+  if (_streamHandler != nullptr)
+    (_streamHandler)(pev);
+  else if (_streamHandlerCtx != nullptr)
+    (_streamHandlerCtx)(pev, _streamCtx);
+}
+#endif
+
+#if MIDI_BATCH_SIZE
+void MD_MIDIFile::flushBatch(void)
+// pass all the MIDI events collected to the user code in one call
+{
+  if (_batchCount != 0)
+    callBatch(_batch, _batchCount);
+  _batchCount = 0;
+}
+#endif
+
+#if MIDI_PLAYLIST_SIZE
+uint32_t MD_MIDIFile::getEndTime(void)
+// Work back from the time the current tick was due to the tick of the 
+// last event, which is where each track stopped.
+{
+  uint32_t endTick = 0;
+  uint32_t t = _lastTickCheckTime - _lastTickError;
+
+  for (uint8_t i = 0; i < _trackCount; i++)
+    if (_track[i].getNextEventTick() > endTick)
+      endTick = _track[i].getNextEventTick();
+
+  if (_tickCount > endTick)
+    t -= ticksToSpan(_tickCount - endTick, _tickTime, _tickFrac, 0);
+
+  return(t);
+}
+#endif
 
-      if (_format != 0) DUMPX("", i);
+#if MIDI_ACTIVE_NOTES
+void MD_MIDIFile::silenceActiveNotes(void)
+// send a note off for each note that is sounding
+{
+  midi_event ev;
+
+  ev.track = 0;
+  ev.size = 3;
+  ev.data[0] = 0x80;
+  ev.data[2] = 0;
+
+  for (uint16_t i = 0; i < sizeof(_activeNotes); i++)
+  {
+    if (_activeNotes[i] == 0)   // none of these 8 notes
+      continue;
 
-      // Other than the first event, the other have an elapsed time of 0 (ie occur simultaneously)
-      b = _track[i].getNextEvent(this, (n==0 ? ticks : 0));
-      if (b && (_format != 0))
-        DUMPS("\n-- TRK "); 
-      doneEvents = (doneEvents || b);
+    ev.channel = i >> 4;
+    for (uint8_t b = 0; b < 8; b++)
+    {
+      if (_activeNotes[i] & (1 << b))
+      {
+        ev.data[1] = ((i & 0xf) << 3) | b;
+        sendMidi(&ev);
+      }
     }
+    _activeNotes[i] = 0;
+  }
 
-    // When there are no more events, just break out
-    if (!doneEvents)
-      break;
-  } 
-#endif // EVENT/TRACK_PRIORITY
+  flushBatch();
 }
+#endif
 
-int MD_MIDIFile::load(const char *fname) 
-// Load the MIDI file into memory ready for processing
-// Return one of the E_* error codes
+#if MIDI_LOAD_SCAN
+int MD_MIDIFile::scan(void)
+// Check every event in the SMF in one pass, taking the tracks in time order as 
+// if playing, to collect the statistics and build the tempo map.
 {
-  uint32_t dat32;
-  uint16_t dat16;
+  uint8_t notes[16 * 128 / 8];  // notes sounding, one bit for each channel and note
+  uint16_t poly = 0;            // number of notes sounding
+  uint16_t tickEvents = 0;      // number of MIDI events on this tick
+  uint32_t tick = 0;
+  int err = E_OK;
 
-  _fileName = fname;
-  
-  if ((_fileName == nullptr) || (*_fileName == '\0'))
-    return(E_NO_FILE);
+  memset(&_scanStats, 0, sizeof(_scanStats));
+  memset(notes, 0, sizeof(notes));
+#if MIDI_TEMPO_MAP_SIZE
+  // the MIDI default applies until the SMF changes it
+  _tempoMapCount = 1;
+  _tempoMap[0].tick = 0;
+  _tempoMap[0].usPerQN = 500000;
+#endif
 
-  // open the file for reading
-  if (!_fd.open(_fileName, O_READ)) 
-    return(E_NO_OPEN);
+  for (uint8_t i = 0; i < _trackCount; i++)
+    _track[i].scanStart(this);
 
-  // Read the MIDI header
-  // header chunk = "MThd" + <header_length:4> + <format:2> + <num_tracks:2> + <time_division:2>
+  while (err == E_OK)
   {
-    char    h[MTHD_HDR_SIZE+1]; // Header characters + nul
+    uint8_t t = _trackCount;
+    midi_event ev;
+    uint32_t len;
 
-    _fd.fgets(h, MTHD_HDR_SIZE+1);
-    h[MTHD_HDR_SIZE] = '\0';
+    // the track with the earliest event is next
+    for (uint8_t i = 0; i < _trackCount; i++)
+      if (!_track[i].getEndOfTrack() && 
+        ((t == _trackCount) || (_track[i].getNextEventTick() < _track[t].getNextEventTick())))
+        t = i;
 
-    if (strcmp(h, MTHD_HDR) != 0)
+    if (t == _trackCount)   // no events left
+      break;
+
+    if (_track[t].getNextEventTick() != tick)
     {
-      _fd.close();
-      return(E_NOT_MIDI);
+      tick = _track[t].getNextEventTick();
+      tickEvents = 0;
     }
-  }
 
-  // read header size
-  dat32 = readMultiByte(&_fd, MB_LONG);
-  if (dat32 != 6)   // must be 6 for this header
-  {
-    _fd.close();
-    return(E_HEADER);
-  }
-  
-  // read file type
-  dat16 = readMultiByte(&_fd, MB_WORD);
-  if ((dat16 != 0) && (dat16 != 1))
-  {
-    _fd.close();
-    return(E_FORMAT);
-  }
-  _format = dat16;
- 
-  // read number of tracks
-  dat16 = readMultiByte(&_fd, MB_WORD);
-  if ((_format == 0) && (dat16 != 1)) 
-  {
-    _fd.close();
-    return(E_FORMAT0);
+    _scanStats.events++;
+    switch (_track[t].scanEvent(this, &ev, &len))
+    {
+    case -1:
+      err = (10 * (t + 1)) + E_CHUNK_DATA;
+      break;
+
+    case 0xf0:  // SYSEX
+    case 0xf7:
+      if (len > _scanStats.sysexMax) _scanStats.sysexMax = len;
+      break;
+
+    case 0xff:  // META
+      if (len > _scanStats.metaMax) _scanStats.metaMax = len;
+      break;
+
+    default:    // MIDI
+      _scanStats.midiEvents++;
+      if (++tickEvents > _scanStats.tickEventsMax) 
+        _scanStats.tickEventsMax = tickEvents;
+
+      if ((ev.data[0] == 0x80) || (ev.data[0] == 0x90))
+      {
+        uint8_t *p = &notes[(ev.channel << 4) | (ev.data[1] >> 3)];
+        uint8_t bit = (1 << (ev.data[1] & 7));
+
+        if ((ev.data[0] == 0x90) && (ev.data[2] != 0))   // note on
+        {
+          if (!(*p & bit))
+          {
+            *p |= bit;
+            if (++poly > _scanStats.polyphonyMax)
+              _scanStats.polyphonyMax = poly;
+          }
+        }
+        else if (*p & bit)    // note off, or note on with 0 velocity
+        {
+          *p &= ~bit;
+          poly--;
+        }
+      }
+      break;
+    }
   }
-  if (dat16 > MIDI_MAX_TRACKS)
+
+#if MIDI_TEMPO_MAP_SIZE
+  _endTick = tick;
+  tempoMapCalc();
+#endif
+
+  for (uint8_t i = 0; i < _trackCount; i++)
+    _track[i].restart();
+
+  return(err);
+}
+#endif
+
+#if MIDI_TIMING_STATS
+void MD_MIDIFile::resetTimingStats(void)
+{
+  memset(&_stats, 0, sizeof(_stats));
+  _stats.lateMin = 0xffffffff;
+}
+
+void MD_MIDIFile::statsEvent(uint32_t ticks)
+// The current tick was due at _statsTickDue, so an event due some ticks 
+// before that was due the time for those ticks earlier still.
+{
+  uint32_t late;
+  uint8_t bin;
+
+  _stats.events++;
+  if (!_statsTimed)
+    return;
+
+  late = micros() - _statsTickDue;
+  if (ticks != 0)
   {
-    _fd.close();
-    return(E_TRACKS);
+    if (ticks > 0xffffffff / (_tickTime + 1))
+      late = 0xffffffff;
+    else
+    {
+      uint32_t span = ticksToSpan(ticks, _tickTime, _tickFrac, _tickPhase);
+
+      late = (span > 0xffffffff - late ? 0xffffffff : late + span);
+    }
   }
-  _trackCount = dat16;
 
-  // read ticks per quarter note
-  dat16 = readMultiByte(&_fd, MB_WORD);
-  if (dat16 & 0x8000) // top bit set is SMTE format
+  _stats.lateCount++;
+  _stats.lateTotal += late;
+  if (late < _stats.lateMin) _stats.lateMin = late;
+  if (late > _stats.lateMax) _stats.lateMax = late;
+
+  // power of 2 bins starting at 256us
+  late >>= 8;
+  for (bin = 0; (late != 0) && (bin < MIDI_STATS_BINS - 1); bin++)
+    late >>= 1;
+  _stats.lateHist[bin]++;
+}
+#endif
+
+#if MIDI_EVENT_FILTER
+void MD_MIDIFile::setMetaFilter(uint8_t type, bool skip)
+{
+  if (type >= 128)
+    return;
+
+  if (skip)
+    _metaFilter[type >> 3] |= (1 << (type & 7));
+  else
+    _metaFilter[type >> 3] &= ~(1 << (type & 7));
+}
+
+void MD_MIDIFile::clearFilters(void)
+{
+  _statusFilter = 0;
+  _channelFilter = 0;
+  memset(_metaFilter, 0, sizeof(_metaFilter));
+}
+#endif
+
+#if MIDI_QUEUE_SIZE
+void MD_MIDIFile::queueMode(bool bMode)
+{
+  _queueMode = bMode;
+
+  noInterrupts();
+  _queue.clear();
+  interrupts();
+
+  _synchDone = false;   // force a time resynch for the new mode
+}
+
+uint8_t MD_MIDIFile::queueEvents(void)
+// read ahead from the SMF to fill the queue - producer side
+{
+  if (!_queueMode || _paused)
+    return(_queue.count());
+
+  // sync start all the tracks if we need to
+  if (!_synchDone)
   {
-    int framespersecond = (dat16 >> 8) & 0x00ff;
-    int resolution      = dat16 & 0x00ff;
+    synchTracks();
+    _synchDone = true;
 
-    switch (framespersecond) 
+    // If there is nothing queued start a new time line. Otherwise we 
+    // are looping and carry on from the last event read.
+    if (_queue.isEmpty())
     {
-      case 232:  framespersecond = 24; break;
-      case 231:  framespersecond = 25; break;
-      case 227:  framespersecond = 29; break;
-      case 226:  framespersecond = 30; break;
-      default:   _fd.close(); return(7);
+      _queueTime = 0;
+      _queuePhase = 0;
+      noInterrupts();
+      _queueBase = micros();
+      interrupts();
     }
-    dat16 = framespersecond * resolution;
-  } 
-  _ticksPerQuarterNote = dat16;
-  calcTickTime();  // we may have changed from default, so recalculate
+  }
 
-  // load all tracks
-  for (uint8_t i = 0; i<_trackCount; i++)
+  // Process events in time order until the queue is full. Each event 
+  // queues at most one MIDI message so there is always room.
+  while (!_queue.isFull() && (_heapCount > 0))
   {
-    int err;
+    uint8_t i = _heap[0];
 
-    if ((err = _track[i].load(i, this)) != -1)
+    // move the read ahead time on to the next event
+    if (!_track[i].isEventDue(_tickCount))
     {
-      _fd.close();
-      return((10*(i+1))+err);
+      uint32_t t = _track[i].getNextEventTick();
+
+      _queueTime += ticksToSpan(t - _tickCount, _tickTime, _tickFrac, _queuePhase);
+      _queuePhase += (t - _tickCount) * _tickFrac;
+      _tickCount = t;
     }
-   }
 
-  return(E_OK);
+    _track[i].getNextEvent(this, _tickCount);
+
+    // reschedule the track, unless a callback has changed the tracks
+    if ((_heapCount > 0) && (_heap[0] == i))
+      heapUpdateTop();
+  }
+
+  return(_queue.count());
+}
+
+uint32_t MD_MIDIFile::dispatchQueue(void)
+// send all the events that are due - consumer side, safe for ISR
+{
+  midi_queue_event *pq;
+  uint32_t now;
+
+  if (_paused)
+    return(0xffffffff);
+
+  now = micros() - _queueBase;
+
+#if MIDI_BATCH_SIZE
+  // The batch in the class belongs to the main loop, so collect the events
+  // due now in a local batch for the batch callback.
+  if (isBatch())
+  {
+    midi_event batch[MIDI_BATCH_SIZE < MIDI_QUEUE_BATCH_SIZE ? MIDI_BATCH_SIZE : MIDI_QUEUE_BATCH_SIZE];
+    uint8_t count = 0;
+    uint32_t t = 0;         // queue time of the events in the batch
+    uint32_t wait = 0xffffffff;
+
+    while ((pq = _queue.peek()) != nullptr)
+    {
+      int32_t w = (int32_t)(pq->time - now);
+
+      if (w > 0)
+      {
+        wait = w;
+        break;
+      }
+
+      // a batch is the events for the same time, even if later ones are also due
+      if ((count != 0) && (pq->time != t))
+      {
+        callBatch(batch, count);
+        count = 0;
+      }
+      t = pq->time;
+
+#if MIDI_ACTIVE_NOTES
+      noteActive(&pq->ev);
+#endif
+      batch[count++] = pq->ev;
+      _queue.pop();
+      if (count >= ARRAY_SIZE(batch))
+      {
+        callBatch(batch, count);
+        count = 0;
+      }
+    }
+
+    if (count != 0)
+      callBatch(batch, count);
+
+    return(wait);
+  }
+#endif
+
+  while ((pq = _queue.peek()) != nullptr)
+  {
+    int32_t wait = (int32_t)(pq->time - now);
+
+    if (wait > 0)
+      return(wait);
+
+#if MIDI_ACTIVE_NOTES
+    noteActive(&pq->ev);
+#endif
+    callMidi(&pq->ev);
+    _queue.pop();
+  }
+
+  return(0xffffffff);
+}
+#endif // MIDI_QUEUE_SIZE
+
+#if MIDI_TEMPO_MAP_SIZE
+void MD_MIDIFile::tempoMapBuild(void)
+// scan all the tracks for tempo changes and the end of the SMF
+{
+  tempoMapStart();
+
+  for (uint8_t i = 0; i < _trackCount; i++)
+  {
+    _track[i].restart();
+    while (!tempoMapScan(i, 0xffff))
+      ;
+  }
+
+  tempoMapCalc();
+}
+
+void MD_MIDIFile::tempoMapStart(void)
+{
+  // the MIDI default applies until the SMF changes it
+  _tempoMapCount = 1;
+  _tempoMap[0].tick = 0;
+  _tempoMap[0].usPerQN = 500000;
+  _endTick = 0;
+}
+
+bool MD_MIDIFile::tempoMapScan(uint8_t i, uint16_t events)
+// scan the next events of the track, keeping the end of the SMF once it is done
+{
+  uint32_t t;
+
+  if (!_track[i].scanTempo(this, events, &t))
+    return(false);
+
+  if (t > _endTick)
+    _endTick = t;
+
+  return(true);
+}
+
+void MD_MIDIFile::tempoMapAdd(uint32_t tick, uint32_t m)
+// add the tempo change, in microseconds per quarter note, in tick order
+{
+  uint8_t idx = _tempoMapCount;
+
+  if (m == 0)
+    return;
+
+  while ((idx > 0) && (_tempoMap[idx - 1].tick > tick))
+    idx--;
+
+  if ((idx > 0) && (_tempoMap[idx - 1].tick == tick))   // replaces the tempo at this tick
+  {
+    _tempoMap[idx - 1].usPerQN = m;
+    return;
+  }
+
+  if (_tempoMapCount >= MIDI_TEMPO_MAP_SIZE)
+  {
+    if (idx >= _tempoMapCount)   // no room and later than all the others
+      return;
+    _tempoMapCount--;            // lose the last one to make room
+  }
+
+  for (uint8_t i = _tempoMapCount; i > idx; i--)
+    _tempoMap[i] = _tempoMap[i - 1];
+
+  _tempoMap[idx].tick = tick;
+  _tempoMap[idx].usPerQN = m;
+  _tempoMapCount++;
+}
+
+void MD_MIDIFile::tempoMapCalc(void)
+// work out the tick time and the time of each tempo change
+{
+  for (uint8_t i = 0; i < _tempoMapCount; i++)
+  {
+    tempo_map *pt = &_tempoMap[i];
+
+    tickTimeFor(pt->usPerQN, &pt->tickTime, &pt->tickFrac);
+    if (i == 0)
+    {
+      pt->micros = ticksToSpan(pt->tick, pt->tickTime, pt->tickFrac, 0);
+      pt->phase = pt->tick * pt->tickFrac;
+    }
+    else
+    {
+      uint32_t dt = pt->tick - pt[-1].tick;
+
+      pt->micros = pt[-1].micros + ticksToSpan(dt, pt[-1].tickTime, pt[-1].tickFrac, pt[-1].phase);
+      pt->phase = pt[-1].phase + (dt * pt[-1].tickFrac);
+    }
+  }
+}
+
+uint8_t MD_MIDIFile::tempoMapFind(uint32_t v, bool byTime)
+// binary search for the last tempo change at or before the tick or time
+{
+  uint8_t lo = 0, hi = _tempoMapCount;
+
+  while (hi - lo > 1)
+  {
+    uint8_t mid = (lo + hi) / 2;
+
+    if ((byTime ? _tempoMap[mid].micros : _tempoMap[mid].tick) <= v)
+      lo = mid;
+    else
+      hi = mid;
+  }
+
+  return(lo);
+}
+
+uint32_t MD_MIDIFile::tickToMicros(uint32_t tick)
+{
+  tempo_map *pt;
+
+  if (_tempoMapCount == 0)
+    return(ticksToSpan(tick, _tickTime, _tickFrac, 0));
+
+  pt = &_tempoMap[tempoMapFind(tick, false)];
+
+  return(pt->micros + ticksToSpan(tick - pt->tick, pt->tickTime, pt->tickFrac, pt->phase));
+}
+
+uint32_t MD_MIDIFile::microsToTick(uint32_t us)
+{
+  tempo_map *pt;
+
+  if (_tempoMapCount == 0)
+    return(spanToTicks(us, _tickTime, _tickFrac, 0));
+
+  pt = &_tempoMap[tempoMapFind(us, true)];
+
+  // the only division is for the part after the last tempo change
+  return(pt->tick + spanToTicks(us - pt->micros, pt->tickTime, pt->tickFrac, pt->phase));
+}
+#endif // MIDI_TEMPO_MAP_SIZE
+
+#if MIDI_SEEK_CHECKPOINTS
+// Controllers chased by a seek, in the order they are sent. Bank select 
+// is first so that it is set before the program change.
+static const uint8_t chaseCC[MIDI_CHASE_CC] = 
+{ 
+  0x00, 0x20,   // bank select MSB, LSB
+  0x01,         // modulation
+  0x07,         // volume
+  0x0a,         // pan
+  0x0b,         // expression
+  0x40,         // sustain
+  0x5b,         // reverb
+  0x5d          // chorus
+};
+
+void MD_MIDIFile::seekReset(void)
+// clear the seek index ready for a new SMF
+{
+  _cpCount = 0;
+  _cpInterval = 4 * _ticksPerQuarterNote;   // a bar of 4/4 to start with
+  if (_cpInterval == 0) _cpInterval = 1;
+  _cpNextTick = _cpInterval;
+}
+
+void MD_MIDIFile::addTickTime(uint32_t ticks, uint32_t *ms, uint16_t *us, uint16_t *phase)
+// add the playing time for a number of ticks at the current tempo
+{
+  uint32_t t = ticksToSpan(ticks, _tickTime, _tickFrac, *phase) + *us;
+
+  *phase += ticks * _tickFrac;
+  *ms += t / 1000;
+  *us = t % 1000;
+}
+
+void MD_MIDIFile::chaseEvent(const midi_event *pev)
+// keep the channel setup messages found during a seek
+{
+  midi_chase *pc = &_chase[pev->channel];
+
+  switch (pev->data[0])
+  {
+  case 0xb0:  // control change
+    if (pev->data[1] == 0x79)   // reset all controllers
+    {
+      memset(pc->cc, 0xff, sizeof(pc->cc));
+      pc->pressure = pc->bend[0] = pc->bend[1] = 0xff;
+    }
+    else
+    {
+      for (uint8_t i = 0; i < MIDI_CHASE_CC; i++)
+        if (chaseCC[i] == pev->data[1])
+        {
+          pc->cc[i] = pev->data[2];
+          break;
+        }
+    }
+    break;
+
+  case 0xc0:  // program change
+    pc->program = pev->data[1];
+    break;
+
+  case 0xd0:  // channel pressure
+    pc->pressure = pev->data[1];
+    break;
+
+  case 0xe0:  // pitch bend
+    pc->bend[0] = pev->data[1];
+    pc->bend[1] = pev->data[2];
+    break;
+  }
+}
+
+void MD_MIDIFile::chaseSend(void)
+// send the channel setup chased by a seek to the user code
+{
+  midi_event ev;
+
+  ev.track = 0;
+  for (uint8_t ch = 0; ch < ARRAY_SIZE(_chase); ch++)
+  {
+    midi_chase *pc = &_chase[ch];
+
+    ev.channel = ch;
+
+    ev.size = 3;
+    ev.data[0] = 0xb0;
+    for (uint8_t i = 0; i < MIDI_CHASE_CC; i++)
+      if (pc->cc[i] != 0xff)
+      {
+        ev.data[1] = chaseCC[i];
+        ev.data[2] = pc->cc[i];
+        sendMidi(&ev);
+      }
+
+    ev.size = 2;
+    if (pc->program != 0xff)
+    {
+      ev.data[0] = 0xc0;
+      ev.data[1] = pc->program;
+      sendMidi(&ev);
+    }
+
+    if (pc->pressure != 0xff)
+    {
+      ev.data[0] = 0xd0;
+      ev.data[1] = pc->pressure;
+      sendMidi(&ev);
+    }
+
+    if (pc->bend[0] != 0xff)
+    {
+      ev.size = 3;
+      ev.data[0] = 0xe0;
+      ev.data[1] = pc->bend[0];
+      ev.data[2] = pc->bend[1];
+      sendMidi(&ev);
+    }
+  }
+
+  flushBatch();
+}
+
+void MD_MIDIFile::seekCheckpoint(uint32_t tick, uint32_t ms, uint16_t us, uint16_t phase)
+// save the state of the SMF at the tick in the seek index
+{
+  seek_checkpoint *pcp;
+
+  if (_cpCount >= MIDI_SEEK_CHECKPOINTS)
+  {
+    // Index is full - keep every second checkpoint and double the interval, 
+    // so the index is spread over all the SMF scanned so far.
+    uint8_t j = 0;
+
+    for (uint8_t i = 1; i < _cpCount; i += 2, j++)
+    {
+      _cp[j] = _cp[i];
+      for (uint8_t k = 0; k < _trackCount; k++)
+        _track[k].moveCheckpoint(j, i);
+    }
+    _cpCount = j;
+    _cpInterval *= 2;
+
+    _cpNextTick = (_cpCount == 0 ? _cpInterval : ((_cp[_cpCount - 1].tick / _cpInterval) + 1) * _cpInterval);
+    if (tick < _cpNextTick)
+      return;
+  }
+
+  pcp = &_cp[_cpCount];
+  pcp->tick = tick;
+  pcp->millis = ms;
+  pcp->micros = us;
+  pcp->phase = phase;
+  pcp->usPerQN = _usPerQN;
+  pcp->timeSignature[0] = _timeSignature[0];
+  pcp->timeSignature[1] = _timeSignature[1];
+  memcpy(pcp->chase, _chase, sizeof(pcp->chase));
+
+  for (uint8_t i = 0; i < _trackCount; i++)
+    _track[i].saveCheckpoint(_cpCount);
+
+  _cpCount++;
+  _cpNextTick = ((tick / _cpInterval) + 1) * _cpInterval;
+}
+
+bool MD_MIDIFile::seek(uint32_t tick, uint32_t ms)
+// Move playback to the tick or the time, whichever comes first
+{
+  int8_t cp;
+  uint32_t msTime = 0;    // playing time at _tickCount
+  uint16_t usTime = 0;
+  uint16_t phase = 0;     // fraction of a microsecond carried
+
+  if (_trackCount == 0)
+    return(false);
+
+#if MIDI_ACTIVE_NOTES
+  silenceActiveNotes();
+#endif
+  _tickBase = 0;
+
+  // find the last checkpoint before the target
+  for (cp = _cpCount - 1; cp >= 0; cp--)
+    if (_cp[cp].tick <= tick && _cp[cp].millis < ms)
+      break;
+
+#if MIDI_QUEUE_SIZE
+  noInterrupts();
+  _queue.clear();
+  interrupts();
+#endif
+
+  if (cp < 0)   // start from the beginning of the SMF
+  {
+    for (uint8_t i = 0; i < _trackCount; i++)
+      _track[i].restart();
+    _tickCount = 0;
+
+    // MIDI defaults until the SMF sets them
+    setMicrosecondPerQuarterNote(500000);
+    setTimeSignature(4, 4);
+    memset(_chase, 0xff, sizeof(_chase));
+  }
+  else          // start from the checkpoint
+  {
+    seek_checkpoint *pcp = &_cp[cp];
+
+    for (uint8_t i = 0; i < _trackCount; i++)
+      _track[i].loadCheckpoint(cp);
+    _tickCount = pcp->tick;
+    msTime = pcp->millis;
+    usTime = pcp->micros;
+    phase = pcp->phase;
+
+    _usPerQN = pcp->usPerQN;
+    _tempo = (60 * 1000000L) / _usPerQN;
+    setTimeSignature(pcp->timeSignature[0], pcp->timeSignature[1]); // also recalculates tick time
+    memcpy(_chase, pcp->chase, sizeof(_chase));
+  }
+
+  // make sure all tracks have the time of their next event ready
+  for (uint8_t i = 0; i < _trackCount; i++)
+    _track[i].readDelta(this);
+  heapBuild();
+
+  // Scan the events in time order up to the target, with MIDI events 
+  // chased rather than passed to the callback.
+  _seeking = true;
+  while (_heapCount > 0)
+  {
+    uint8_t i = _heap[0];
+    uint32_t t = _track[i].getNextEventTick();
+    uint32_t m = msTime;
+    uint16_t u = usTime;
+    uint16_t f = phase;
+
+    // playing time to the next event
+    addTickTime(t - _tickCount, &m, &u, &f);
+
+    // all events before t are done, so this is a good place for a checkpoint
+    if (t >= _cpNextTick)
+      seekCheckpoint(t, m, u, f);
+
+    if (t >= tick)
+    {
+      _tickCount = tick;
+      break;
+    }
+    if (m >= ms)
+    {
+      // the target time is before the next event
+      _tickCount += spanToTicks(((ms - msTime) * 1000) - usTime, _tickTime, _tickFrac, phase);
+      break;
+    }
+
+    _tickCount = t;
+    msTime = m;
+    usTime = u;
+    phase = f;
+
+    _track[i].getNextEvent(this, _tickCount);
+
+    // reschedule the track, unless a callback has changed the tracks
+    if ((_heapCount > 0) && (_heap[0] == i))
+      heapUpdateTop();
+  }
+  _seeking = false;
+
+  chaseSend();
+#if MIDI_CLOCK_OUT
+  clockPosition();
+#endif
+  _synchDone = false;   // restart the time base from the new position
+
+  return(_heapCount > 0);
+}
+#endif // MIDI_SEEK_CHECKPOINTS
+
+#if MIDI_LOOP_REGION
+bool MD_MIDIFile::setLoopRegion(uint32_t tickA, uint32_t tickB)
+{
+  if (tickB <= tickA)
+    return(false);
+
+  _loopStart = tickA;
+  _loopEnd = tickB;
+  _loopSaved = false;
+  _loopCount = 0;
+
+  return(true);
+}
+
+bool MD_MIDIFile::setLoopMarkers(const char *markA, const char *markB)
+// The markers are usually all in the first track but any track may have them
+{
+  uint32_t a = 0xffffffff, b = 0xffffffff;
+
+  if ((markA == nullptr) || (markB == nullptr) || (_trackCount == 0))
+    return(false);
+
+  for (uint8_t i = 0; i < _trackCount; i++)
+  {
+    uint32_t t = _track[i].scanMarker(this, markA, 0);
+
+    if (t < a) a = t;
+  }
+
+  if (a != 0xffffffff)
+  {
+    for (uint8_t i = 0; i < _trackCount; i++)
+    {
+      uint32_t t = _track[i].scanMarker(this, markB, a + 1);
+
+      if (t < b) b = t;
+    }
+  }
+
+  // the scans have moved all the tracks back to the start
+  restart();
+
+  return((b != 0xffffffff) && setLoopRegion(a, b));
+}
+
+void MD_MIDIFile::clearLoopRegion(void)
+{
+  _loopStart = _loopEnd = 0;
+  _loopSaved = false;
+  _loopCount = 0;
+}
+
+void MD_MIDIFile::loopSave(void)
+// Save the state one tick before the start of the loop region, with all the 
+// earlier events done and the time of the next event on each track known.
+{
+  for (uint8_t i = 0; i < _trackCount; i++)
+  {
+    _track[i].readDelta(this);
+    _track[i].saveLoop();
+  }
+  heapBuild();
+
+  _loopBase = _tickBase;
+  _loopTick = _tickCount;
+  _loopUsPerQN = _usPerQN;
+  _loopTimeSignature[0] = _timeSignature[0];
+  _loopTimeSignature[1] = _timeSignature[1];
+  _loopSaved = true;
+}
+
+void MD_MIDIFile::loopRestore(void)
+// Put back the state saved one tick before the start of the loop region. A loop
+// from the start of the SMF needs no saved state, the tracks are restarted.
+{
+#if MIDI_ACTIVE_NOTES
+  silenceActiveNotes();
+#endif
+  if (_loopStart == 0)
+  {
+    for (uint8_t i = 0; i < _trackCount; i++)
+      _track[i].restart();
+    _tickBase = 0;
+    _tickCount = _loopStart - 1;  // the next tick counted brings this to 0
+
+    // MIDI defaults until the SMF sets them
+    setMicrosecondPerQuarterNote(500000);
+    setTimeSignature(4, 4);
+  }
+  else
+  {
+    for (uint8_t i = 0; i < _trackCount; i++)
+      _track[i].loadLoop();
+    _tickBase = _loopBase;
+    _tickCount = _loopTick;
+
+    _usPerQN = _loopUsPerQN;
+    _tempo = (60 * 1000000L) / _usPerQN;
+    setTimeSignature(_loopTimeSignature[0], _loopTimeSignature[1]); // also recalculates tick time
+  }
+  heapBuild();
+  _loopCount++;
+}
+
+uint16_t MD_MIDIFile::loopCheck(uint16_t ticks)
+// Deal with playback reaching the start or the end of the loop region in the 
+// next ticks. The events before each point are processed first so the state is 
+// saved, or playback wraps, exactly one tick before the point. Returns the ticks 
+// left to count from the new position.
+{
+  uint32_t pos = getTickPosition();
+
+  // first time at the start of the loop, so save the state
+  if (!_loopSaved && (_loopStart != 0) && (pos < _loopStart) && (ticks > _loopStart - 1 - pos))
+  {
+    uint16_t pre = _loopStart - 1 - pos;
+
+    if (pre != 0)
+    {
+      processEvents(pre);
+      ticks -= pre;
+    }
+    loopSave();
+    pos = _loopStart - 1;
+  }
+
+  if (pos >= _loopEnd)    // already past the loop
+    return(ticks);
+
+  // wrap to the start of the loop, as often as needed to use up the ticks
+  while (ticks > _loopEnd - 1 - pos)
+  {
+    uint16_t pre = _loopEnd - 1 - pos;
+
+#if !MIDI_SEEK_CHECKPOINTS
+    if (!_loopSaved && (_loopStart != 0))
+      break;    // the loop starts the next time playback reaches the start
+#endif
+    if (pre != 0)
+    {
+      processEvents(pre);
+      ticks -= pre;
+    }
+
+#if MIDI_SEEK_CHECKPOINTS
+    if (!_loopSaved && (_loopStart != 0))
+    {
+      // the start was passed before the loop was set, so seek to it once
+      seekTick(_loopStart);
+      _tickCount--;
+      loopSave();
+      _loopCount++;
+    }
+    else
+#endif
+      loopRestore();
+
+    pos = _loopStart - 1;
+  }
+
+  return(ticks);
+}
+#endif // MIDI_LOOP_REGION
+
+#if MIDI_CLOCK_OUT
+void MD_MIDIFile::sendClock(uint8_t status, uint16_t beats)
+// pass a clock message on to the user code
+{
+  uint8_t data[3];
+
+  data[0] = status;
+  data[1] = beats & 0x7f;
+  data[2] = (beats >> 7) & 0x7f;
+
+  if (_clockHandler != nullptr)
+    (_clockHandler)(data, (status == 0xf2 ? 3 : 1));
+  else if (_clockHandlerCtx != nullptr)
+    (_clockHandlerCtx)(data, (status == 0xf2 ? 3 : 1), _clockCtx);
+}
+
+void MD_MIDIFile::clockTick(uint16_t ticks)
+// There are _ticksPerQuarterNote / 24 ticks to a clock. The ticks are counted 
+// in 24ths in _clockAcc, so each clock is sent on the first tick at or after 
+// it is due, with no rounding error carried forward.
+{
+  if (!isClockOut())
+    return;
+
+  if (_clockState == CLOCK_IDLE)
+  {
+    // the first clock is at the start of the SMF, the ticks counted from there
+    sendClock(0xfa, 0);
+    sendClock(0xf8, 0);
+    _clockAcc = 0;
+  }
+  else if (_clockState == CLOCK_STOP)
+    sendClock(0xfb, 0);
+  _clockState = CLOCK_RUN;
+
+  _clockAcc += (uint32_t)ticks * 24;
+  while (_clockAcc >= (int32_t)_ticksPerQuarterNote)
+  {
+    sendClock(0xf8, 0);
+    _clockAcc -= _ticksPerQuarterNote;
+  }
+}
+
+void MD_MIDIFile::clockStop(uint8_t state)
+{
+  if (_clockState == CLOCK_RUN && isClockOut())
+    sendClock(0xfc, 0);
+  _clockState = state;
+}
+
+void MD_MIDIFile::clockPosition(void)
+// Send the position of the next 16th note (6 clocks) and set the clock count 
+// so the next clock is sent on the tick for that 16th note.
+{
+  uint32_t beats = (_tickCount * 4 + _ticksPerQuarterNote - 1) / _ticksPerQuarterNote;
+
+  clockStop(CLOCK_STOP);
+
+  if (beats > 0x3fff)   // past the end of the pointer range
+  {
+    beats = 0x3fff;
+    _clockAcc = 0;
+  }
+  else
+    _clockAcc = _ticksPerQuarterNote - (int32_t)(beats * _ticksPerQuarterNote - _tickCount * 4) * 6;
+
+  if (isClockOut())
+    sendClock(0xf2, beats);
+}
+#endif // MIDI_CLOCK_OUT
+
+#if MIDI_CLOCK_SYNC
+void MD_MIDIFile::setClockSync(bool bEnable)
+{
+  if (bEnable && !_syncMode)
+  {
+    // start the loop at the current tempo, 24 clocks per quarter note
+    _syncPeriod = ((((uint32_t)_tickTime << 8) + (_tickFrac >> 8)) * _ticksPerQuarterNote) / 24;
+    _syncRunning = _syncLocked = false;
+
+    // wait at the current position for the clock to start
+    _syncBase = getTickPosition();
+    _syncClock = 0;
+    _syncFirst = true;
+    syncPosition();
+  }
+  else if (!bEnable && _syncMode)
+  {
+    // the library clock carries on from now
+    _lastTickCheckTime = micros();
+    _lastTickError = 0;
+  }
+
+  _syncMode = bEnable;
+}
+
+void MD_MIDIFile::syncPosition(void)
+{
+  _syncTick = _syncBase + ((uint32_t)_syncClock * _ticksPerQuarterNote) / 24;
+}
+
+void MD_MIDIFile::clockEvent(uint8_t status, uint32_t t)
+{
+  if (!_syncMode)
+    return;
+
+  switch (status)
+  {
+  case 0xf8:    // Timing Clock
+    if (_syncLocked)
+    {
+      uint32_t p = _syncPeriod >> 8;
+      int32_t err = (int32_t)(t - (_syncLast + p));   // from the predicted time
+
+      if ((err > (int32_t)(p / 4)) || (err < -(int32_t)(p / 4)))
+      {
+        // Too far out to be jitter, so the tempo has changed or the clock has 
+        // stopped for a while. Lock on to this clock and the last interval.
+        if (t - _syncRaw < 4 * p)
+          _syncPeriod = (t - _syncRaw) << 8;
+        _syncLast = t;
+      }
+      else
+      {
+        // Phase locked loop: move the clock time by 1/4 of the error and 
+        // the period by 1/16 of the error (24.8 fixed point).
+        _syncLast += p + err / 4;
+        _syncPeriod += err * 16;
+      }
+    }
+    else
+    {
+      _syncLast = t;
+      _syncLocked = true;
+    }
+    _syncRaw = t;
+
+    // count the clock from the current position
+    if (_syncRunning)
+    {
+      if (_syncFirst)
+        _syncFirst = false;
+      else if (++_syncClock >= 24)
+      {
+        _syncClock = 0;
+        _syncBase += _ticksPerQuarterNote;
+      }
+    }
+    break;
+
+  case 0xfa:    // Start
+    restart();
+    _syncBase = 0;
+    _syncClock = 0;
+    _syncFirst = true;
+    syncPosition();
+    // fall through
+
+  case 0xfb:    // Continue
+    _syncRunning = true;
+    pause(false);
+    break;
+
+  case 0xfc:    // Stop
+    _syncRunning = false;
+    pause(true);
+    break;
+  }
+}
+
+void MD_MIDIFile::clockSongPosition(uint16_t beats)
+// A MIDI beat is 6 clocks, so there are 4 to the quarter note
+{
+  if (!_syncMode)
+    return;
+
+  _syncBase = (uint32_t)(beats >> 2) * _ticksPerQuarterNote;
+  _syncClock = (beats & 3) * 6;
+  _syncFirst = true;
+  syncPosition();
+
+#if MIDI_SEEK_CHECKPOINTS
+  seekTick(_syncTick);
+#else
+  if (beats == 0)
+    restart();
+#endif
+}
+
+uint16_t MD_MIDIFile::syncClock(void)
+// Work out the SMF tick from the last clock and the time since then as a fraction 
+// of the smoothed clock period. The fraction is held below 1, so playback never 
+// gets ahead of the clocks received and waits if the master slows down or stops.
+{
+  uint32_t p = _syncPeriod >> 8;
+  int32_t  dt = (int32_t)(micros() - _syncLast);
+  uint32_t f, pos;
+
+  if (!_syncRunning || _syncFirst)
+    return(0);
+
+  if (dt <= 0)
+    f = 0;
+  else if ((uint32_t)dt >= p)
+    f = 255;
+  else
+    f = ((uint32_t)dt << 8) / p;
+
+  pos = _syncBase + ((((uint32_t)_syncClock << 8) + f) * _ticksPerQuarterNote) / (24 << 8);
+  if (pos <= _syncTick)
+    return(0);
+
+  f = pos - _syncTick;
+  if (f > 0xffff) f = 0xffff;
+  _syncTick += f;
+
+#if MIDI_TIMING_STATS
+  if (f > _stats.catchUpMax)
+    _stats.catchUpMax = f;
+#endif
+
+  return(f);
+}
+#endif // MIDI_CLOCK_SYNC
+
+bool MD_MIDIFile::heapBefore(uint8_t a, uint8_t b)
+// true if track a has an event due before track b
+{
+  uint32_t ta = _track[a].getNextEventTick();
+  uint32_t tb = _track[b].getNextEventTick();
+
+  return((ta < tb) || (ta == tb && a < b));
+}
+
+void MD_MIDIFile::heapSiftDown(uint16_t idx)
+// move the track at idx down the heap to its correct position. The index 
+// arithmetic is 16 bit as the children of the entries above 127 are past 255.
+{
+  uint8_t trk = _heap[idx];
+
+  while (true)
+  {
+    uint16_t child = (2 * idx) + 1;
+ 
+    if (child >= _heapCount)
+      break;
+    if ((child + 1 < _heapCount) && heapBefore(_heap[child + 1], _heap[child]))
+      child++;
+    if (!heapBefore(_heap[child], trk))
+      break;
+
+    _heap[idx] = _heap[child];
+    idx = child;
+  }
+  _heap[idx] = trk;
+}
+
+void MD_MIDIFile::heapBuild(void)
+// put all the tracks that have not ended into the scheduling heap
+{
+  _heapCount = 0;
+  for (uint8_t i = 0; i < _trackCount; i++)
+    if (!_track[i].getEndOfTrack())
+      _heap[_heapCount++] = i;
+
+  for (uint16_t i = _heapCount / 2; i > 0; i--)
+    heapSiftDown(i - 1);
+}
+
+void MD_MIDIFile::heapUpdateTop(void)
+// the track at the top of the heap has changed, so reschedule it
+{
+  if (_track[_heap[0]].getEndOfTrack())
+    _heap[0] = _heap[--_heapCount];   // remove the track from the heap
+
+  if (_heapCount > 1)
+    heapSiftDown(0);
+}
+
+void MD_MIDIFile::trackEvent(uint8_t i)
+{
+  if (_format != 0) DUMPX("", i);
+
+  if (_track[i].getNextEvent(this, _tickCount) && (_format != 0))
+    DUMPS("\n-- TRK "); 
+}
+
+void MD_MIDIFile::processEvents(uint16_t ticks)
+{
+#if MIDI_LOOP_REGION
+  // the events up to the loop points are processed first, in their own calls
+  if (_loopEnd != 0)
+    ticks = loopCheck(ticks);
+#endif
+
+  uint16_t n = 0;           // events processed
+  bool over = false;        // true if the budget ran out with events still due
+  uint32_t start = (_timeBudget != 0 ? micros() : 0);
+#if MIDI_TIMING_STATS
+  uint32_t startEvents = _stats.events;
+
+  _stats.ticks += ticks;
+#endif
+
+  _tickCount += ticks;
+#if MIDI_CLOCK_OUT
+  clockTick(ticks);   // before the events at the same tick
+#endif
+
+  if (_format != 0) 
+  {
+    DUMP("\n-- [", ticks); 
+    DUMPS("] TRK "); 
+  }
+
+  // The tracks are kept in a heap ordered by the tick of their next event, so 
+  // only tracks with events due are touched and the earliest is always at the top.
+  // Any events still due when the budget runs out are left for the next call.
+  switch (_eventOrder)
+  {
+  case ORDER_TRACK:
+    // process all the events due on one track before moving on to the next
+    for (uint8_t i = 0; (i < _trackCount) && !over; i++)
+    {
+      while (_track[i].isEventDue(_tickCount))
+      {
+        if ((n != 0) && isBudgetUsed(n, start))
+        {
+          over = true;
+          break;
+        }
+        trackEvent(i);
+        n++;
+      }
+    }
+
+    // reschedule all the tracks processed
+    if (n != 0)
+      heapBuild();
+    break;
+
+  case ORDER_EVENT:
+  {
+    // process one event from each track due, round-robin style
+#if MIDI_TRACK_ARENA
+    uint8_t *due = _heap + _trackCount;   // carved after the heap
+#else
+    uint8_t due[MIDI_MAX_TRACKS];
+#endif
+    uint8_t dueCount;
+
+    while (!over)
+    {
+      // take all the tracks with events due off the heap
+      for (dueCount = 0; (_heapCount > 0) && _track[_heap[0]].isEventDue(_tickCount); dueCount++)
+      {
+        due[dueCount] = _heap[0];
+        _heap[0] = _heap[--_heapCount];
+        if (_heapCount > 1)
+          heapSiftDown(0);
+      }
+
+      // When there are no more events, just break out
+      if (dueCount == 0)
+        break;
+
+      // cycle through all the due tracks
+      for (uint8_t j = 0; j < dueCount; j++)
+      {
+        if ((n != 0) && isBudgetUsed(n, start))
+        {
+          over = true;
+          break;
+        }
+        trackEvent(due[j]);
+        n++;
+      }
+
+      // put them back into the heap for the next time around
+      for (uint8_t j = 0; j < dueCount; j++)
+      {
+        uint8_t i = due[j];
+        
+        if ((_heapCount < _trackCount) && !_track[i].getEndOfTrack())
+        {
+          uint16_t k = _heapCount++;
+
+          // sift up to the correct place
+          while ((k > 0) && heapBefore(i, _heap[(k - 1) / 2]))
+          {
+            _heap[k] = _heap[(k - 1) / 2];
+            k = (k - 1) / 2;
+          }
+          _heap[k] = i;
+        }
+      }
+    } 
+  }
+  break;
+
+  default:  // ORDER_TIME
+    // process events in time order, with events on the same tick taken from 
+    // the lowest numbered track first
+    while ((_heapCount > 0) && _track[_heap[0]].isEventDue(_tickCount))
+    {
+      uint8_t i = _heap[0];
+
+      if ((n != 0) && isBudgetUsed(n, start))
+      {
+        over = true;
+        break;
+      }
+      trackEvent(i);
+      n++;
+
+      // reschedule the track, unless a callback has changed the tracks
+      if ((_heapCount > 0) && (_heap[0] == i))
+        heapUpdateTop();
+    }
+    break;
+  }
+
+  _carryOver = over;
+#if MIDI_TIMING_STATS
+  if (over)
+    _stats.capHits++;
+  if (_stats.events - startEvents > _stats.eventsMax)
+    _stats.eventsMax = (_stats.events - startEvents > 0xffff ? 0xffff : _stats.events - startEvents);
+#endif
+
+  flushBatch();   // all the MIDI events for this tick
+}
+
+uint32_t MD_MIDIFile::render(uint32_t maxEvents)
+{
+  uint32_t n = 0;
+
+#if MIDI_QUEUE_SIZE
+  if (_queueMode)
+    return(0);
+#endif
+
+  // sync start all the tracks if we need to
+  if (!_synchDone)
+  {
+    synchTracks();
+    _synchDone = true;
+  }
+
+  // Process events in time order, moving the time on to each event as it
+  // comes due, at the tempo in effect up to that event.
+  while ((_heapCount > 0) && ((maxEvents == 0) || (n < maxEvents)))
+  {
+    uint8_t i = _heap[0];
+
+    if (!_track[i].isEventDue(_tickCount))
+    {
+      uint32_t t = _track[i].getNextEventTick();
+
+      flushBatch();   // all the MIDI events for the last tick
+      _renderTime += ticksToSpan(t - _tickCount, _tickTime, _tickFrac, _renderPhase);
+      _renderPhase += (t - _tickCount) * _tickFrac;
+      _tickCount = t;
+    }
+
+    trackEvent(i);
+    n++;
+
+    // reschedule the track, unless a callback has changed the tracks
+    if ((_heapCount > 0) && (_heap[0] == i))
+      heapUpdateTop();
+  }
+  flushBatch();
+
+  return(n);
+}
+
+#if MIDI_TRACK_ARENA
+void MD_MIDIFile::setArena(void *mem, uint32_t size)
+{
+  close();
+  _arena = (uint8_t *)mem;
+  _arenaSize = (mem == nullptr ? 0 : size);
+  _track = nullptr;
+  _heap = nullptr;
+}
+
+uint32_t MD_MIDIFile::getArenaSize(uint8_t tracks)
+// Each track needs the track object, a read-ahead buffer and 2 bytes for the heap 
+// and the list of tracks due. Allow for aligning the track objects.
+{
+  return((alignof(MD_MFTrack) - 1) + ((uint32_t)tracks * (sizeof(MD_MFTrack) + MIDI_TRACK_BUFFER_SIZE + 2)));
+}
+
+bool MD_MIDIFile::arenaCarve(uint8_t tracks)
+// lay out the tracks, their buffers and the heap in the arena
+{
+  uintptr_t p = ((uintptr_t)_arena + alignof(MD_MFTrack) - 1) & ~(uintptr_t)(alignof(MD_MFTrack) - 1);
+  uint8_t *pb;
+
+  if ((_arena == nullptr) || (_arenaSize < getArenaSize(tracks)))
+    return(false);
+
+  _track = (MD_MFTrack *)p;
+  for (uint8_t i = 0; i < tracks; i++)
+    new (&_track[i]) MD_MFTrack;
+
+  pb = (uint8_t *)(_track + tracks);
+#if MIDI_TRACK_BUFFER_SIZE
+  for (uint8_t i = 0; i < tracks; i++, pb += MIDI_TRACK_BUFFER_SIZE)
+    _track[i].setBuffer(pb);
+#endif
+  _heap = pb;
+
+  return(true);
+}
+#endif
+
+int MD_MIDIFile::load(const char *fname) 
+// Load the MIDI file into memory ready for processing
+// Return one of the E_* error codes
+{
+  _fileName = fname;
+  
+  if ((_fileName == nullptr) || (*_fileName == '\0'))
+    return(E_NO_FILE);
+
+  // open the file for reading
+  if (!_srcSD.open(_fileName)) 
+    return(E_NO_OPEN);
+
+  return(load(&_srcSD));
+}
+
+int MD_MIDIFile::load(const uint8_t *data, uint32_t len)
+// Load the SMF from a memory buffer
+{
+  if (data == nullptr || len == 0)
+    return(E_NO_FILE);
+
+  _srcMem.open(data, len);
+
+  return(load(&_srcMem));
+}
+
+int MD_MIDIFile::load_P(const uint8_t *data, uint32_t len)
+// Load the SMF from a PROGMEM buffer
+{
+  if (data == nullptr || len == 0)
+    return(E_NO_FILE);
+
+#ifdef __AVR__
+  _srcMem.open(data, len, true);
+#else
+  _srcMem.open(data, len);    // program memory is directly addressable
+#endif
+
+  return(load(&_srcMem));
+}
+
+int MD_MIDIFile::load(MD_MFSource *src)
+// Load the MIDI file header and tracks from the data source
+// Return one of the E_* error codes
+{
+  uint32_t dat32;
+  uint16_t dat16;
+
+  if (src == nullptr)
+    return(E_NO_FILE);
+
+  _src = src;
+  _src->seekSet(0);
+
+  // Read the MIDI header
+  // header chunk = "MThd" + <header_length:4> + <format:2> + <num_tracks:2> + <time_division:2>
+  {
+    char    h[MTHD_HDR_SIZE+1]; // Header characters + nul
+
+    _src->read(h, MTHD_HDR_SIZE);
+    h[MTHD_HDR_SIZE] = '\0';
+
+#if MIDI_COMPILED_STREAM
+    if (strcmp(h, MFST_HDR) == 0)
+      return(loadStream());
+#endif
+    if (strcmp(h, MTHD_HDR) != 0)
+    {
+      _src->close();
+      return(E_NOT_MIDI);
+    }
+  }
+
+  // read header size
+  dat32 = readMultiByte(_src, MB_LONG);
+  if (dat32 != 6)   // must be 6 for this header
+  {
+    _src->close();
+    return(E_HEADER);
+  }
+  
+  // read file type
+  dat16 = readMultiByte(_src, MB_WORD);
+  if ((dat16 != 0) && (dat16 != 1))
+  {
+    _src->close();
+    return(E_FORMAT);
+  }
+  _format = dat16;
+ 
+  // read number of tracks
+  dat16 = readMultiByte(_src, MB_WORD);
+  if ((_format == 0) && (dat16 != 1)) 
+  {
+    _src->close();
+    return(E_FORMAT0);
+  }
+#if MIDI_TRACK_ARENA
+  if ((dat16 > 255) || !arenaCarve(dat16))
+#else
+  if (dat16 > MIDI_MAX_TRACKS)
+#endif
+  {
+    _src->close();
+    return(E_TRACKS);
+  }
+  _trackCount = dat16;
+
+  // read ticks per quarter note
+  dat16 = readMultiByte(_src, MB_WORD);
+  if (dat16 & 0x8000) // top bit set is SMTE format
+  {
+    int framespersecond = (dat16 >> 8) & 0x00ff;
+    int resolution      = dat16 & 0x00ff;
+
+    switch (framespersecond) 
+    {
+      case 232:  framespersecond = 24; break;
+      case 231:  framespersecond = 25; break;
+      case 227:  framespersecond = 29; break;
+      case 226:  framespersecond = 30; break;
+      default:   _src->close(); return(7);
+    }
+    dat16 = framespersecond * resolution;
+  } 
+  _ticksPerQuarterNote = dat16;
+  calcTickTime();  // we may have changed from default, so recalculate
+#if MIDI_SEEK_CHECKPOINTS
+  seekReset();
+#endif
+
+  // load all tracks
+  for (uint8_t i = 0; i<_trackCount; i++)
+  {
+    int err;
+
+    if ((err = _track[i].load(i, this)) != -1)
+    {
+      _src->close();
+      return((10*(i+1))+err);
+    }
+   }
+
+  return(loadFinish());
+}
+
+int MD_MIDIFile::loadFinish(void)
+// Build the load time data and get the tracks ready to play
+// Return one of the E_* error codes
+{
+#if MIDI_LOAD_SCAN || MIDI_TEMPO_MAP_SIZE
+#if MIDI_PLAYLIST_SIZE
+  if (_scanDefer)   // the playlist preload builds the tempo map in steps
+  {
+#if MIDI_LOAD_SCAN
+    memset(&_scanStats, 0, sizeof(_scanStats));
+#endif
+  }
+  else
+#endif
+  {
+#if MIDI_LOAD_SCAN
+    int err;
+
+    if ((err = scan()) != E_OK)
+    {
+      _src->close();
+      return(err);
+    }
+#else
+    tempoMapBuild();
+#endif
+  }
+#endif
+
+  synchTracks();  // ready to play, even if the caller is generating the ticks
+  _tickBase = 0;
+#if MIDI_TIMING_STATS
+  resetTimingStats();   // only count the reads made during playback
+#endif
+
+  return(E_OK);
+}
+
+#if MIDI_COMPILED_STREAM
+int MD_MIDIFile::loadStream(void)
+// Load the rest of the compiled stream header and set up the single track
+// stream_header = "MFst" + <version:1> + <format:1> + <num_tracks:1> + <0:1> + <time_division:2> + <0:6>
+// Return one of the E_* error codes
+{
+  uint32_t size = _src->size();
+
+  if ((size < MFST_HDR_LEN) || ((size - MFST_HDR_LEN) % MFST_RECORD != 0) ||
+      (readMultiByte(_src, MB_BYTE) != MFST_VERSION))
+  {
+    _src->close();
+    return(E_HEADER);
+  }
+
+  _format = readMultiByte(_src, MB_BYTE);
+  readMultiByte(_src, MB_WORD);   // tracks in the source SMF and reserved byte
+#if MIDI_TRACK_ARENA
+  if (!arenaCarve(1))
+  {
+    _src->close();
+    return(E_TRACKS);
+  }
+#endif
+  _trackCount = 1;
+
+  _ticksPerQuarterNote = readMultiByte(_src, MB_WORD);
+  calcTickTime();  // we may have changed from default, so recalculate
+#if MIDI_SEEK_CHECKPOINTS
+  seekReset();
+#endif
+
+  _track[0].loadStream(MFST_HDR_LEN, size - MFST_HDR_LEN);
+
+  return(loadFinish());
+}
+
+uint32_t MD_MIDIFile::compile(Print *out)
+// Write all the events in time order as a compiled stream
+{
+  uint8_t h[MFST_HDR_LEN];
+  uint32_t total = MFST_HDR_LEN;
+  uint32_t last = 0;        // tick of the last record written
+  uint32_t end = 0;         // tick of the last event in the SMF
+  uint8_t endTrack = 0;     // track with the last event
+  bool looping = _looping;
+
+  if ((out == nullptr) || (_trackCount == 0) || _track[0].isStream())
+    return(0);
+#if MIDI_QUEUE_SIZE
+  if (_queueMode)
+    return(0);
+#endif
+
+  _looping = false;   // so all the tracks start from the beginning
+  restart();
+
+  memset(h, 0, sizeof(h));
+  memcpy(h, MFST_HDR, MFST_HDR_SIZE);
+  h[4] = MFST_VERSION;
+  h[5] = _format;
+  h[6] = _trackCount;
+  h[8] = _ticksPerQuarterNote >> 8;
+  h[9] = _ticksPerQuarterNote & 0xff;
+  if (out->write(h, sizeof(h)) != sizeof(h))
+    total = 0;
+
+  // take the events in the order they are played
+  while ((total != 0) && (_heapCount > 0))
+  {
+    uint8_t i = _heap[0];
+    int32_t n;
+
+    if (_track[i].getNextEventTick() >= end)
+    {
+      end = _track[i].getNextEventTick();
+      endTrack = i;
+    }
+
+    if ((n = _track[i].compileEvent(this, out, &last)) < 0)
+      total = 0;
+    else
+      total += n;
+
+    heapUpdateTop();
+  }
+
+  // one End of Track for the whole stream, when the last track ends, with the 
+  // META type in its data block
+  if (total != 0)
+  {
+    memset(h, 0, sizeof(h));
+    MD_MFTrack::putRecord(h, end - last, endTrack, 0xff, 0, 0);
+    h[MFST_RECORD] = 0x2f;
+    if (out->write(h, 2 * MFST_RECORD) != 2 * MFST_RECORD)
+      total = 0;
+    else
+      total += 2 * MFST_RECORD;
+  }
+
+  restart();
+  _looping = looping;
+
+  return(total);
 }
+#endif
 
 #if DUMP_DATA
 void MD_MIDIFile::dump(void)
@@ -1,8 +1,8 @@
 /**
 \mainpage Arduino Standard MIDI File (SMF) Player
 
-This library allows Standard MIDI Files (SMF) to be read from an SD card and played through 
-a MIDI interface. SMF can be opened and processed, with MIDI and SYSEX events passed to the 
+This library allows Standard MIDI Files (SMF) to be read from an SD card, or from memory,
+and played through a MIDI interface. SMF can be opened and processed, with MIDI and SYSEX events passed to the 
 calling program through callback functions. This allows the calling application to manage 
 sending to a MIDI synthesizer through serial interface or other output device, such as a MIDI 
 shield. SMF playing may be controlled through the library using methods to start, pause and 
@@ -30,6 +30,39 @@ Topics
 
 Revision History
 ----------------
+Oct 2026 version 2.7.0
+- Track delta times are decoded once and cached with the absolute tick the event is due.
+- Added optional per-track read-ahead buffers (MIDI_TRACK_BUFFER_SIZE).
+- Added MD_MFSource data source interface and load() from memory, PROGMEM or user source.
+- Tracks are now scheduled by next event time in a min-heap in processEvents().
+- Added getMicrosToNextEvent() for sleep or timer driven playback.
+- Added interrupt driven playback queue (MIDI_QUEUE_SIZE, queueEvents(), dispatchQueue()).
+- Added seekTick() and seekMillis() with seek index and chase of channel state (MIDI_SEEK_CHECKPOINTS).
+- Added tempo map built at load (MIDI_TEMPO_MAP_SIZE) with getDuration() and tick/time conversion.
+- Added getTickPosition().
+- Tick clock uses a 16.16 fixed point tick time set from the SMF tempo, with no divide per call.
+- Added batch MIDI callback for all the events on the same tick (MIDI_BATCH_SIZE, setMidiBatchHandler()).
+- Added callbacks with a user context and MD_MIDIFilePlayer template with a handler object.
+- Added MD_MIDIMulti engine to play several SMF at the same time (MIDI_MULTI_SONGS).
+- Added user supplied memory arena for the tracks, sized to the SMF (MIDI_TRACK_ARENA, setArena()).
+- Added stream mode to pass SYSEX and META data in chunks without copies (MIDI_STREAM_CHUNK_SIZE, setStreamHandler()).
+- Added event filters by status, channel and META type (MIDI_EVENT_FILTER, setStatusFilter(), setChannelFilter(), setMetaFilter()).
+- Added playback timing statistics for lateness, catch up, events per tick and read time (MIDI_TIMING_STATS, getTimingStats()).
+- Added a desktop benchmark for the parser in extras/benchmark.
+- Added load time scan to check all the events and collect SMF statistics (MIDI_LOAD_SCAN, getScanStats()).
+- Added tracking of the notes sounding with silenceActiveNotes() (MIDI_ACTIVE_NOTES).
+- Added MD_MIDIPlaylist to play a list of SMF with no gap, loading the next SMF during playback (MIDI_PLAYLIST_SIZE).
+- Replaced TRACK_PRIORITY with a run time event order and a per call event and time budget for processEvents() (setEventOrder(), setProcessBudget()).
+- Added sync to an external MIDI clock with a phase locked loop and Song Position Pointer (MIDI_CLOCK_SYNC, setClockSync(), clockEvent()).
+- Added MIDI clock output locked to the playback ticks (MIDI_CLOCK_OUT, setClockHandler()).
+- Added MD_MIDIOut serial output with running status and a non-blocking transmit buffer (MIDI_OUT_BUFFER_SIZE).
+- Added render() to process a SMF as fast as possible with the tick and time of each event.
+- Added A/B loop regions set in ticks or from marker META events, restored with no scan at each wrap (MIDI_LOOP_REGION, setLoopRegion(), setLoopMarkers()).
+- Added pipelined playback with the SMF read and the events sent on different cores for ESP32 and RP2040 (MIDI_PIPELINE, pipelineMode()).
+- Added compile time transform chain for MD_MIDIFilePlayer with transpose, velocity and channel map stages (MD_MFTransform).
+- Added MD_MIDICatalog to index the SMF in a folder to a file on the SD card, updated by loading only new or changed SMF (MIDI_CATALOG_NAME_SIZE).
+- Added compile() to convert a SMF to a time sorted compiled stream that load() plays with sequential reads, and smfcompile in extras/benchmark (MIDI_COMPILED_STREAM).
+
 Apr 2022 version 2.6.0
 - Changes file referencing from SdFat only to FAT16/FAT32/exFAT using SD_FAT_TYPE define.
 - Adjusted examples for SDFat library version 2 changes/deprecated methods.
@@ -343,6 +376,288 @@ _NOTE_: Compile switches must be edited in the library header file. Arduino head
 'mashing' during compilation makes the setting of these switches from user code
 completely unreliable.
 
+Interrupt Driven Playback
+-------------------------
+When MIDI_QUEUE_SIZE is not 0 the library can decouple reading the SMF from the 
+timing of the MIDI output. In queue mode (queueMode()) the main loop calls queueEvents()
+to read ahead from the SMF into a lock-free queue of time stamped events, and a hardware 
+timer interrupt calls dispatchQueue() to send each event at the time it is due. Delays 
+in the main loop (eg, updating a display) or the SD card then have no effect on the
+timing of the music, provided the queue does not run empty.
+
+In this mode the MIDI callback set by setMidiHandler() is called from the interrupt 
+service routine, so it must follow the rules for interrupt context code:
+- Keep it short. Send the event and return, as other interrupts are held up.
+- Do not access the SD card, use delay() or print debug output to the Serial port.
+- Any data shared with the main loop must be declared volatile and multi-byte values
+must be read with interrupts disabled.
+- Serial.write() may be used if the transmit buffer has room for the whole message.
+The Serial transmit buffer must not be allowed to fill from inside the 
+interrupt on some architectures.
+
+The SYSEX and META callbacks are called from queueEvents() in the main loop, ahead of 
+the time the events would be heard.
+
+Pipelined Playback
+------------------
+On dual core processors the queue can be used to put the reading of the SMF and 
+the sending of the events on different cores (MIDI_PIPELINE, pipelineMode()):
+- ESP32: a FreeRTOS task reads the SMF and another sends the events, each pinned 
+to the core and given the priority set in the Configuration Section.
+- RP2040: the second core sends the events and pipelineLoop(), called from loop(), 
+reads the SMF.
+- other processors: pipelineLoop() does both from loop(), the same as queue mode 
+with dispatchQueue() called from the main loop.
+
+MIDI_QUEUE_SIZE is the depth of the queue between the cores. The SMF state is only 
+changed by the read side, so the application must hold the pipeline with 
+pipelineLock() around any call that changes the SMF, such as pause() or seekTick().
+
+\code
+  SMF.load(fileName);
+  SMF.pipelineMode(true);
+  ...
+  SMF.pipelineLoop();
+  if (buttonPressed)
+  {
+    SMF.pipelineLock();
+    SMF.pause(true);
+    SMF.pipelineUnlock();
+  }
+\endcode
+
+Fast Seek
+---------
+When MIDI_SEEK_CHECKPOINTS is not 0, seekTick() and seekMillis() move playback to any 
+point in the SMF without playing the events before it. A seek scans the tracks at
+full speed with the callbacks suspended and keeps the last program, controller and 
+pitch bend settings for each MIDI channel, which are sent once the new position is 
+reached.
+
+To avoid scanning the SMF from the start for every seek, the scan saves checkpoints 
+in a seek index at regular tick intervals. A later seek starts from the nearest 
+checkpoint before the target. When the index is full every second checkpoint is 
+dropped and the interval doubles, so the index always covers all of the SMF that 
+has been scanned. The index is cleared when a new SMF is loaded.
+
+Loop Region
+-----------
+When MIDI_LOOP_REGION is not 0 playback can repeat a part of the SMF, from a start 
+point A to an end point B, set in ticks by setLoopRegion() or from the text of two 
+Marker META events by setLoopMarkers(). When playback first reaches A the library 
+saves the position of each track in the file, its running status and the tempo and 
+time signature. Each time playback reaches B these are put back, so the wrap takes 
+the same short time wherever A is in the SMF, with no scan of the tracks. Any ticks 
+counted past B carry on from A, so the loop keeps time.
+
+The data at A is read again from the source after each wrap, as for a seek. With a 
+track buffer this is one read for each track.
+
+Callback Context
+----------------
+Each set*Handler() method has a second form that also takes a void* context pointer, 
+which is passed back to the callback with each event. This allows more than one 
+player, each with its own output, without global variables.
+
+The MD_MIDIFilePlayer template class goes one step further and holds a handler 
+object whose midi(), sysex() and meta() methods are called for each event. As the
+handler class is known at compile time, the handler methods can be inlined into the 
+callbacks set up by the player.
+
+The player can also run each MIDI event through a chain of transform stages before 
+it reaches the handler, given as the second template parameter. The library has 
+stages to transpose notes (MD_MFTranspose), scale velocity (MD_MFVelocity) and 
+remap or mute channels (MD_MFChannelMap), and any class with the same midi() 
+method can be a stage. The chain is fixed at compile time, so the stages used are 
+inlined with the handler and a player with no chain has no extra code.
+
+\code
+  typedef MD_MFTransform<MD_MFTranspose, MD_MFVelocity> Transform;
+  MD_MIDIFilePlayer<MyHandler, Transform> player;
+
+  player.transform().stage.semitones = -12;   // down an octave
+  player.transform().next.stage.scale = 96;   // 75% velocity
+\endcode
+
+Playing More Than One SMF
+-------------------------
+When MIDI_MULTI_SONGS is not 0 the MD_MIDIMulti class plays up to MIDI_MULTI_SONGS 
+SMF at the same time, for example a backing track, a click track and a drum loop. 
+Each song is a MD_MIDIFile object that keeps its own tempo, looping and pause state.
+The songs are scheduled from MD_MIDIMulti::getNextEvent(), one tick with events 
+at a time, taking the song with the earliest event in microseconds each time, so 
+all the events are passed to one set of callbacks in time order with the number of 
+the song they came from. With MIDI_TRACK_ARENA the songs can share one arena for 
+their tracks and buffers (MD_MIDIMulti::setArena() and MD_MIDIMulti::load()).
+
+Gapless Playlist
+----------------
+When MIDI_PLAYLIST_SIZE is not 0 the MD_MIDIPlaylist class plays a list of SMF one 
+after the other. Closing one SMF and loading the next takes time to find the file 
+and read the header and track chunks, which leaves an audible gap between songs. 
+The playlist uses two MD_MIDIFile objects, so the next SMF is loaded into one while 
+the other plays. The load and the read of the first block of each track are done 
+in steps from MD_MIDIPlaylist::getNextEvent(), each only when the current SMF has 
+no events due for a while (setPreloadTime()). The next SMF starts at the time the 
+last event of the current SMF was due.
+
+The load time scans, which read the whole SMF, are not done by the preload. With 
+MIDI_TEMPO_MAP_SIZE the tempo map is built in steps instead, a few events per step. 
+With MIDI_LOAD_SCAN the events of the SMF in the playlist are not checked and the 
+statistics from getScanStats() and getTrackEvents() are all 0.
+
+Folder Catalog
+--------------
+A player that shows the SMF on a card with their length or title has to load each
+file to find them, which takes a long time for a card with thousands of SMF. When 
+MIDI_CATALOG_NAME_SIZE is not 0 the MD_MIDICatalog class does this once and writes 
+the file name, format, track count, PPQN, playing time and title of each SMF to an 
+index file in the folder. Each entry is the same size, so a menu reads the entry it 
+shows directly from the index with getEntry().
+
+MD_MIDICatalog::build() lists the folder and only loads the SMF that are not in the 
+index or have a different size or modified time. If nothing has changed the index 
+is not written, so build() at each start up only costs the folder listing and one 
+read per SMF. MD_MIDICatalog::open() uses the index with no check of the folder.
+The playing time is only worked out if MIDI_TEMPO_MAP_SIZE is not 0.
+
+\code
+  MD_MIDICatalog CAT;
+  catalog_entry e;
+
+  CAT.begin(&SMF);
+  CAT.build("/");
+  for (uint16_t i = 0; i < CAT.getCount(); i++)
+    if (CAT.getEntry(i, &e) && e.error == MD_MIDIFile::E_OK)
+      Serial.println(e.title[0] != '\0' ? e.title : e.name);
+\endcode
+
+Compiled Streams
+----------------
+Playing a SMF means reading from a different place in the file for each track and 
+decoding the variable length delta times and running status of every event. When 
+MIDI_COMPILED_STREAM is not 0, compile() writes all the events of the loaded SMF 
+in the order they are played to a compiled stream. load() recognises a compiled 
+stream by its header and plays it with the same callbacks and control methods as 
+a SMF, reading it from start to end as one track.
+
+The stream is a 16 byte header ("MFst", version, SMF format, SMF tracks, PPQN) 
+followed by one 8 byte record for each event, with no running status or variable 
+length values to decode:
+- a 4 byte delta time in ticks from the last record
+- the number of the SMF track the event came from, so the events are passed to the 
+callbacks with their original track numbers
+- the status byte
+- for MIDI events the 2 data bytes, with the second 0 if the message has one
+- for SYSEX and META events the 2 byte length of the data, which follows the record
+in 8 byte data blocks padded with zeroes. The data blocks of a META event start with 
+the META type.
+
+The End of Track META events of the tracks are replaced by one at the end of the 
+stream. All the numbers are big endian and every record starts on a multiple of 8 
+bytes, so a stream in memory can be used in place and stepped through one record at 
+a time. SYSEX and META events longer than 65535 bytes cannot be compiled.
+
+The records are played by their own path in the library, which passes each MIDI 
+record on as it is. The stream is read in order from one place in the file, with one 
+seek to the start and no search for the next track. With MIDI_TRACK_BUFFER_SIZE set 
+or the stream in memory each record is used in place in the buffer. A compiled stream 
+is about twice the size of the SMF (1.8 to 2.6 times for the example files), so it 
+gives the most for SMF with many tracks playing together. It can be made on the 
+Arduino, writing to a file on the SD card, or on a desktop computer with smfcompile 
+in the extras/benchmark folder, and it can be played from memory with 
+load(data, len). getTrackCount() is 1 for a compiled stream and the events on the 
+same tick are played in track order, as for ORDER_TIME.
+
+\code
+  SDFILE f;
+
+  if (SMF.load("SONG.MID") == MD_MIDIFile::E_OK && f.open("SONG.MFS", O_WRITE | O_CREAT | O_TRUNC))
+  {
+    SMF.compile(&f);
+    f.close();
+  }
+  SMF.close();
+  SMF.load("SONG.MFS");   // plays like the SMF
+\endcode
+
+External MIDI Clock
+-------------------
+When MIDI_CLOCK_SYNC is not 0 playback can follow a MIDI clock from another device, 
+such as a drum machine or sequencer, instead of the tempo in the SMF. Once 
+setClockSync() is enabled the application passes each MIDI Clock (0xF8), Start 
+(0xFA), Continue (0xFB) and Stop (0xFC) message it receives to clockEvent(), with 
+the time it was received, and the 14 bit value of each Song Position Pointer (0xF2) 
+to clockSongPosition(). getNextEvent() is called as usual.
+
+\code
+  if (MIDI.available())
+  {
+    uint8_t c = MIDI.read();
+
+    if (c >= 0xf8)   // real time messages
+      SMF.clockEvent(c, micros());
+  }
+  SMF.getNextEvent();
+\endcode
+
+The time between clocks is smoothed by a phase locked loop, so jitter from the 
+sending device and the serial link is filtered out. Between clocks the SMF ticks 
+are spread evenly over the smoothed clock period, but playback never runs ahead 
+of the clocks received. After each clock exactly (clocks x ticks per quarter note 
+/ 24) ticks have been played, so there is no long term drift from the master. 
+Start plays the SMF from the beginning on the next clock, Stop pauses playback 
+and Continue carries on from the same place on the next clock. A Song Position 
+Pointer moves the SMF to the new position using the seek index 
+(MIDI_SEEK_CHECKPOINTS), or only to the start of the SMF if there is no index.
+
+MIDI Clock Output
+-----------------
+When MIDI_CLOCK_OUT is not 0 the library can also be the clock master for other 
+devices. The messages are passed to the callback set by setClockHandler() as the 
+bytes to send:
+- a MIDI Clock (0xF8) every 1/24 quarter note of playback, counted from the same 
+ticks as the SMF events so tempo changes, setTempoAdjust() and an external clock 
+are followed exactly. The clocks due at a tick are sent before the events due at 
+the same tick. When the ticks per quarter note are not a multiple of 24 each clock 
+is sent on the first tick at or after the time it is due, with no long term drift.
+- Start (0xFA) and the first clock when playback starts from the beginning of the 
+SMF, including each time the SMF loops.
+- Stop (0xFC) when playback is paused, reaches the end of the SMF or is closed.
+- Continue (0xFB) when playback starts again after a pause or a seek.
+- Song Position Pointer (0xF2) after a seek, for the next 16th note. The clocks 
+start again from that 16th note so the devices stay in step.
+
+Clocks are only sent from getNextEvent() and processEvents(), not by queueEvents().
+
+Serial Output with Running Status
+---------------------------------
+A MIDI message takes 320us per byte to send at 31,250 baud, so a busy part of the 
+SMF can take longer to send than it takes to play and the timing is smeared. When 
+MIDI_OUT_BUFFER_SIZE is not 0 the MD_MIDIOut class can be attached to a MD_MIDIFile 
+object to send the events to a serial port with fewer bytes:
+- the status byte is left out when it is the same as the status of the last message 
+sent (running status), across all the tracks of the SMF. With many notes on the same 
+channel this removes about one byte in three. 
+- optionally Note Off is sent as Note On with velocity 0, so notes starting and 
+ending can share the same running status.
+
+The bytes are put into a transmit buffer and written to the port only as fast as 
+the port takes them, so the library is never held up by the serial port. 
+MD_MIDIOut::transmit() should also be called from loop() to keep the buffer 
+moving. getBufferCount() and getBufferPeak() show how full the buffer is. If a 
+message does not fit in the buffer it is thrown away and counted by getDropCount().
+
+\code
+  MD_MIDIOut MIDIOut;
+
+  MIDIOut.begin(&Serial);
+  MIDIOut.attach(&SMF);     // set the SMF callbacks to MIDIOut
+  ...
+  SMF.getNextEvent();
+  MIDIOut.transmit();
+\endcode
+
 \page pageHardware Hardware Interface
 
 The MIDI communications hardware is a opt-isolated byte-based serial interface configured 
@@ -424,16 +739,311 @@ http://www.stephenhobley.com/blog/2011/03/14/the-last-darned-midi-interface-ill-
 #define MIDI_MAX_TRACKS 16
 #endif
 
-#ifndef TRACK_PRIORITY
+#ifndef MIDI_TRACK_BUFFER_SIZE
+/**
+ \def MIDI_TRACK_BUFFER_SIZE
+ Size in bytes of the read-ahead buffer allocated to each track. When non-zero, track 
+ data is read from the SD file in blocks of this size and the events are parsed from 
+ the buffer, so the file is only accessed when the buffer is empty. This uses 
+ MIDI_TRACK_BUFFER_SIZE * MIDI_MAX_TRACKS bytes of RAM. When set to 0 the data is 
+ read directly from the file one byte at a time.
+ */
+#define MIDI_TRACK_BUFFER_SIZE 0
+#endif
+
+#ifndef MIDI_TRACK_ARENA
+/**
+ \def MIDI_TRACK_ARENA
+ Set to 1 to take the track data from a memory arena supplied by the user code 
+ with setArena(), instead of having MIDI_MAX_TRACKS tracks built into each MD_MIDIFile 
+ object. load() then carves exactly the tracks in the SMF, and their read-ahead 
+ buffers, from the arena. Only the RAM needed for the SMF is used, and SMF with up 
+ to 255 tracks can be played if the arena is large enough. getArenaSize() gives the 
+ number of bytes needed. MIDI_MAX_TRACKS is not used when this is set to 1.
+ */
+#define MIDI_TRACK_ARENA 0
+#endif
+
+#ifndef MIDI_QUEUE_SIZE
+/**
+ \def MIDI_QUEUE_SIZE
+ Number of MIDI events held in the queue used for interrupt driven playback
+ (see queueEvents() and dispatchQueue()). Set to 0 to remove the queue and related 
+ code. Otherwise the size must be a power of 2 no larger than 128. Each queue 
+ entry uses 11 bytes of RAM.
+ */
+#define MIDI_QUEUE_SIZE 0
+#endif
+
+#ifndef MIDI_SEEK_CHECKPOINTS
+/**
+ \def MIDI_SEEK_CHECKPOINTS
+ Number of checkpoints held in the index used by seekTick() and seekMillis(). The 
+ index is built as the SMF is scanned by seeks and saves the position of each track, 
+ the tempo and the chased channel state at intervals through the SMF, so a seek only
+ scans forward from the nearest checkpoint. Set to 0 to remove the seek methods and 
+ related code. Each checkpoint uses 222 + (11 * MIDI_MAX_TRACKS) bytes of RAM.
+ */
+#define MIDI_SEEK_CHECKPOINTS 0
+#endif
+
+#ifndef MIDI_TEMPO_MAP_SIZE
+/**
+ \def MIDI_TEMPO_MAP_SIZE
+ Number of tempo changes held in the tempo map. When non-zero, load() scans all the 
+ tracks for Set Tempo events and the end of the SMF, so that the playing time of the 
+ SMF and conversions between ticks and time are available before it is played. The
+ scan reads the whole SMF once, increasing load() time. Set to 0 to remove the tempo
+ map and related code. The size can be up to 255 and each entry uses 20 bytes 
+ of RAM.
+ */
+#define MIDI_TEMPO_MAP_SIZE 0
+#endif
+
+#ifndef MIDI_BATCH_SIZE
+/**
+ \def MIDI_BATCH_SIZE
+ Number of MIDI events collected for the batch callback set by setMidiBatchHandler().
+ The MIDI events due on the same tick from all the tracks are passed in one call, so
+ the output can be sent in one transfer (eg, one USB-MIDI packet or one UART DMA 
+ burst). A full batch is sent early. Set to 0 to remove the batch handler and related
+ code. The size can be up to 255 and each entry uses 7 bytes of RAM. In queue mode 
+ dispatchQueue() collects the batch on the stack of the caller, usually an interrupt,
+ so there it is limited to MIDI_QUEUE_BATCH_SIZE events.
+ */
+#define MIDI_BATCH_SIZE 0
+#endif
+
+#ifndef MIDI_QUEUE_BATCH_SIZE
+/**
+ \def MIDI_QUEUE_BATCH_SIZE
+ Largest batch passed to the batch callback by dispatchQueue() in queue mode. The 
+ batch is held on the stack of the caller, normally an interrupt service routine, 
+ and uses 7 bytes of stack for each entry. Larger batches are passed in more than 
+ one call. Only used when MIDI_BATCH_SIZE and MIDI_QUEUE_SIZE are not 0.
+ */
+#define MIDI_QUEUE_BATCH_SIZE 16
+#endif
+
+#ifndef MIDI_STREAM_CHUNK_SIZE
+/**
+ \def MIDI_STREAM_CHUNK_SIZE
+ Largest number of data bytes passed in each call to the stream callback set by 
+ setStreamHandler(). In stream mode SYSEX and META events are passed to the callback
+ in chunks straight from the track read-ahead buffer (or the SMF in memory), with no
+ copy and no limit on the length, instead of as a sysex_event or meta_event. If the 
+ track is not buffered a stack buffer of this size is used. Set to 0 to remove stream
+ mode and related code. The size can be up to 255.
+ */
+#define MIDI_STREAM_CHUNK_SIZE 0
+#endif
+
+#ifndef MIDI_EVENT_FILTER
+/**
+ \def MIDI_EVENT_FILTER
+ Set to 1 to enable the event filters set by setStatusFilter(), setChannelFilter()
+ and setMetaFilter(). Filtered events are skipped over when they are read from the 
+ SMF and are not passed to the callbacks. Set to 0 to remove the filters and related 
+ code. The filters use 19 bytes of RAM.
+ */
+#define MIDI_EVENT_FILTER 0
+#endif
+
+#ifndef MIDI_TIMING_STATS
+/**
+ \def MIDI_TIMING_STATS
+ Set to 1 to collect playback timing statistics, returned by getTimingStats(). These
+ record how late events are processed, how many ticks are caught up at once, how 
+ many events are processed per tick and the time spent reading the data source, to 
+ help size the buffers and check the timing of a system. Set to 0 to remove the 
+ statistics and related code. The statistics use 81 bytes of RAM.
+ */
+#define MIDI_TIMING_STATS 0
+#endif
+
+#ifndef MIDI_LOAD_SCAN
+/**
+ \def MIDI_LOAD_SCAN
+ Set to 1 to check every event in the SMF when it is loaded. The tracks are read in 
+ one pass, in time order, and the SMF is rejected by load() with error E_CHUNK_DATA 
+ if any track has an invalid event, instead of the track stopping during playback.
+ Statistics for the SMF are collected in the same pass and returned by getScanStats()
+ and getTrackEvents(), and the tempo map is built without a separate scan. The scan
+ reads the whole SMF once, increasing load() time, and is not done for the SMF 
+ preloaded by MD_MIDIPlaylist. Set to 0 to remove the scan and
+ related code. The scan uses 20 bytes of RAM plus 4 bytes per track, and 256 bytes 
+ of stack while load() runs.
+ */
+#define MIDI_LOAD_SCAN 0
+#endif
+
+#ifndef MIDI_ACTIVE_NOTES
+/**
+ \def MIDI_ACTIVE_NOTES
+ Set to 1 to keep track of the notes sounding on each MIDI channel. Note Off messages 
+ for just these notes are sent by silenceActiveNotes(), which is also called when 
+ the SMF is paused, restarted, moved to a new position or closed. Set to 0 to remove 
+ the note tracking and related code. The tracking uses 256 bytes of RAM.
+ */
+#define MIDI_ACTIVE_NOTES 0
+#endif
+
+#ifndef MIDI_MULTI_SONGS
+/**
+ \def MIDI_MULTI_SONGS
+ Maximum number of songs played at the same time by the MD_MIDIMulti engine. Each 
+ song is a MD_MIDIFile object with its own tempo, loop and pause state, and the 
+ output of all the songs is merged in time order to one set of callbacks. Set to 
+ 0 to remove the MD_MIDIMulti class. The size can be up to 8.
+ */
+#define MIDI_MULTI_SONGS 0
+#endif
+
+#ifndef MIDI_PLAYLIST_SIZE
+/**
+ \def MIDI_PLAYLIST_SIZE
+ Number of SMF file names that can be queued in the MD_MIDIPlaylist class. The 
+ playlist plays the SMF one after the other with no gap, loading the next SMF into 
+ a second MD_MIDIFile object while the current one is playing. Set to 0 to remove 
+ the MD_MIDIPlaylist class. The size can be up to 255 and each entry uses 2 bytes 
+ of RAM (a pointer on 8 bit processors).
+ */
+#define MIDI_PLAYLIST_SIZE 0
+#endif
+
+#ifndef MIDI_CLOCK_SYNC
+/**
+ \def MIDI_CLOCK_SYNC
+ Set to 1 to allow playback to follow an external MIDI clock (24 clocks per quarter 
+ note) with Start, Stop, Continue and Song Position Pointer, passed to the library 
+ by clockEvent() and clockSongPosition(). The clock period is smoothed by a phase 
+ locked loop so the jitter in the incoming clock does not reach the SMF ticks. 
+ Set to 0 to remove the sync code.
+ */
+#define MIDI_CLOCK_SYNC 0
+#endif
+
+#ifndef MIDI_CLOCK_OUT
+/**
+ \def MIDI_CLOCK_OUT
+ Set to 1 to send MIDI Clock (24 clocks per quarter note), Start, Stop, Continue and
+ Song Position Pointer messages to the callback set by setClockHandler(), locked to 
+ the ticks of the SMF being played. Set to 0 to remove the clock output code.
+ */
+#define MIDI_CLOCK_OUT 0
+#endif
+
+#ifndef MIDI_OUT_BUFFER_SIZE
+/**
+ \def MIDI_OUT_BUFFER_SIZE
+ Size in bytes of the transmit buffer in the MD_MIDIOut class. MD_MIDIOut encodes 
+ the MIDI and SYSEX events from a MD_MIDIFile object to bytes using running status 
+ and writes them to a serial port without waiting for the port. The size must be a 
+ power of 2 no larger than 32768. Set to 0 to remove the MD_MIDIOut class.
+ */
+#define MIDI_OUT_BUFFER_SIZE 0
+#endif
+
+#ifndef MIDI_LOOP_REGION
+/**
+ \def MIDI_LOOP_REGION
+ Set to 1 to allow playback to loop between two points in the SMF, set in ticks by
+ setLoopRegion() or by marker META events with setLoopMarkers(). The state of each
+ track is saved when playback first reaches the start point, so each wrap back to
+ the start is a restore with no scan of the tracks. Set to 0 to remove the loop
+ region code.
+ */
+#define MIDI_LOOP_REGION 0
+#endif
+
+#ifndef MIDI_PIPELINE
+/**
+ \def MIDI_PIPELINE
+ Set to 1 to add pipelined playback for dual core processors (see pipelineMode()).
+ This builds on queue mode, so MIDI_QUEUE_SIZE sets the depth of the event queue 
+ between the cores and must not be 0. On ESP32 the SMF is read by a task on one 
+ core and the events are sent by a task on the other. On RP2040 the events are 
+ sent from the second core. On other processors pipelineLoop() does both from the 
+ main loop. Set to 0 to remove the pipeline code.
+ */
+#define MIDI_PIPELINE 0
+#endif
+
+#ifndef MIDI_PIPELINE_READ_CORE
+/**
+ \def MIDI_PIPELINE_READ_CORE
+ ESP32 core for the pipeline task that reads the SMF into the event queue. The 
+ default is core 0, away from the Arduino loop().
+ */
+#define MIDI_PIPELINE_READ_CORE 0
+#endif
+
+#ifndef MIDI_PIPELINE_SEND_CORE
+/**
+ \def MIDI_PIPELINE_SEND_CORE
+ ESP32 core for the pipeline task that sends the events from the queue when they
+ are due. 
+ */
+#define MIDI_PIPELINE_SEND_CORE 1
+#endif
+
+#ifndef MIDI_PIPELINE_READ_PRIORITY
+/**
+ \def MIDI_PIPELINE_READ_PRIORITY
+ FreeRTOS priority of the ESP32 pipeline task that reads the SMF.
+ */
+#define MIDI_PIPELINE_READ_PRIORITY 1
+#endif
+
+#ifndef MIDI_PIPELINE_SEND_PRIORITY
+/**
+ \def MIDI_PIPELINE_SEND_PRIORITY
+ FreeRTOS priority of the ESP32 pipeline task that sends the events. This should 
+ be higher than the Arduino loop() (priority 1) on the same core so the events 
+ are sent on time.
+ */
+#define MIDI_PIPELINE_SEND_PRIORITY 2
+#endif
+
+#ifndef MIDI_PIPELINE_STACK
+/**
+ \def MIDI_PIPELINE_STACK
+ Stack size in bytes for each of the ESP32 pipeline tasks. The stack must also 
+ hold the callbacks run by the task.
+ */
+#define MIDI_PIPELINE_STACK 4096
+#endif
+
+#ifndef MIDI_CATALOG_NAME_SIZE
+/**
+ \def MIDI_CATALOG_NAME_SIZE
+ Size in bytes of the file name held in each MD_MIDICatalog entry, including the 
+ nul at the end. 13 is enough for 8.3 file names. SMF with longer names are left 
+ out of the catalog. Set to 0 to remove the MD_MIDICatalog class. The size can be 
+ up to 255.
+ */
+#define MIDI_CATALOG_NAME_SIZE 0
+#endif
+
+#ifndef MIDI_CATALOG_TITLE_SIZE
+/**
+ \def MIDI_CATALOG_TITLE_SIZE
+ Size in bytes of the title held in each MD_MIDICatalog entry, including the nul 
+ at the end. Longer titles are cut short. The size can be 1 to 255.
+ */
+#define MIDI_CATALOG_TITLE_SIZE 32
+#endif
+
+#ifndef MIDI_COMPILED_STREAM
 /**
- \def TRACK_PRIORITY
- Events may be processed in 2 different ways. One way is to give priority to all 
- events on one track before moving on to the next track (TRACK_PRIORITY) or to process 
- one event from each track and cycling through all tracks round robin fashion until 
- no events are left to be processed (EVENT_PRIORITY). This macro definition enables
- the mode of operation implemented in getNextEvent().
+ \def MIDI_COMPILED_STREAM
+ Set to 1 to add compile(), to convert a SMF to a compiled stream, and to allow
+ load() to play compiled streams. A compiled stream has all the tracks merged in 
+ time order into one, as fixed size records with the delta times converted and 
+ no running status, so it is played with sequential reads only and no parsing of 
+ the MIDI events. Set to 0 to remove the compiled stream code.
  */
-#define TRACK_PRIORITY  1
+#define MIDI_COMPILED_STREAM 0
 #endif
 
 #ifndef SD_FAT_TYPE
@@ -560,688 +1170,3886 @@ typedef struct
   };
 } meta_event;
 
+#if MIDI_STREAM_CHUNK_SIZE
+#if MIDI_STREAM_CHUNK_SIZE > 255
+#error MIDI_STREAM_CHUNK_SIZE must be no larger than 255
+#endif
 
-class MD_MIDIFile;
+#define MIDI_STREAM_FIRST 0x01  ///< stream_event flag set for the first chunk of an event
+#define MIDI_STREAM_LAST  0x02  ///< stream_event flag set for the last chunk of an event
 
 /**
- * Object definition for a SMF MIDI track. 
- * This object is not invoked by user code.
+ Streamed SYSEX or META event definition structure
+
+ Structure defining one chunk of the data for a SYSEX or META event in stream mode.
+ Each event is passed as one or more chunks, in order. The first chunk has the 
+ MIDI_STREAM_FIRST flag set and the last has MIDI_STREAM_LAST set (both are set if 
+ there is only one chunk). An event with no data is passed as one chunk with no data.
+
+ For SYSEX the starting 0xF0 or 0xF7 byte is in status and is not part of the data.
+ The data includes the ending 0xF7, if there is one in the SMF.
+
+ A pointer to this structure type is passed to the callback function registered
+ using setStreamHandler().
+*/
+typedef struct
+{
+  uint8_t track;        ///< the track this was on
+  uint8_t status;       ///< the event status byte, 0xf0 or 0xf7 for SYSEX and 0xff for META
+  uint8_t type;         ///< the META event type, 0 for SYSEX
+  uint8_t flags;        ///< MIDI_STREAM_FIRST and MIDI_STREAM_LAST flags
+  uint32_t size;        ///< the total number of data bytes in the event
+  uint32_t offset;      ///< the offset of this chunk in the event data
+  uint8_t len;          ///< the number of data bytes in this chunk
+  const uint8_t *data;  ///< the chunk data. Only 'len' bytes are valid
+} stream_event;
+#endif
+
+#if MIDI_LOAD_SCAN
+/**
+ SMF statistics structure
+
+ Structure holding the statistics collected by the load() scan of the SMF. These 
+ can be used to size the buffers before the SMF is played. For example,
+ - the queue (MIDI_QUEUE_SIZE) and batch (MIDI_BATCH_SIZE) should hold at least 
+ tickEventsMax events for all the events on one tick to be handled together,
+ - SYSEX or META events larger than the sysex_event or meta_event data buffers are 
+ truncated unless stream mode (MIDI_STREAM_CHUNK_SIZE) is used,
+ - polyphonyMax is the number of voices a synthesizer needs to play the SMF.
+
+ A pointer to this structure is returned by getScanStats().
+*/
+typedef struct
+{
+  uint32_t events;        ///< the number of events in the SMF
+  uint32_t midiEvents;    ///< the number of MIDI events in the SMF
+  uint16_t tickEventsMax; ///< the most MIDI events on the same tick, from all the tracks
+  uint16_t polyphonyMax;  ///< the most notes sounding at the same time, from all the tracks
+  uint32_t sysexMax;      ///< the largest SYSEX event, in data bytes
+  uint32_t metaMax;       ///< the largest META event, in data bytes
+} scan_stats;
+#endif
+
+#if MIDI_TIMING_STATS
+#define MIDI_STATS_BINS 8   ///< number of bins in the timing_stats lateness histogram
+
+/**
+ Playback timing statistics structure
+
+ Structure holding the playback timing statistics collected since the SMF was loaded 
+ or resetTimingStats() was called. Times are in microseconds. 
+
+ The lateness of an event is the time from when its tick was due by the library clock 
+ to when the event was processed. Lateness is only measured when the ticks are counted 
+ by getNextEvent(), not when the ticks are passed to processEvents() by user code.
+ Bin 0 of the lateness histogram counts events less than 256 us late, and each bin 
+ after that is twice as wide as the one before, up to the last bin which counts all
+ the events more than 16,384 us late.
+
+ A pointer to this structure is returned by getTimingStats().
+*/
+typedef struct
+{
+  uint32_t events;      ///< the number of events processed
+  uint32_t ticks;       ///< the number of ticks processed, events/ticks is the mean events per tick
+  uint32_t lateCount;   ///< the number of events with lateness measured
+  uint32_t lateMin;     ///< the smallest lateness of an event
+  uint32_t lateMax;     ///< the largest lateness of an event
+  uint32_t lateTotal;   ///< the total lateness of all the events, lateTotal/lateCount is the mean
+  uint32_t lateHist[MIDI_STATS_BINS]; ///< the number of events in each lateness bin
+  uint16_t catchUpMax;  ///< the most ticks counted in one call to getNextEvent()
+  uint16_t eventsMax;   ///< the most events processed in one call to processEvents()
+  uint32_t capHits;     ///< the number of times processEvents() stopped at its budget with events still due
+  uint32_t reads;       ///< the number of reads from the data source to fill a track buffer
+  uint32_t readTotal;   ///< the total time spent on the reads
+  uint32_t readMax;     ///< the longest time spent on one read
+} timing_stats;
+#endif
+
+#if MIDI_CATALOG_NAME_SIZE
+/**
+ SMF catalog entry structure
+
+ Structure holding the details of one SMF in a MD_MIDICatalog index. The entry is
+ written to the index file as it is held in memory, so an index is only read by 
+ code built with the same configuration. The file size and modified time are used
+ to find the SMF that have changed since the index was built.
+
+ The structure is filled in by MD_MIDICatalog::getEntry().
+*/
+typedef struct
+{
+  uint32_t size;        ///< the file size in bytes
+  uint32_t modified;    ///< the FAT modified date (high 16 bits) and time (low 16 bits)
+  uint32_t duration;    ///< the playing time in milliseconds, 0 if there is no tempo map (MIDI_TEMPO_MAP_SIZE)
+  uint16_t ticksPerQuarterNote; ///< the SMF time division (PPQN)
+  int16_t  error;       ///< the error code from load(), E_OK if the SMF loaded. The other details are 0 if it did not
+  uint8_t  format;      ///< the SMF format, 0 or 1
+  uint8_t  tracks;      ///< the number of tracks in the SMF
+  char name[MIDI_CATALOG_NAME_SIZE];    ///< the file name, relative to the folder
+  char title[MIDI_CATALOG_TITLE_SIZE];  ///< the first Sequence/Track Name META event in the first track, empty if none
+} catalog_entry;
+#endif
+
+
+/**
+ * Object definition for a source of SMF data.
+ *
+ * The library reads all SMF data through this interface. Implementations are provided
+ * for files on the SD card (MD_MFSourceSD) and for data in memory (MD_MFSourceMem),
+ * and user code may derive additional types to be passed to MD_MIDIFile::load().
+ * Positions are byte offsets from the start of the SMF data.
  */
-class MD_MFTrack
+class MD_MFSource
 {
 public:
-  /** 
-   * Class Constructor
-   *
-   * Instantiate a new instance of the class.
-   *
-   * \return No return data.
-   */
-  MD_MFTrack(void);
-  
-  /** 
+  /**
    * Class Destructor
+   */
+  virtual ~MD_MFSource(void) {};
+
+  /**
+   * Close the source
    *
-   * Released allocated memory and does the necessary to clean up once the object is
-   * no longer required.
+   * Release the data source once the SMF is no longer required.
    *
    * \return No return data.
    */
-  ~MD_MFTrack(void);
+  virtual void close(void) {};
 
-  //--------------------------------------------------------------
-  /** \name Methods for track file data
-   * @{
-   */
-  /** 
-   * Get end of track status
-   *
-   * The method is used to test whether a track has reached the end.
-   * Once a track reached the end it stops being processed for MIDI events.
-   * 
-   * \return true if end of track has been reached.
-   */
-  bool getEndOfTrack(void);
- 
-  /** 
-   * Get the length of the track in bytes
+  /**
+   * Set the read position
    *
-   * The length of a track is specified in the track header. This method returns 
-   * the total length of the track in bytes.
-   * 
-   * \return the total track length (bytes).
+   * \param pos  the byte offset from the start of the data.
+   * \return true if the position is valid.
    */
-  uint32_t  getLength(void);
-  /** @} */
+  virtual bool seekSet(uint32_t pos) = 0;
 
-  //--------------------------------------------------------------
-  /** \name Methods for data handling
-   * @{
-   */
-  /** 
-   * Close the track
-   *
-   * Stop processing the track and reset it to start conditions.
+  /**
+   * Get the read position
    *
-   * \return No return data.
+   * \return the byte offset from the start of the data for the next read.
    */
-  void close(void);
-  
-  /** 
-   * Get and process the next sequential MIDI or SYSEX event
+  virtual uint32_t curPosition(void) = 0;
+
+  /**
+   * Get the size of the data
    *
-   * Each track is made up of a sequence of MIDI and SYSEX events that are processed 
-   * in sequential order using this method. An event will not be processed if the track
-   * is at end of track or insufficient time has elapsed for the next event to be 
-   * triggered. Once processed the track position is advanced to the next event to be 
-   * processed.
-   * 
-   * \param mf          pointer to the MIDI file object calling this track.
-   * \param tickCount   the number of ticks since this method was last called for this track.
-   * \return true if an event was found and processed.
+   * \return the total number of bytes in the source.
    */
-  bool getNextEvent(MD_MIDIFile *mf, uint16_t tickCount);
-  
-  /** 
-   * Load the definition of a track
+  virtual uint32_t size(void) = 0;
+
+  /**
+   * Read one byte
    *
-   * Before it can be processed, each track must be initialise to its start conditions by 
-   * invoking this method.
-   * 
-   * \param trackId the identifying number for the track [0..MIDI_MAX_TRACKS-1].
-   * \param mf      pointer to the MIDI file object calling this track.
-   * \return Error code with one of these values 
-   * - -1 if successful 
-   * - 0 if the track header is not in the correct format 
-   * - 1 if the track chunk is past the end of file
+   * \return the next byte or -1 if there is no more data.
    */
-  int load(uint8_t trackId, MD_MIDIFile *mf);
-  
-  /** 
-   * Reset the track to the start of the data in the file
-   *
-   * Sets up the track to start playing from the beginning again.
+  virtual int read(void) = 0;
+
+  /**
+   * Read a block of bytes
    *
-   * \return No return data.
+   * \param buf  pointer to the buffer to fill.
+   * \param len  the number of bytes requested.
+   * \return the number of bytes read, 0 if there is no more data.
    */
-  void restart(void);
-  
-  /** 
-   * Reset the start time for this track
+  virtual int read(void *buf, uint16_t len) = 0;
+
+  /**
+   * Get direct access to the data
    *
-   * This is used to resynchronize a track when it has been paused.
+   * Sources held in directly addressable memory return a pointer to the data so 
+   * that it can be parsed in place, without any copies. Other sources return nullptr.
    *
-   * \return No return data.
+   * \return pointer to the start of the data or nullptr.
    */
-  void syncTime(void);
-  /** @} */
+  virtual const uint8_t *getData(void) { return(nullptr); }
+};
+
+/**
+ * SMF data source for a file on the SD card
+ */
+class MD_MFSourceSD : public MD_MFSource
+{
+public:
+  /**
+   * Open the named file
+   *
+   * \param fname  the name of the file, relative to the current folder.
+   * \return true if the file was opened.
+   */
+  bool open(const char *fname) { return(_fd.open(fname, O_READ)); }
+
+  virtual void close(void) { _fd.close(); }
+  virtual bool seekSet(uint32_t pos) { return(_fd.seekSet(pos)); }
+  virtual uint32_t curPosition(void) { return(_fd.curPosition()); }
+  virtual uint32_t size(void) { return(_fd.fileSize()); }
+  virtual int read(void) { return(_fd.read()); }
+  virtual int read(void *buf, uint16_t len) { int n = _fd.read(buf, len); return(n > 0 ? n : 0); }
+
+protected:
+  SDFILE  _fd;    ///< SDFat file descriptor
+};
+
+/**
+ * SMF data source for a memory buffer
+ *
+ * The SMF data may be in RAM (including external PSRAM on processors where it is 
+ * mapped into the address space) or in program memory (PROGMEM). Data in RAM is 
+ * parsed in place without being copied.
+ */
+class MD_MFSourceMem : public MD_MFSource
+{
+public:
+  /**
+   * Class Constructor
+   */
+  MD_MFSourceMem(void) : _data(nullptr), _size(0), _pos(0), _progmem(false) {};
+
+  /**
+   * Set the memory to read
+   *
+   * The memory buffer belongs to user code and must persist until the SMF is closed.
+   *
+   * \param data     pointer to the SMF data.
+   * \param len      the number of bytes of SMF data.
+   * \param progmem  true if the data is in PROGMEM and cannot be addressed directly.
+   * \return No return data.
+   */
+  void open(const uint8_t *data, uint32_t len, bool progmem = false) { _data = data; _size = len; _pos = 0; _progmem = progmem; }
+
+  virtual void close(void) { _data = nullptr; _size = _pos = 0; }
+  virtual bool seekSet(uint32_t pos) { if (pos > _size) return(false); _pos = pos; return(true); }
+  virtual uint32_t curPosition(void) { return(_pos); }
+  virtual uint32_t size(void) { return(_size); }
+  virtual int read(void);
+  virtual int read(void *buf, uint16_t len);
+  virtual const uint8_t *getData(void) { return(_progmem ? nullptr : _data); }
+
+protected:
+  const uint8_t *_data; ///< the SMF data in user memory
+  uint32_t  _size;      ///< the number of bytes of data
+  uint32_t  _pos;       ///< current read position
+  bool      _progmem;   ///< true if the data is in PROGMEM
+};
+
+#if MIDI_BATCH_SIZE > 255
+#error MIDI_BATCH_SIZE must be no larger than 255
+#endif
+
+#if (MIDI_QUEUE_BATCH_SIZE < 1) || (MIDI_QUEUE_BATCH_SIZE > 255)
+#error MIDI_QUEUE_BATCH_SIZE must be 1 to 255
+#endif
+
+#if MIDI_EVENT_FILTER
+#define MIDI_FILTER_NOTE_OFF      0x01  ///< setStatusFilter() bit for Note Off (0x80) events
+#define MIDI_FILTER_NOTE_ON       0x02  ///< setStatusFilter() bit for Note On (0x90) events
+#define MIDI_FILTER_POLY_PRESSURE 0x04  ///< setStatusFilter() bit for Polyphonic Key Pressure (0xA0) events
+#define MIDI_FILTER_CONTROL       0x08  ///< setStatusFilter() bit for Control Change (0xB0) events
+#define MIDI_FILTER_PROGRAM       0x10  ///< setStatusFilter() bit for Program Change (0xC0) events
+#define MIDI_FILTER_CHAN_PRESSURE 0x20  ///< setStatusFilter() bit for Channel Pressure (0xD0) events
+#define MIDI_FILTER_PITCH_BEND    0x40  ///< setStatusFilter() bit for Pitch Bend (0xE0) events
+#define MIDI_FILTER_SYSEX         0x80  ///< setStatusFilter() bit for SYSEX (0xF0 and 0xF7) events
+#endif
+
+#if MIDI_MULTI_SONGS > 8
+#error MIDI_MULTI_SONGS must be no larger than 8
+#endif
+
+#if MIDI_PLAYLIST_SIZE > 255
+#error MIDI_PLAYLIST_SIZE must be no larger than 255
+#endif
+
+#if MIDI_CATALOG_NAME_SIZE
+#if MIDI_CATALOG_NAME_SIZE > 255
+#error MIDI_CATALOG_NAME_SIZE must be no larger than 255
+#endif
+#if (MIDI_CATALOG_TITLE_SIZE < 1) || (MIDI_CATALOG_TITLE_SIZE > 255)
+#error MIDI_CATALOG_TITLE_SIZE must be 1 to 255
+#endif
+#endif
+
+#if MIDI_OUT_BUFFER_SIZE
+#if (MIDI_OUT_BUFFER_SIZE & (MIDI_OUT_BUFFER_SIZE - 1)) || (MIDI_OUT_BUFFER_SIZE > 32768)
+#error MIDI_OUT_BUFFER_SIZE must be a power of 2 no larger than 32768
+#endif
+#endif
+
+#if MIDI_PIPELINE
+#if !MIDI_QUEUE_SIZE
+#error MIDI_PIPELINE needs the event queue, MIDI_QUEUE_SIZE must not be 0
+#endif
+
+#if defined(ARDUINO_ARCH_ESP32) && (portNUM_PROCESSORS > 1)
+#define MIDI_PIPELINE_TASKS 1   ///< the pipeline is run by a FreeRTOS task on each core
+#else
+#define MIDI_PIPELINE_TASKS 0   ///< the pipeline is not run by FreeRTOS tasks
+#endif
+
+#if defined(ARDUINO_ARCH_RP2040) && !MIDI_PIPELINE_TASKS
+#define MIDI_PIPELINE_CORE1 1   ///< the pipeline sends the events from the second core
+#else
+#define MIDI_PIPELINE_CORE1 0   ///< the pipeline does not use the second core directly
+#endif
+
+#define MIDI_QUEUE_BARRIER() __sync_synchronize()   ///< queue memory barrier, for both cores
+#else
+#define MIDI_QUEUE_BARRIER() __asm__ __volatile__("" ::: "memory") ///< queue memory barrier, for the compiler
+#endif
+
+#if MIDI_QUEUE_SIZE
+#if (MIDI_QUEUE_SIZE & (MIDI_QUEUE_SIZE - 1)) || (MIDI_QUEUE_SIZE > 128)
+#error MIDI_QUEUE_SIZE must be a power of 2 no larger than 128
+#endif
+
+/**
+ Queued MIDI event definition structure
+
+ Structure defining a MIDI event and the time it is due, as held in the event queue
+ for interrupt driven playback.
+*/
+typedef struct
+{
+  uint32_t time;    ///< time the event is due, in microseconds from the start of playback
+  midi_event ev;    ///< the MIDI event
+} midi_queue_event;
+
+/**
+ * Object definition for a lock-free single producer, single consumer event queue.
+ *
+ * Events are added by one process (eg, the main loop) and removed by another 
+ * (eg, an interrupt service routine) without the need to disable interrupts.
+ * Each side only changes its own index into the ring buffer.
+ * This object is not invoked by user code.
+ */
+class MD_MFQueue
+{
+public:
+  /**
+   * Class Constructor
+   */
+  MD_MFQueue(void) : _head(0), _tail(0) {};
+
+  /**
+   * Get the number of events in the queue
+   *
+   * \return the number of events queued.
+   */
+  inline uint8_t count(void) { return((uint8_t)(_head - _tail)); }
+
+  /**
+   * Check if the queue is empty
+   *
+   * \return true if there are no events queued.
+   */
+  inline bool isEmpty(void) { return(_head == _tail); }
+
+  /**
+   * Check if the queue is full
+   *
+   * \return true if no more events can be queued.
+   */
+  inline bool isFull(void) { return(count() >= MIDI_QUEUE_SIZE); }
+
+  /**
+   * Add an event to the queue - producer side only
+   *
+   * \param time the time the event is due.
+   * \param pev  pointer to the event data to copy into the queue.
+   * \return true if the event was queued, false if the queue is full.
+   */
+  bool push(uint32_t time, const midi_event *pev)
+  {
+    if (isFull()) return(false);
+    _q[_head & (MIDI_QUEUE_SIZE - 1)].time = time;
+    _q[_head & (MIDI_QUEUE_SIZE - 1)].ev = *pev;
+    MIDI_QUEUE_BARRIER();   // data is written before the index changes
+    _head++;
+    return(true);
+  }
+
+  /**
+   * Get the event at the front of the queue - consumer side only
+   *
+   * \return pointer to the oldest event in the queue or nullptr if empty.
+   */
+  inline midi_queue_event *peek(void) { return(isEmpty() ? nullptr : &_q[_tail & (MIDI_QUEUE_SIZE - 1)]); }
+
+  /**
+   * Remove the event at the front of the queue - consumer side only
+   *
+   * \return No return data.
+   */
+  inline void pop(void) { MIDI_QUEUE_BARRIER(); _tail++; }
+
+  /**
+   * Remove all the events from the queue
+   *
+   * This changes the consumer index, so the consumer must not be running 
+   * (eg, interrupts disabled) while this is called.
+   *
+   * \return No return data.
+   */
+  inline void clear(void) { _tail = _head; }
+
+protected:
+  midi_queue_event _q[MIDI_QUEUE_SIZE]; ///< the event ring buffer
+  volatile uint8_t _head;   ///< index of the next free slot, only changed by the producer
+  volatile uint8_t _tail;   ///< index of the oldest event, only changed by the consumer
+};
+#endif // MIDI_QUEUE_SIZE
+
+#if MIDI_SEEK_CHECKPOINTS
+#if MIDI_SEEK_CHECKPOINTS > 127
+#error MIDI_SEEK_CHECKPOINTS must be no larger than 127
+#endif
+
+#define MIDI_CHASE_CC 9   ///< number of controllers chased by a seek
+
+/**
+ Chased MIDI channel state definition structure
+
+ Structure holding the last value of the MIDI messages that set up the sound of a
+ channel. A seek collects these and sends them once the new position is reached.
+ Values not yet set are 0xff.
+*/
+typedef struct
+{
+  uint8_t program;            ///< last program change
+  uint8_t pressure;           ///< last channel pressure
+  uint8_t bend[2];            ///< last pitch bend data bytes (LSB, MSB)
+  uint8_t cc[MIDI_CHASE_CC];  ///< last value of each chased controller
+} midi_chase;
+
+/**
+ Seek checkpoint definition structure
+
+ Structure holding the SMF state for a checkpoint in the seek index. The position
+ of each track is held by the track.
+*/
+typedef struct
+{
+  uint32_t tick;        ///< absolute tick of the checkpoint
+  uint32_t millis;      ///< playing time to the checkpoint in milliseconds
+  uint16_t micros;      ///< additional playing time to the checkpoint in microseconds [0..999]
+  uint16_t phase;       ///< fraction of a microsecond of playing time carried, 16 bit fixed point
+  uint32_t usPerQN;     ///< tempo in microseconds per quarter note
+  uint8_t timeSignature[2]; ///< time signature [0] = numerator, [1] = denominator
+  midi_chase chase[16]; ///< chased state for each MIDI channel
+} seek_checkpoint;
+#endif // MIDI_SEEK_CHECKPOINTS
+
+#if MIDI_SEEK_CHECKPOINTS || MIDI_LOOP_REGION
+/**
+ Track checkpoint definition structure
+
+ Structure holding the position of a track for a checkpoint in the seek index or
+ the start of the loop region.
+*/
+typedef struct
+{
+  uint32_t offset;      ///< offset of the next event from the start of the track
+  uint32_t tick;        ///< absolute tick the next event is due
+  uint8_t status;       ///< running status command and channel
+  uint8_t size;         ///< running status message size
+  bool endOfTrack;      ///< true if the track had ended
+} track_checkpoint;
+#endif
+
+#if MIDI_TEMPO_MAP_SIZE
+#if MIDI_TEMPO_MAP_SIZE > 255
+#error MIDI_TEMPO_MAP_SIZE must be no larger than 255
+#endif
+
+/**
+ Tempo map entry definition structure
+
+ Structure holding a tempo change in the tempo map, with the time it happens.
+*/
+typedef struct
+{
+  uint32_t tick;      ///< absolute tick of the tempo change
+  uint32_t micros;    ///< playing time to the tempo change in microseconds
+  uint32_t tickTime;  ///< tick time in microseconds from this tempo change
+  uint16_t tickFrac;  ///< fraction of a microsecond in the tick time, 16 bit fixed point
+  uint16_t phase;     ///< fraction of a microsecond carried in micros, 16 bit fixed point
+  uint32_t usPerQN;   ///< tempo in microseconds per quarter note
+} tempo_map;
+#endif // MIDI_TEMPO_MAP_SIZE
+
+class MD_MIDIFile;
+
+/**
+ * Object definition for a SMF MIDI track. 
+ * This object is not invoked by user code.
+ */
+class MD_MFTrack
+{
+public:
+  /** 
+   * Class Constructor
+   *
+   * Instantiate a new instance of the class.
+   *
+   * \return No return data.
+   */
+  MD_MFTrack(void);
+  
+  /** 
+   * Class Destructor
+   *
+   * Released allocated memory and does the necessary to clean up once the object is
+   * no longer required.
+   *
+   * \return No return data.
+   */
+  ~MD_MFTrack(void);
 
   //--------------------------------------------------------------
-  /** \name Methods for debugging
+  /** \name Methods for track file data
    * @{
    */
   /** 
-   * Dump the track header data to the debug stream
+   * Get end of track status
    *
-   * During debugging, this method provides a formatted dump of data to the debug
-   * output stream.
+   * The method is used to test whether a track has reached the end.
+   * Once a track reached the end it stops being processed for MIDI events.
+   * 
+   * \return true if end of track has been reached.
+   */
+  bool getEndOfTrack(void);
+ 
+  /** 
+   * Get the length of the track in bytes
+   *
+   * The length of a track is specified in the track header. This method returns 
+   * the total length of the track in bytes.
+   * 
+   * \return the total track length (bytes).
+   */
+  uint32_t  getLength(void);
+  /** @} */
+
+  //--------------------------------------------------------------
+  /** \name Methods for data handling
+   * @{
+   */
+  /** 
+   * Close the track
+   *
+   * Stop processing the track and reset it to start conditions.
+   *
+   * \return No return data.
+   */
+  void close(void);
+  
+  /** 
+   * Get and process the next sequential MIDI or SYSEX event
+   *
+   * Each track is made up of a sequence of MIDI and SYSEX events that are processed 
+   * in sequential order using this method. An event will not be processed if the track
+   * is at end of track or insufficient time has elapsed for the next event to be 
+   * triggered. Once processed the track position is advanced to the next event to be 
+   * processed.
+   * 
+   * The delta time of the next event is read ahead once the current event has been 
+   * processed and is cached as the absolute tick at which the event is due, so a track 
+   * that is not yet due is skipped without any file access.
+   * 
+   * \param mf          pointer to the MIDI file object calling this track.
+   * \param tickCount   the current absolute tick count for the SMF playback.
+   * \return true if an event was found and processed.
+   */
+  bool getNextEvent(MD_MIDIFile *mf, uint32_t tickCount);
+
+  /**
+   * Check if the next event in this track is due
+   *
+   * Uses the cached due tick for the next event, so there is no file access.
+   * A track that has just been loaded or restarted is always reported as due
+   * as the first delta time has not yet been read from the file.
+   *
+   * \param tickCount   the current absolute tick count for the SMF playback.
+   * \return true if getNextEvent() may have an event to process.
+   */
+  inline bool isEventDue(uint32_t tickCount) { return(!_endOfTrack && (!_deltaRead || _nextEventTick <= tickCount)); }
+
+  /**
+   * Get the tick the next event is due
+   *
+   * Returns the absolute tick at which the next event in this track is due. This 
+   * is only valid once the delta time for the event has been read from the file.
+   *
+   * \return the absolute tick for the next event.
+   */
+  inline uint32_t getNextEventTick(void) { return(_nextEventTick); }
+  
+  /** 
+   * Load the definition of a track
+   *
+   * Before it can be processed, each track must be initialise to its start conditions by 
+   * invoking this method.
+   * 
+   * \param trackId the identifying number for the track [0..MIDI_MAX_TRACKS-1].
+   * \param mf      pointer to the MIDI file object calling this track.
+   * \return Error code with one of these values 
+   * - -1 if successful 
+   * - 0 if the track header is not in the correct format 
+   * - 1 if the track chunk is past the end of file
+   */
+  int load(uint8_t trackId, MD_MIDIFile *mf);
+
+#if MIDI_COMPILED_STREAM
+  /**
+   * Load the definition of a compiled stream track
+   *
+   * The track is all the records of a compiled stream, which has no track header.
+   * Each record has the number of the SMF track the event came from, so the events
+   * are passed to the callbacks with their original track numbers.
+   *
+   * \param offset the start of the records in bytes from the start of the file.
+   * \param length the length of the records in bytes.
+   * \return No return data.
+   */
+  void loadStream(uint32_t offset, uint32_t length);
+
+  /**
+   * Check if the track is a compiled stream
+   *
+   * \return true if the track was set up by loadStream().
+   */
+  inline bool isStream(void) { return(_stream); }
+
+  /**
+   * Copy the next event to a compiled stream
+   *
+   * Writes the next event of the SMF track as a compiled stream record, with the 
+   * delta time from the last record written and the running status filled in. The 
+   * SYSEX and META data follows the record in data blocks. The End of Track META 
+   * event is not copied, as there is one for the whole stream. The first call for 
+   * the track only reads the delta time of the first event.
+   *
+   * \param mf    pointer to the MIDI file object calling this track.
+   * \param out   the output for the record.
+   * \param last  the absolute tick of the last record written, updated if a record is written.
+   * \return the number of bytes written, 0 if there is no record for the event or -1 if 
+   * the write failed or the SYSEX or META data is longer than 65535 bytes.
+   */
+  int32_t compileEvent(MD_MIDIFile *mf, Print *out, uint32_t *last);
+
+  /**
+   * Fill in a compiled stream record
+   *
+   * \param p      the buffer for the record, MFST_RECORD bytes.
+   * \param delta  the delta time from the last record written.
+   * \param track  the track number of the event.
+   * \param status the status byte of the event.
+   * \param d1     the first MIDI data byte, or the high byte of the SYSEX or META data length.
+   * \param d2     the second MIDI data byte, or the low byte of the SYSEX or META data length.
+   * \return No return data.
+   */
+  static void putRecord(uint8_t *p, uint32_t delta, uint8_t track, uint8_t status, uint8_t d1, uint8_t d2);
+#endif
+  
+  /** 
+   * Reset the track to the start of the data in the file
+   *
+   * Sets up the track to start playing from the beginning again.
+   *
+   * \return No return data.
+   */
+  void restart(void);
+  
+  /** 
+   * Reset the start time for this track
+   *
+   * This is used to resynchronize a track when the SMF tick count is restarted from 0.
+   * Any event already pending in the track is moved so that it remains the same number
+   * of ticks away from the new time base.
+   *
+   * \param tickCount  the absolute tick count being reset to 0.
+   * \return No return data.
+   */
+  void syncTime(uint32_t tickCount);
+
+#if MIDI_SEEK_CHECKPOINTS || MIDI_PLAYLIST_SIZE || MIDI_LOOP_REGION
+  /**
+   * Read the delta time for the next event
+   *
+   * Makes sure the tick for the next event is known, reading the delta time from 
+   * the file if this has not yet been done. There is no file access if the track 
+   * is at end of track or the delta time has already been read.
+   *
+   * \param mf  pointer to the MIDI file object calling this track.
+   * \return No return data.
+   */
+  void readDelta(MD_MIDIFile *mf);
+#endif
+
+#if MIDI_SEEK_CHECKPOINTS || MIDI_LOOP_REGION
+  /**
+   * Save the track position
+   *
+   * The position is only complete if the delta time for the next event has been read.
+   *
+   * \param pcp  pointer to the structure for the saved position.
+   * \return No return data.
+   */
+  void saveState(track_checkpoint *pcp);
+
+  /**
+   * Restore the track position
+   *
+   * The track data is read again from the source at the restored position.
+   *
+   * \param pcp  pointer to the structure with the saved position.
+   * \return No return data.
+   */
+  void loadState(const track_checkpoint *pcp);
+#endif
+
+#if MIDI_SEEK_CHECKPOINTS
+  /**
+   * Save the track position in a checkpoint
+   *
+   * \param idx  the index of the checkpoint [0..MIDI_SEEK_CHECKPOINTS-1].
+   * \return No return data.
+   */
+  inline void saveCheckpoint(uint8_t idx) { saveState(&_cp[idx]); }
+
+  /**
+   * Restore the track position from a checkpoint
+   *
+   * \param idx  the index of the checkpoint [0..MIDI_SEEK_CHECKPOINTS-1].
+   * \return No return data.
+   */
+  inline void loadCheckpoint(uint8_t idx) { loadState(&_cp[idx]); }
+
+  /**
+   * Move a checkpoint to a new index
+   *
+   * \param to    the index of the checkpoint to overwrite.
+   * \param from  the index of the checkpoint to copy.
+   * \return No return data.
+   */
+  inline void moveCheckpoint(uint8_t to, uint8_t from) { _cp[to] = _cp[from]; }
+#endif
+
+#if MIDI_LOOP_REGION
+  /**
+   * Save the track position at the start of the loop region
+   *
+   * \return No return data.
+   */
+  inline void saveLoop(void) { saveState(&_loop); }
+
+  /**
+   * Restore the track position to the start of the loop region
+   *
+   * \return No return data.
+   */
+  inline void loadLoop(void) { loadState(&_loop); }
+
+  /**
+   * Scan the track for a marker
+   *
+   * Reads through the track data, without processing any events, for the first
+   * Marker META event with the text specified at or after a tick. The track is 
+   * restarted once the scan is finished.
+   *
+   * \param mf    pointer to the MIDI file object calling this track.
+   * \param name  the marker text to find, matched exactly.
+   * \param from  the first absolute tick to check for the marker.
+   * \return the absolute tick of the marker, 0xffffffff if it was not found.
+   */
+  uint32_t scanMarker(MD_MIDIFile *mf, const char *name, uint32_t from);
+#endif
+
+#if MIDI_TEMPO_MAP_SIZE
+  /**
+   * Scan the track for tempo changes
+   *
+   * Reads through the track data, without processing any events, and adds each
+   * Set Tempo event to the tempo map in the MIDI file object. Each call reads up
+   * to the number of events given, so the scan can be spread over many calls. 
+   * The scan starts from the beginning of a restarted track and the track is 
+   * restarted again once the scan is finished.
+   *
+   * \param mf  pointer to the MIDI file object calling this track.
+   * \param events the maximum number of events to read in this call.
+   * \param tick set to the absolute tick at the end of the track when the scan is finished.
+   * \return true if the scan is finished.
+   */
+  bool scanTempo(MD_MIDIFile *mf, uint16_t events, uint32_t *tick);
+#endif
+
+#if MIDI_CATALOG_NAME_SIZE
+  /**
+   * Scan the track for the title
+   *
+   * Reads the events at the start of the track, up to the first event with a delta 
+   * time, for a Sequence/Track Name META event. The text is copied to the buffer, 
+   * cut short if needed, and ended with a nul. The track is restarted once the scan 
+   * is finished.
+   *
+   * \param mf   pointer to the MIDI file object calling this track.
+   * \param buf  the buffer for the title.
+   * \param len  the size of the buffer in bytes, including the nul.
+   * \return true if a title was found, otherwise the buffer is set empty.
+   */
+  bool scanTitle(MD_MIDIFile *mf, char *buf, uint16_t len);
+#endif
+
+#if MIDI_LOAD_SCAN
+  /**
+   * Start the load scan of the track
+   *
+   * Restart the track and read the time of the first event.
+   *
+   * \param mf  pointer to the MIDI file object calling this track.
+   * \return No return data.
+   */
+  void scanStart(MD_MIDIFile *mf);
+
+  /**
+   * Check the next event in the load scan of the track
+   *
+   * Reads and checks the next event, without processing it, and reads the time of the
+   * event after that. Set Tempo events are added to the tempo map. The track must be
+   * restarted once the scan is finished.
+   *
+   * \param mf  pointer to the MIDI file object calling this track.
+   * \param pev set to the MIDI event, if the event is a MIDI event.
+   * \param len set to the number of data bytes, if the event is a SYSEX or META event.
+   * \return -1 if the event is not valid, otherwise the status byte for the event (the 
+   * MIDI command without the channel for MIDI events).
+   */
+  int16_t scanEvent(MD_MIDIFile *mf, midi_event *pev, uint32_t *len);
+
+  /**
+   * Get the number of events in the track
+   *
+   * \return the number of events found by the load scan.
+   */
+  inline uint32_t getEventCount(void) { return(_eventCount); }
+#endif
+  /** @} */
+
+  //--------------------------------------------------------------
+  /** \name Methods for debugging
+   * @{
+   */
+  /** 
+   * Dump the track header data to the debug stream
+   *
+   * During debugging, this method provides a formatted dump of data to the debug
+   * output stream.
+   *
+   * The DUMP_DATA macro define must be set to 1 to enable this method.
+   *
+   * \return No return data.
+   */
+  void dump(void);
+  /** @} */
+
+#if MIDI_TRACK_ARENA
+  /**
+   * Construct a track in memory from the arena
+   *
+   * The size of the object is not needed, as the arena was carved for it.
+   *
+   * \param p the memory for the object.
+   * \return the memory for the object.
+   */
+  static void *operator new(size_t, void *p) { return(p); }
+
+#if MIDI_TRACK_BUFFER_SIZE
+  /**
+   * Set the read-ahead buffer
+   *
+   * \param buf the MIDI_TRACK_BUFFER_SIZE bytes of memory for the buffer.
+   * \return No return data.
+   */
+  inline void setBuffer(uint8_t *buf) { _buf = buf; }
+#endif
+#endif
+
+protected:
+  /**
+   * Process the event from the physical file
+   *
+   * Read and process the next event for this track from the file.
+   *
+   * \param mf  pointer tho the MIDIFile object with the file to process.
+   *
+   * \return No return data.
+   */
+  void  parseEvent(MD_MIDIFile *mf);
+
+#if MIDI_COMPILED_STREAM
+  /**
+   * Process the next record of a compiled stream
+   *
+   * The playback path for compiled streams, used instead of parseEvent(). The MIDI
+   * records are passed on as they are, with no running status or variable length 
+   * values to decode. The SYSEX and META records are processed as in the SMF.
+   *
+   * \param mf  pointer tho the MIDIFile object with the file to process.
+   * \return No return data.
+   */
+  void  playRecord(MD_MIDIFile *mf);
+#endif
+
+  /**
+   * Process a SYSEX or META event
+   *
+   * Filter the event, or pass it to the stream callback or parseSysex() or parseMeta().
+   *
+   * \param mf    pointer tho the MIDIFile object with the file to process.
+   * \param eType the SYSEX or META status byte already read.
+   * \param mType the META type already read, 0 for SYSEX.
+   * \param mLen  the length of the data still to be read.
+   * \return No return data.
+   */
+  void  parseData(MD_MIDIFile *mf, uint8_t eType, uint8_t mType, uint32_t mLen);
+
+  /**
+   * Process a SYSEX event from the physical file
+   *
+   * \param mf    pointer tho the MIDIFile object with the file to process.
+   * \param eType the SYSEX status byte already read.
+   * \param mLen  the length of the SYSEX data already read.
+   * \return No return data.
+   */
+  void  parseSysex(MD_MIDIFile *mf, uint8_t eType, uint32_t mLen);
+
+  /**
+   * Process a META event from the physical file
+   *
+   * \param mf    pointer tho the MIDIFile object with the file to process.
+   * \param eType the META type already read.
+   * \param mLen  the length of the META data already read.
+   * \return No return data.
+   */
+  void  parseMeta(MD_MIDIFile *mf, uint8_t eType, uint32_t mLen);
+
+#if MIDI_STREAM_CHUNK_SIZE
+  /**
+   * Pass a SYSEX or META event to the stream callback
+   *
+   * The event data is passed in chunks of up to MIDI_STREAM_CHUNK_SIZE bytes. The META
+   * events used by the library (end of track, tempo and time signature) are also 
+   * processed as normal.
+   *
+   * \param mf     pointer tho the MIDIFile object with the file to process.
+   * \param status the SYSEX or META status byte already read.
+   * \param type   the META type already read, 0 for SYSEX.
+   * \param size   the length of the data already read.
+   * \return No return data.
+   */
+  void  streamEvent(MD_MIDIFile *mf, uint8_t status, uint8_t type, uint32_t size);
+
+  /**
+   * Get the next chunk of track data
+   *
+   * Point to the next bytes of track data, in place in the track buffer if there
+   * is one, otherwise read into the tmp buffer.
+   *
+   * \param mf  pointer tho the MIDIFile object with the file to process.
+   * \param pp  set to point to the data.
+   * \param len the largest number of bytes wanted.
+   * \param tmp buffer of at least len bytes for unbuffered tracks.
+   * \return the number of bytes available at *pp.
+   */
+  uint8_t readChunk(MD_MIDIFile *mf, const uint8_t **pp, uint8_t len, uint8_t *tmp);
+#endif
+
+  /**
+   * Initialize the class all in one place
+   *
+   * \return No return data.
+   */
+  void  reset(void);
+
+  /**
+   * Read the next byte of track data
+   *
+   * Reads from the read-ahead buffer, refilling it from the file when it is empty,
+   * or directly from the file if MIDI_TRACK_BUFFER_SIZE is 0.
+   *
+   * \param mf  pointer tho the MIDIFile object with the file to process.
+   * \return the byte read.
+   */
+  uint8_t readByte(MD_MIDIFile *mf);
+
+  /**
+   * Skip over track data
+   *
+   * \param mf  pointer tho the MIDIFile object with the file to process.
+   * \param n   the number of bytes to skip.
+   * \return No return data.
+   */
+  void  skipBytes(MD_MIDIFile *mf, uint32_t n);
+
+  /**
+   * Read a multi byte value from the track data
+   *
+   * \param mf    pointer tho the MIDIFile object with the file to process.
+   * \param nLen  one of MB_LONG, MB_TRYTE, MB_WORD, MB_BYTE to specify the number of bytes to read.
+   * \return the value read as a 4 byte integer.
+   */
+  uint32_t readMultiByte(MD_MIDIFile *mf, uint8_t nLen);
+
+  /**
+   * Read a variable length value from the track data
+   *
+   * \param mf  pointer tho the MIDIFile object with the file to process.
+   * \return the value read as a 4 byte integer.
+   */
+  uint32_t readVarLen(MD_MIDIFile *mf);
+
+#if MIDI_COMPILED_STREAM
+  /**
+   * Read the delta time for the next event
+   *
+   * A compiled stream record starts with a 4 byte delta time, after the padding of
+   * the data blocks of the last record. Otherwise the delta time is a variable 
+   * length value.
+   *
+   * \param mf  pointer tho the MIDIFile object with the file to process.
+   * \return the delta time in ticks.
+   */
+  uint32_t readDeltaTime(MD_MIDIFile *mf);
+
+  /**
+   * Read the status byte for the next event
+   *
+   * The status byte of a compiled stream record follows the number of the SMF track
+   * the event came from, which is saved for the callbacks.
+   *
+   * \param mf  pointer tho the MIDIFile object with the file to process.
+   * \return the status byte.
+   */
+  uint8_t readStatus(MD_MIDIFile *mf);
+
+  /**
+   * Get the next bytes of a compiled stream
+   *
+   * The bytes are used in place when they are all in the track buffer or the 
+   * source memory, otherwise they are read into tmp.
+   *
+   * \param mf  pointer tho the MIDIFile object with the file to process.
+   * \param tmp buffer of at least len bytes.
+   * \param len the number of bytes to read.
+   * \return pointer to the bytes.
+   */
+  const uint8_t *readRecord(MD_MIDIFile *mf, uint8_t *tmp, uint8_t len);
+#else
+  inline uint32_t readDeltaTime(MD_MIDIFile *mf) { return(readVarLen(mf)); }  ///< Read the delta time for the next event
+  inline uint8_t readStatus(MD_MIDIFile *mf) { return(readByte(mf)); }        ///< Read the status byte for the next event
+#endif
+#if !MIDI_TRACK_BUFFER_SIZE
+  void    seekCurrent(MD_MIDIFile *mf); ///< move the file pointer to the next track data, if it is not there already
+#endif
+
+#if MIDI_TEMPO_MAP_SIZE || MIDI_LOOP_REGION || MIDI_CATALOG_NAME_SIZE || MIDI_LOAD_SCAN
+  static const int16_t EVENT_SKIPPED = -1;  ///< skipEvent() return for a MIDI or SYSEX event
+  static const int16_t EVENT_INVALID = -2;  ///< skipEvent() return for an event that stops the track
+
+  /**
+   * Read past an event for the scans of the track
+   *
+   * The scans share this to read the events they are not looking for. MIDI messages 
+   * are read into _mev, which keeps the running status. For SYSEX and META events 
+   * only the type and length are read, so the caller reads the data it needs and 
+   * skips the rest.
+   *
+   * \param mf    pointer tho the MIDIFile object with the file to process.
+   * \param eType the status byte for the event, already read.
+   * \param len   set to the length of the SYSEX or META data.
+   * \return the META type for a META event, EVENT_SKIPPED for other events or 
+   * EVENT_INVALID if playing would stop the track at this event.
+   */
+  int16_t skipEvent(MD_MIDIFile *mf, uint8_t eType, uint32_t *len);
+
+#if MIDI_COMPILED_STREAM
+  /**
+   * Read past a compiled stream record for the scans of the track
+   *
+   * Used by skipEvent() for a compiled stream, with the same parameters and return 
+   * values. The META type is read from the first data block.
+   *
+   * \param mf    pointer tho the MIDIFile object with the file to process.
+   * \param eType the status byte for the record, already read.
+   * \param len   set to the length of the SYSEX or META data.
+   * \return the META type for a META event, EVENT_SKIPPED for other events or 
+   * EVENT_INVALID if playing would stop the track at this record.
+   */
+  int16_t skipRecord(MD_MIDIFile *mf, uint8_t eType, uint32_t *len);
+#endif
+#endif
+
+  /**
+   * Refill the read-ahead buffer
+   *
+   * Point the buffer to the next block of data for this track. Data sources in 
+   * memory are used in place. Otherwise the data is read into the track buffer
+   * with one bulk read if MIDI_TRACK_BUFFER_SIZE is not 0.
+   *
+   * \param mf  pointer tho the MIDIFile object with the file to process.
+   * \return false if the data cannot be buffered and must be read directly from the source.
+   */
+  bool  fillBuffer(MD_MIDIFile *mf);
+
+  uint8_t   _trackId;       ///< the id for this track
+  uint32_t  _length;        ///< length of track in bytes
+  uint32_t  _startOffset;   ///< start of the track in bytes from start of file
+  uint32_t  _currOffset;    ///< offset from start of the track for the next read of SD data
+  bool      _endOfTrack;    ///< true when we have reached end of track or we have encountered an undefined event
+  bool      _deltaRead;     ///< true when the delta time for the next event has been read and _currOffset is at the event
+  uint32_t  _nextEventTick; ///< absolute tick when the next event is due
+#if MIDI_TRACK_BUFFER_SIZE
+#if MIDI_TRACK_ARENA
+  uint8_t   *_buf;          ///< read-ahead buffer for the track data, in the arena
+#else
+  uint8_t   _buf[MIDI_TRACK_BUFFER_SIZE]; ///< read-ahead buffer for the track data
+#endif
+#endif
+  const uint8_t *_bufPtr;   ///< start of the buffered data, either _buf or the source memory
+  uint16_t  _bufIdx;        ///< index of the next byte to read from _bufPtr
+  uint16_t  _bufLen;        ///< number of valid bytes at _bufPtr
+  midi_event  _mev;         ///< data for MIDI callback function - persists between calls for run-on messages
+#if MIDI_COMPILED_STREAM
+  bool      _stream;        ///< true if the track is a compiled stream
+#endif
+#if MIDI_LOAD_SCAN
+  uint32_t  _eventCount;    ///< number of events found by the load scan
+#endif
+#if MIDI_SEEK_CHECKPOINTS
+  track_checkpoint _cp[MIDI_SEEK_CHECKPOINTS]; ///< track position for each checkpoint in the seek index
+#endif
+#if MIDI_LOOP_REGION
+  track_checkpoint _loop;   ///< track position at the start of the loop region
+#endif
+};
+
+/**
+ * Core object for the MD_MIDIFile library
+ *
+ * This is the class to handle a MIDI file, including all tracks, and is the only one 
+ * available to user programs.
+ */
+class MD_MIDIFile 
+{
+public:
+  friend class MD_MFTrack;
+#if MIDI_MULTI_SONGS
+  friend class MD_MIDIMulti;
+#endif
+#if MIDI_PLAYLIST_SIZE
+  friend class MD_MIDIPlaylist;
+#endif
+#if MIDI_CATALOG_NAME_SIZE
+  friend class MD_MIDICatalog;
+#endif
+
+  /** Error codes as constants
+   */
+  static const int E_OK = 0;       ///< No errors
+  static const int E_NO_FILE = 1;  ///< Blank file name
+  static const int E_NO_OPEN = 2;  ///< Can't open file specified
+  static const int E_NOT_MIDI = 3; ///< File is not MIDI format
+  static const int E_HEADER = 4;   ///< MIDI header size incorrect
+  static const int E_FORMAT = 5;   ///< File format type not 0 or 1
+  static const int E_FORMAT0 = 6;  ///< File format 0 but more than 1 track
+  static const int E_TRACKS = 7;   ///< More than MIDI_MAX_TRACKS required, or the arena is too small
+
+  // Errors >= 10
+  static const int E_CHUNK_ID = 0;   ///< error >= 10; n0 Track n track chunk not found
+  static const int E_CHUNK_EOF = 1;  ///< error >= 10; n1 Track n chunk size past end of file
+  static const int E_CHUNK_DATA = 2; ///< error >= 10; n2 Track n has an invalid event (MIDI_LOAD_SCAN only)
+
+  /** Event order for processEvents(), see setEventOrder()
+   */
+  static const uint8_t ORDER_TIME = 0;  ///< Strict time order, same tick events taken from the lowest track first
+  static const uint8_t ORDER_TRACK = 1; ///< All the events due on one track before moving on to the next track
+  static const uint8_t ORDER_EVENT = 2; ///< One event from each track due, round robin fashion
+
+  /**
+   * Class Constructor
+   *
+   * Instantiate a new instance of the class.
+   *
+   * \return No return data.
+   */
+  MD_MIDIFile(void);
+  
+  /** 
+   * Class Destructor
+   *
+   * Released allocated memory and does the necessary to clean up once the object is
+   * no longer required.
+   *
+   * \return No return data.
+   */
+  ~MD_MIDIFile(void);
+ 
+  /** 
+   * Initialize the object
+   *
+   * Initialize the object data. This needs to be called during setup() to initialize new 
+   * data for the class that cannot be done during the object creation.
+   * 
+   * The main purpose if to pass in a pointer to the SDFat object will be used for file 
+   * operations on the SMF.  A copy of this pointer is retained by the library for the life 
+   * of the MD_MIDIFile object. The SDFs object should be initialized before calling this 
+   * method.
+   *
+   * \param psd Pointer to the SDFat object.
+   * \return No return data.
+   */
+  void begin(SDFAT *psd);
+
+#if MIDI_TRACK_ARENA
+  /**
+   * Set the memory arena for the tracks
+   *
+   * The tracks for each SMF, and their read-ahead buffers, are carved from this 
+   * memory by load(). The memory belongs to the user code and must persist while a 
+   * SMF is loaded. Any SMF already loaded is closed. If the arena is too small for 
+   * the SMF load() returns E_TRACKS.
+   *
+   * \sa getArenaSize()
+   *
+   * \param mem  pointer to the memory for the arena.
+   * \param size the size of the arena in bytes.
+   * \return No return data.
+   */
+  void setArena(void *mem, uint32_t size);
+
+  /**
+   * Get the arena size needed for a number of tracks
+   *
+   * \sa setArena()
+   *
+   * \param tracks the number of tracks in the SMF.
+   * \return the number of bytes of arena needed.
+   */
+  static uint32_t getArenaSize(uint8_t tracks);
+#endif
+
+  //--------------------------------------------------------------
+  /** \name Methods for MIDI time base
+   * @{
+   */
+  /** 
+   * Get the internally calculated tick time
+   *
+   * Changes to tempo, TPQN and time signature all affect the tick time. This returns the
+   * whole number of microseconds for each tick. The fraction of a microsecond is also
+   * kept internally and included in the playback timing.
+   * 
+   * \return the tick time in microseconds
+   */
+  inline uint32_t getTickTime(void) { return (_tickTime); }
+
+  /** 
+   * Get the overall tempo
+   *
+   * Retrieve the overall tempo for the MIDI playback. Tempo is set by the SMF and the
+   * setTempo() method. 
+   * 
+   * \return the tempo.
+   */
+  inline uint16_t getTempo(void) { return(_tempo); }
+
+  /** 
+   * Get the tempo adjust offset
+   *
+   * Retrieve the tempo adjustment offset for the MIDI playback. Tempo adjust is set by 
+   * the setTempoAdjust() method. 
+   * 
+   * \return the tempo.
+   */
+  inline int16_t getTempoAdjust(void) { return(_tempoDelta); }
+
+  /** 
+   * Get the number of ticks per quarter note
+   *
+   * Retrieve the number of ticks per quarter note for the MIDI playback. TPQN is set by 
+   * the SMF and the setTicksPerQuarterNote() method. 
+   * 
+   * \return the number of TPQN.
+   */
+  inline uint16_t getTicksPerQuarterNote(void) { return(_ticksPerQuarterNote); }
+
+  /** 
+   * Get the Time Signature
+   *
+   * Retrieve the time signature for the MIDI playback. Time Signature is set by the SMF 
+   * and the setTimeSignature() method. 
+   * 
+   * \return the time signature (numerator in the top byte and the denominator in the lower byte).
+   */
+  inline uint16_t getTimeSignature(void) { return((_timeSignature[0]<<8) + _timeSignature[1]); }
+
+  /** 
+   * Set the internal tick time
+   *
+   * Set the number of microseconds per quarter note directly. Normally this is calculated 
+   * from the tempo and ticks per quarter note.
+   *
+   * \param m the number of microseconds per quarter note.
+   * \return No return data.
+   */
+  void setMicrosecondPerQuarterNote(uint32_t m);
+
+  /** 
+   * Set the overall tempo
+   *
+   * Set the overall tempo for the MIDI playback. Tempo is set by the SMF but can be 
+   * changed through this method. 
+   * 
+   * The default MIDI tempo if not specified is 120 beats/minute.
+   *
+   * \param t the tempo required.
+   * \return No return data.
+   */
+  void setTempo(uint16_t t);
+
+  /** 
+   * Set the tempo adjustment offset 
+   *
+   * Set the tempo offset for all tempo settings. This is useful to speed up
+   * a whole SMF by a set amount for the MIDI playback. The offset from SMF
+   * specified may be 
+   * The Tempo set by the SMF can be increased changed through this method. 
+   * 
+   * The default tempo offset if not specified is 0 beats/minute.
+   *
+   * \param t the tempo adjustment required.
+   * \return No return data.
+   */
+  void setTempoAdjust(int16_t t);
+
+  /** 
+   * Set number of ticks per quarter note (TPQN)
+   *
+   * Set the overall ticks per quarter note tempo for the MIDI playback. TPQN is set by the SMF 
+   * but can be changed through this method. 
+   *
+   * The default if not specified is 48 TPQN.
+   *
+   * \param ticks the number of ticks per quarter note.
+   * \return No return data.
+   */
+  void setTicksPerQuarterNote(uint16_t ticks);
+
+  /** 
+   * Set Time Signature for the SMF
+   *
+   * Set the time signature for the MIDI playback. Time signature is specified in 2 parts defined
+   * by the numerator and the denominator of the normal notation.
+   * 
+   * The default if not specified is 4/4.
+   *
+   * \param n numerator of the time signature.
+   * \param d denominator of the time signature.
+   * \return No return data.
+   */
+  void setTimeSignature(uint8_t n, uint8_t d);
+  /** @} */
+
+  //--------------------------------------------------------------
+  /** \name Methods for SMF file handling
+   * @{
+   */
+  /** 
+   * Close the SMF
+   *
+   * Before a new SMF is processed the current SMF must be closed. All tracks are stopped and 
+   * the file name is reset. A new file can then be started using load().
+   *
+   * \return No return data.
+   */
+  void close(void);
+
+  /**
+   * Check if SMF is and end of file
+   *
+   * An SMF is at EOF when there is nothing left to play (ie, all tracks have finished).
+   * The method will return EOF true when this condition is reached.
+   *
+   * \return true if the SMF is at EOF, false otherwise.
+   */
+  bool isEOF(void);
+
+  /** 
+   * Get the name of the SMF
+   *
+   * Gets a pointer to the buffer containing the name of the SMF.
+   *
+   * This is a pointer to a user defined buffer passed to the load()
+   * method when the file is opened. The scope and persistence of this
+   * buffer depends on what the user code does, so the pointer returned
+   * *may* be invalid if the pointer references a buffer that has become 
+   * out of scope.
+   * 
+   * \return character pointer to the name string
+   */
+  const char* getFilename(void) { return(_fileName); };
+
+  /** 
+   * Set the name of the SMF
+   *
+   * THIS METHOD IS DEPRECATED.
+   * Use play() with the file name.
+   *
+   * Stores the pointer reference to the supplied name.
+   * The file name buffer is located in user code and must persist
+   * at least until the load() method is invoked.
+   *
+   * The file specified can include path or just a file name. If not
+   * fully specified the file is located in the current working folder,
+   * which is the root folder by default. For files not in the root 
+   * folder, change the current folder using the setFileFolder() method.
+   *
+   * \sa setFileFolder(), load()
+   *
+   * \param aname pointer to a string with the file name.
+   * \return No return data.
+   */
+  void setFilename(const char* aname) { _fileName = aname; }
+
+  /**
+   * Set the current folder for the SMF
+   *
+   * Sets the current working folder to the specified path.
+   * All subsequent simple (ie, not fully qualified) file names passed 
+   * to setFilename() are referenced to this folder location.
+   *
+   * The default file location is the root folder denoted by "/"
+   *
+   * \sa setFilename
+   *
+   * \param apath pointer to a string with the path name.
+   * \return No return data.
+   */
+  void setFileFolder(const char* apath) { if (apath != nullptr && _sd->chdir(apath)) _sd->chvol(); }
+
+  /** 
+   * Load the named SMF
+   *
+   * Before it can be processed, a file must be opened, loaded and the
+   * MIDI playback initialized by invoking this method.
+   *
+   * The file name specified can include path or just a file name.
+   * If not fully specified the file is located in the current working
+   * folder, which is the root folder by default. For files not in the 
+   * root folder, change the current folder using the setFileFolder() 
+   * method.
+   *
+   * The file name buffer is located in user code and must persist during 
+   * this call. 
+   *
+   * \sa setFileFolder()
+   *
+   * \param fname pointer to a user buffered string with the file name.
+   * \return Error code with one of the E_* error values
+   */
+  int load(const char *fname);
+
+  /** 
+   * Load a SMF from memory
+   *
+   * The SMF data is held in RAM, or memory mapped into the address space 
+   * (eg, PSRAM), and is played directly from the buffer without copying.
+   * The buffer is located in user code and must persist until the SMF is 
+   * closed. No SD card is needed.
+   *
+   * \sa load_P()
+   *
+   * \param data pointer to the SMF data.
+   * \param len  the size of the SMF data in bytes.
+   * \return Error code with one of the E_* error values
+   */
+  int load(const uint8_t *data, uint32_t len);
+
+  /** 
+   * Load a SMF from program memory
+   *
+   * The SMF data is held in program memory (PROGMEM) and is played from there.
+   * No SD card is needed.
+   *
+   * \sa load()
+   *
+   * \param data pointer to the SMF data in PROGMEM.
+   * \param len  the size of the SMF data in bytes.
+   * \return Error code with one of the E_* error values
+   */
+  int load_P(const uint8_t *data, uint32_t len);
+
+  /** 
+   * Load a SMF from a user defined data source
+   *
+   * The data source object is located in user code and must persist until 
+   * the SMF is closed. The source is closed when the SMF is closed.
+   *
+   * \param src pointer to the data source for the SMF.
+   * \return Error code with one of the E_* error values
+   */
+  int load(MD_MFSource *src);
+
+  /** @} */
+
+  //--------------------------------------------------------------
+  /** \name Methods for SMF header data
+   * @{
+   */
+  /** 
+   * Get the format of the SMF
+   *
+   *  The SMF header specifies which of three SMF formats applies to the file
+   * - Type 0 file contains the entire performance, merged onto a single track
+   * - Type 1 files may contain any number of tracks, running synchronously.
+   * - Type 2 files may contain any number of tracks, running asynchronously. This type
+   * is rarely used and not supported by this library..
+   *
+   * The load() method must be invoked to read the SMF header information.
+   * 
+   * \return number [0..2] representing the format.
+   */
+  inline uint8_t getFormat(void) { return(_format); };
+
+  /** 
+   * Get the number of tracks in the file
+   *
+   * The SMF header specifies the number of MIDI tracks in the file. This must be
+   * between [0..MIDI_MAX_TRACKS-1] for the SMF to be successfully processed, or
+   * fit in the arena if MIDI_TRACK_ARENA is enabled.
+   * 
+   * The load() method must be invoked to read the SMF header information.
+   * 
+   * \return the number of tracks in the file
+   */
+  inline uint8_t getTrackCount(void) { return (_trackCount); };
+  /** @} */
+
+  //--------------------------------------------------------------
+  /** \name Methods for MIDI playback control
+   * @{
+   */
+  /** 
+   * Set the looping mode for SMF playback
+   *
+   * A SMF can be set to automatically loop to the start once it has completed.
+   * For SMF file type 0 (1 track only) the single track is looped. 
+   * For file type 1, all tracks except track 0 (the first) is looped. Track 0 contains
+   * global setup information that does not need to be repeated and would delay the restart
+   * of the looped tracks.
+   * 
+   * \param bMode Set true to enable mode, false to disable.
+   * \return No return data.
+   */
+  inline void looping(bool bMode) { _looping = bMode; }
+
+  /**
+   * Get the current looping mode
+   *
+   * Returns the currently set looping mode.
+   *
+   * \sa looping()
+   *
+   * \return Current looping mode.
+   */
+  inline bool isLooping(void) { return(_looping); }
+
+  /**
+   * Pause or un-pause SMF playback
+   *
+   * SMF playback can be paused (true) or un-paused (false) using this method. Whilst in pause 
+   * mode, all callbacks are suspended. 
+   * 
+   * Note that this call only stops the library from processing the file and has no effect 
+   * on the playback device. Silencing the MIDI playback device during the pause is the 
+   * responsibility of the user application, unless MIDI_ACTIVE_NOTES is enabled. Then 
+   * silenceActiveNotes() is called when the pause starts.
+   * 
+   * \param bMode Set true to enable mode, false to disable.
+   *
+   * \return No return data.
+   */
+  void pause(bool bMode);
+
+  /**
+   * Get the current pause mode
+   *
+   * Returns the currently set pause mode.
+   *
+   * \sa looping()
+   *
+   * \return Current paused mode.
+   */
+  inline bool isPaused(void) { return(_paused); }
+
+  /**
+   * Force the SMF to be restarted
+   *
+   * SMF playback can be reset back to the beginning of all tracks using this method. The method
+   * can be invoked at any time during playback and has immediate effect.
+   *
+   * \return No return data.
+   */
+  void restart(void);
+
+#if MIDI_ACTIVE_NOTES
+  /**
+   * Silence the notes that are sounding
+   *
+   * Send a Note Off message through the MIDI callback for each note that is sounding, 
+   * instead of sending All Notes Off or a Note Off for every note to all the channels. 
+   * The notes are those from the Note On messages passed to the callback without a 
+   * Note Off since. In queue mode the notes are recorded as dispatchQueue() sends them, 
+   * so the events cleared from the queue are not counted. The track member of the 
+   * events is 0.
+   *
+   * This is called by pause(), restart(), seekTick(), seekMillis() and close(). In queue 
+   * mode the Note Off messages are sent straight to the callback, so this should not 
+   * be called while dispatchQueue() may be running.
+   *
+   * \return No return data.
+   */
+  void silenceActiveNotes(void);
+#endif
+  /** @} */
+
+  //--------------------------------------------------------------
+  /** \name Methods for data handling
+   * @{
+   */
+  /** 
+   * Read and process the next event from the SMF
+   *
+   * Once a SMF is ready for processing, this method is called as frequently as possible to
+   * process the next MIDI, SYSEX or META from the tracks in the SMF.
+   * 
+   * This method will generate the tick timing from the Arduino microsecond clock.
+   * If an event needs to be processed this function will call processEvents() to do the work.
+   * 
+   * \sa getMicrosToNextEvent()
+   *
+   * \return true if a 'tick' has passed since the last call.
+   */
+  boolean getNextEvent(void);
+
+  /**
+   * Get the time until the next event is due
+   *
+   * Rather than calling getNextEvent() as frequently as possible, the application can use 
+   * this method to find out how long it can sleep, arm a timer or do other work before the 
+   * next event in the SMF needs to be processed. The time is worked out from the earliest
+   * pending event over all the tracks and the current tick time, and includes the time 
+   * already elapsed towards the next tick. 
+   *
+   * A return of 0 means that getNextEvent() should be called now. Tempo changes in the 
+   * SMF take effect as the event is processed so the time returned assumes the current 
+   * tempo. When MIDI clock messages are being sent (setClockHandler()) the time is to 
+   * the next event or the next clock, whichever is first.
+   *
+   * \return the number of microseconds to the next event, or 0xffffffff if the SMF is 
+   * paused or there are no more events.
+   */
+  uint32_t getMicrosToNextEvent(void);
+
+  /**
+   * Get the current playback position
+   *
+   * Returns the absolute tick reached in the SMF, counted from the start of the SMF
+   * and the point playback is restarted from after looping. In queue mode this is 
+   * the position that events have been read up to, which is ahead of the events 
+   * being heard.
+   *
+   * \return the current tick position.
+   */
+  inline uint32_t getTickPosition(void) { return(_tickBase + _tickCount); }
+
+ /** 
+   * Read and process the next event from the SMF
+   *
+   * This method processes the events in the SMF that are due to be processed, given the 
+   * number of ticks that have passed since the last call to the method. No tick timer 
+   * calculations or other checks are performed, so this function is suitable to be called 
+   * from user code that implements timer synchronization with an external MIDI clock.
+   * 
+   * The tracks are scheduled in a priority queue ordered by the time of their next event,
+   * so only tracks with events due are processed. The order the due events are processed 
+   * in is set by setEventOrder() and the number processed in one call may be limited by
+   * setProcessBudget(). Events still due when the budget runs out are left for the next 
+   * call, so code that calls this method directly should call processEvents(0) while 
+   * isEventDue() is true to catch up before the next tick.
+   *
+   * Each MIDI and SYSEX event is passed back to the calling program for processing though the 
+   * callback functions set up by setMidiHandler() and setSysexHandler().
+   * 
+   * \param ticks the number of ticks since the last call to this method.
+   * \return No return data
+   */
+  void processEvents(uint16_t ticks);
+
+ /** 
+   * Set the order events are processed in
+   *
+   * When more than one event is due, processEvents() handles them in one of these orders:
+   * - ORDER_TIME processes events in strict time order, with the events due at the same 
+   * tick taken from the lowest numbered track first. This is the default.
+   * - ORDER_TRACK processes all the events due on one track before moving on to the next 
+   * track, so a track that has fallen behind catches up in one go.
+   * - ORDER_EVENT processes one event from each track due and cycles through the tracks 
+   * round robin fashion until no events are left to be processed.
+   *
+   * In practice there is little difference between them unless playback falls behind.
+   * The order is reset to ORDER_TIME when the SMF is closed.
+   *
+   * \sa getEventOrder(), setProcessBudget()
+   *
+   * \param order one of the ORDER_* constants.
+   * 
+   * \return No return data
+   */
+  inline void setEventOrder(uint8_t order) { _eventOrder = (order > ORDER_EVENT ? ORDER_TIME : order); }
+
+ /** 
+   * Get the order events are processed in
+   *
+   * \sa setEventOrder()
+   *
+   * \return one of the ORDER_* constants.
+   */
+  inline uint8_t getEventOrder(void) { return(_eventOrder); }
+
+ /** 
+   * Limit the work done by one call to processEvents()
+   *
+   * Each call to processEvents(), and so getNextEvent(), stops when it has processed the 
+   * number of events or used the time specified, whichever is first. The events still 
+   * due are carried over to the following calls, so the rest of the application loop 
+   * gets a predictable slice of time even when many events fall due together. At least 
+   * one event is processed in each call, so playback always moves on. The time includes 
+   * the time spent in the callbacks and is checked between events.
+   *
+   * A value of 0 for either limit removes that limit. By default there is no limit on 
+   * either and the budget is reset when the SMF is closed.
+   *
+   * \sa isEventDue(), setEventOrder()
+   *
+   * \param events the maximum number of events for one call, 0 for no limit.
+   * \param us the maximum time for one call in microseconds, 0 for no limit.
+   * 
+   * \return No return data
+   */
+  inline void setProcessBudget(uint16_t events, uint16_t us) { _eventBudget = events; _timeBudget = us; }
+
+ /** 
+   * Check if events are waiting to be processed
+   *
+   * Events are left waiting when processEvents() stops at the budget set by 
+   * setProcessBudget(). getNextEvent() processes them on the next call without 
+   * waiting for a tick.
+   *
+   * \sa setProcessBudget()
+   *
+   * \return true if at least one event is due at the current tick.
+   */
+  inline bool isEventDue(void) { return(_heapCount > 0 && _track[_heap[0]].isEventDue(_tickCount)); }
+
+ /** 
+   * Process the SMF as fast as possible
+   *
+   * The events in all the tracks are processed in time order without waiting for 
+   * the time they are due, so a SMF can be converted, analysed or checked in the 
+   * time it takes to read it. Events are passed to the same callbacks as for 
+   * playback. During each callback getTickPosition() is the absolute tick of the 
+   * event and getRenderTime() is its time from the start of the SMF, worked out 
+   * from the tempo changes in the SMF as they are read.
+   *
+   * When maxEvents is not 0 the method returns after that number of events and can 
+   * be called again to carry on, until it returns 0 at the end of the SMF. Looping 
+   * is ignored and queue mode (queueMode()) must be off.
+   *
+   * \sa getRenderTime()
+   *
+   * \param maxEvents the maximum number of events to process, 0 for all of them.
+   * \return the number of events processed.
+   */
+  uint32_t render(uint32_t maxEvents = 0);
+
+ /** 
+   * Get the time of the event being rendered
+   *
+   * The time from the start of the SMF, or the last restart(), to the event passed 
+   * to the callback by render(), in microseconds. The time is held in 32 bits and is 
+   * only valid for the first 71 minutes of the SMF.
+   *
+   * \sa render()
+   *
+   * \return the event time in microseconds.
+   */
+  inline uint32_t getRenderTime(void) { return(_renderTime); }
+
+#if MIDI_COMPILED_STREAM
+ /** 
+   * Convert the SMF to a compiled stream
+   *
+   * The events in all the tracks of the loaded SMF are written to the output in 
+   * time order, as a compiled stream that can be played by load() like a SMF. The 
+   * events on the same tick are written in track order, as they are played with 
+   * ORDER_TIME. The End of Track META events of the tracks are replaced by one at 
+   * the end of the stream.
+   *
+   * Like render(), the SMF is processed as fast as possible, but no events are 
+   * passed to the callbacks. The output is anything derived from Print, such as an 
+   * open file on the SD card or a memory buffer. The SMF is restarted before and 
+   * after it is compiled, so it is ready to play again. Queue mode (queueMode()) 
+   * must be off.
+   *
+   * \sa load()
+   *
+   * \param out pointer to the Print object to write the compiled stream to.
+   * \return the number of bytes written, or 0 if there is no SMF loaded, it is already a stream, the output 
+   * failed or a SYSEX or META event is longer than 65535 bytes.
+   */
+  uint32_t compile(Print *out);
+#endif
+
+ /** 
+   * Set the MIDI callback function
+   *
+   * The callback function is called from the library when a MIDI events read from a track 
+   * needs to be processed.
+   *  
+   * The callback function has one parameter of type midi_event. 
+   * The pointer passed to the callback will be initialized with the event data for the 
+   * callback to process. Once the function returns from the callback the pointer 
+   * may no longer be valid (ie, don't rely on it!).
+   * 
+   * \param mh  the address of the function to be called from the library.
+   * \return No return data
+   */
+  inline void setMidiHandler(void (*mh)(midi_event *pev)) { _midiHandler = mh; _midiHandlerCtx = nullptr; };
+
+ /** 
+   * Set the MIDI callback function with a user context
+   *
+   * As setMidiHandler() but the callback is also passed the context pointer given here, 
+   * so the callback can find the object it works on (eg, the output port or the player
+   * instance) without using global variables. This replaces any MIDI callback set 
+   * by setMidiHandler().
+   *
+   * \param mh  the address of the function to be called from the library.
+   * \param ctx the context pointer passed to the callback.
+   * \return No return data
+   */
+  inline void setMidiHandler(void (*mh)(midi_event *pev, void *ctx), void *ctx) { _midiHandlerCtx = mh; _midiCtx = ctx; _midiHandler = nullptr; };
+
+#if MIDI_BATCH_SIZE
+ /** 
+   * Set the MIDI batch callback function
+   *
+   * The batch callback function is called from the library with all the MIDI events 
+   * that are due on the same tick, from all the tracks, in the order they would have
+   * been passed to the MIDI callback. This allows the output to be sent in one transfer
+   * rather than one for each event. When set, the batch callback is used instead of the 
+   * MIDI callback set by setMidiHandler().
+   * 
+   * The events are passed in one call for each tick, or in more than one if there 
+   * are more than MIDI_BATCH_SIZE events. When processEvents() catches up on more 
+   * than one tick, each tick has its own batch. A batch is also passed before any 
+   * SYSEX or META callback so the order of the events is kept. In queue mode the 
+   * batch is the queued events for the same time that are due in dispatchQueue(),
+   * up to MIDI_QUEUE_BATCH_SIZE events.
+   *
+   * The callback function has two parameters, a pointer to the first midi_event in an array
+   * and the number of events in the array. Once the function returns from the callback 
+   * the pointer may no longer be valid (ie, don't rely on it!).
+   * 
+   * \param mbh  the address of the function to be called from the library, nullptr to use the MIDI callback.
+   * \return No return data
+   */
+  inline void setMidiBatchHandler(void (*mbh)(midi_event *pev, uint8_t count)) { _midiBatchHandler = mbh; _midiBatchHandlerCtx = nullptr; };
+
+ /** 
+   * Set the MIDI batch callback function with a user context
+   *
+   * As setMidiBatchHandler() but the callback is also passed the context pointer 
+   * given here. This replaces any batch callback set by setMidiBatchHandler().
+   *
+   * \param mbh the address of the function to be called from the library, nullptr to use the MIDI callback.
+   * \param ctx the context pointer passed to the callback.
+   * \return No return data
+   */
+  inline void setMidiBatchHandler(void (*mbh)(midi_event *pev, uint8_t count, void *ctx), void *ctx) { _midiBatchHandlerCtx = mbh; _midiBatchCtx = ctx; _midiBatchHandler = nullptr; };
+#endif
+
+  /** 
+   * Set the SYSEX callback function
+   *
+   * The callback function is called from the library when a SYSEX events read from a track 
+   * needs to be processed.
+   *  
+   * The callback function has one parameter of type sysex_event.
+   * The pointer passed to the callback will be initialized with the event data for the 
+   * callback to process. Once the function returns from the callback the pointer
+   * may no longer be valid (ie, don't rely on it!).
+   * 
+   * \param sh  the address of the function to be called from the library.
+   * \return No return data
+   */
+  inline void setSysexHandler(void (*sh)(sysex_event *pev)) { _sysexHandler = sh; _sysexHandlerCtx = nullptr; };
+
+  /** 
+   * Set the SYSEX callback function with a user context
+   *
+   * As setSysexHandler() but the callback is also passed the context pointer given here.
+   * This replaces any SYSEX callback set by setSysexHandler().
+   *
+   * \param sh  the address of the function to be called from the library.
+   * \param ctx the context pointer passed to the callback.
+   * \return No return data
+   */
+  inline void setSysexHandler(void (*sh)(sysex_event *pev, void *ctx), void *ctx) { _sysexHandlerCtx = sh; _sysexCtx = ctx; _sysexHandler = nullptr; };
+
+  /** 
+   * Set the META callback function
+   *
+   * The callback function is called from the library when a META events read from a track 
+   * needs to be processed.
+   * 
+   * The callback function has one parameter of type meta_event.
+   * The pointer passed to the callback will be initialized with the meta data for the 
+   * callback to process. Once the function returns from the callback the pointer
+   * may no longer be valid (ie, don't rely on it!).
+   * 
+   * \param mh  the address of the function to be called from the library.
+   * \return No return data
+   */
+  inline void setMetaHandler(void (*mh)(const meta_event *mev)) { _metaHandler = mh; _metaHandlerCtx = nullptr; };
+
+  /** 
+   * Set the META callback function with a user context
+   *
+   * As setMetaHandler() but the callback is also passed the context pointer given here.
+   * This replaces any META callback set by setMetaHandler().
+   *
+   * \param mh  the address of the function to be called from the library.
+   * \param ctx the context pointer passed to the callback.
+   * \return No return data
+   */
+  inline void setMetaHandler(void (*mh)(const meta_event *mev, void *ctx), void *ctx) { _metaHandlerCtx = mh; _metaCtx = ctx; _metaHandler = nullptr; };
+
+#if MIDI_STREAM_CHUNK_SIZE
+  /** 
+   * Set the stream callback function
+   *
+   * When a stream callback is set all SYSEX and META events are passed to it in 
+   * chunks, straight from the track data without being copied, and the SYSEX and META
+   * callbacks are not used. There is no limit on the length of the events passed, so
+   * long SYSEX messages (eg, patch dumps) can be forwarded as they are read.
+   *
+   * The callback function has one parameter of type stream_event. The data pointed to
+   * is only valid until the callback returns.
+   * 
+   * \param sh  the address of the function to be called from the library, nullptr for normal SYSEX and META callbacks.
+   * \return No return data
+   */
+  inline void setStreamHandler(void (*sh)(const stream_event *pev)) { _streamHandler = sh; _streamHandlerCtx = nullptr; };
+
+  /** 
+   * Set the stream callback function with a user context
+   *
+   * As setStreamHandler() but the callback is also passed the context pointer given here.
+   * This replaces any stream callback set by setStreamHandler().
+   *
+   * \param sh  the address of the function to be called from the library.
+   * \param ctx the context pointer passed to the callback.
+   * \return No return data
+   */
+  inline void setStreamHandler(void (*sh)(const stream_event *pev, void *ctx), void *ctx) { _streamHandlerCtx = sh; _streamCtx = ctx; _streamHandler = nullptr; };
+#endif
+
+#if MIDI_CLOCK_OUT
+  /** 
+   * Set the MIDI clock output callback function
+   *
+   * The callback function is called from the library for each MIDI Clock, Start, Stop,
+   * Continue and Song Position Pointer message to be sent to other devices. The 
+   * parameters are the bytes of the message, ready to send as they are, and the 
+   * number of bytes (1, or 3 for Song Position Pointer). See \ref pageLibrary for 
+   * when each message is sent.
+   * 
+   * \param ch  the address of the function to be called from the library, nullptr for no clock output.
+   * \return No return data
+   */
+  inline void setClockHandler(void (*ch)(const uint8_t *data, uint8_t size)) { _clockHandler = ch; _clockHandlerCtx = nullptr; };
+
+  /** 
+   * Set the MIDI clock output callback function with a user context
+   *
+   * As setClockHandler() but the callback is also passed the context pointer given here.
+   * This replaces any clock callback set by setClockHandler().
+   *
+   * \param ch  the address of the function to be called from the library.
+   * \param ctx the context pointer passed to the callback.
+   * \return No return data
+   */
+  inline void setClockHandler(void (*ch)(const uint8_t *data, uint8_t size, void *ctx), void *ctx) { _clockHandlerCtx = ch; _clockCtx = ctx; _clockHandler = nullptr; };
+#endif
+  /** @} */
+
+#if MIDI_LOAD_SCAN
+  //--------------------------------------------------------------
+  /** \name Methods for SMF statistics
+   * @{
+   */
+  /**
+   * Get the SMF statistics
+   *
+   * The statistics are collected when the SMF is loaded and are valid until the next
+   * SMF is loaded.
+   *
+   * \sa getTrackEvents(), scan_stats
+   *
+   * \return Pointer to the SMF statistics.
+   */
+  inline const scan_stats *getScanStats(void) { return(&_scanStats); }
+
+  /**
+   * Get the number of events in a track
+   *
+   * \sa getScanStats()
+   *
+   * \param track the track number [0..getTrackCount()-1].
+   * \return the number of events in the track, 0 if the track is not valid.
+   */
+  inline uint32_t getTrackEvents(uint8_t track) { return(track < _trackCount ? _track[track].getEventCount() : 0); }
+  /** @} */
+#endif
+
+#if MIDI_TIMING_STATS
+  //--------------------------------------------------------------
+  /** \name Methods for timing statistics
+   * @{
+   */
+  /**
+   * Get the playback timing statistics
+   *
+   * The statistics are collected from when the SMF is loaded, or from the last call to 
+   * resetTimingStats(). The data is updated as the SMF is played, so it should be 
+   * copied if a snapshot is required.
+   *
+   * \sa resetTimingStats(), timing_stats
+   *
+   * \return Pointer to the timing statistics.
+   */
+  inline const timing_stats *getTimingStats(void) { return(&_stats); }
+
+  /**
+   * Reset the playback timing statistics
+   *
+   * Clear all the statistics to start a new measurement.
+   *
+   * \sa getTimingStats()
+   *
+   * \return No return data
+   */
+  void resetTimingStats(void);
+  /** @} */
+#endif
+
+#if MIDI_EVENT_FILTER
+  //--------------------------------------------------------------
+  /** \name Methods for event filtering
+   * @{
+   */
+  /**
+   * Set the MIDI status filter
+   *
+   * Each bit set in the mask skips one type of event (MIDI_FILTER_NOTE_OFF to 
+   * MIDI_FILTER_PITCH_BEND for the channel messages, MIDI_FILTER_SYSEX for SYSEX 
+   * messages). Filtered events are still parsed far enough to keep the running status
+   * correct but are never passed to the callbacks, the queue or the batch.
+   *
+   * \sa getStatusFilter(), clearFilters()
+   *
+   * \param mask the MIDI_FILTER_* bits for the events to skip.
+   * \return No return data
+   */
+  inline void setStatusFilter(uint8_t mask) { _statusFilter = mask; }
+
+  /**
+   * Get the MIDI status filter
+   *
+   * \sa setStatusFilter()
+   *
+   * \return The current status filter mask.
+   */
+  inline uint8_t getStatusFilter(void) { return(_statusFilter); }
+
+  /**
+   * Set the MIDI channel filter
+   *
+   * Bit n set in the mask (0-15) skips all the channel messages for MIDI channel n.
+   *
+   * \sa getChannelFilter(), clearFilters()
+   *
+   * \param mask the bits for the channels to skip.
+   * \return No return data
+   */
+  inline void setChannelFilter(uint16_t mask) { _channelFilter = mask; }
+
+  /**
+   * Get the MIDI channel filter
+   *
+   * \sa setChannelFilter()
+   *
+   * \return The current channel filter mask.
+   */
+  inline uint16_t getChannelFilter(void) { return(_channelFilter); }
+
+  /**
+   * Set the META event filter
+   *
+   * Skip, or stop skipping, META events of the specified type (0-127). The data for 
+   * skipped events is not read into memory. End of Track, Set Tempo and Time Signature 
+   * events are still used by the library to play the file but are not passed to the 
+   * callbacks.
+   *
+   * \sa clearFilters()
+   *
+   * \param type the META event type.
+   * \param skip true to skip the events, false to pass them to the callbacks.
+   * \return No return data
+   */
+  void setMetaFilter(uint8_t type, bool skip);
+
+  /**
+   * Clear all the event filters
+   *
+   * After this call all events are passed to the callbacks.
+   *
+   * \return No return data
+   */
+  void clearFilters(void);
+  /** @} */
+#endif
+
+#if MIDI_QUEUE_SIZE
+  //--------------------------------------------------------------
+  /** \name Methods for interrupt driven playback
+   * @{
+   */
+  /**
+   * Set the queue mode for SMF playback
+   *
+   * In queue mode MIDI events are not passed to the MIDI callback as they are read 
+   * from the SMF. Instead queueEvents() reads ahead and places each event, with the 
+   * time it is due, in a queue. The events are sent to the MIDI callback from 
+   * dispatchQueue(), normally called from a hardware timer interrupt, so output 
+   * timing is not affected by SD card latency or other work in the main loop.
+   * getNextEvent() and processEvents() should not be used in this mode.
+   *
+   * See the \ref pageLibrary page for the restrictions on callbacks in this mode.
+   *
+   * \sa queueEvents(), dispatchQueue()
+   *
+   * \param bMode Set true to enable mode, false to disable.
+   * \return No return data.
+   */
+  void queueMode(bool bMode);
+
+  /**
+   * Get the current queue mode
+   *
+   * \sa queueMode()
+   *
+   * \return Current queue mode.
+   */
+  inline bool isQueueMode(void) { return(_queueMode); }
+
+  /**
+   * Fill the event queue from the SMF
+   *
+   * This is the producer side of queue mode and is called from the main loop as often 
+   * as possible, in place of getNextEvent(). Events are read from the tracks in time 
+   * order until the queue is full. Tempo and other META events are processed, and 
+   * META and SYSEX callbacks are invoked, as the events are read ahead of time. Tempo 
+   * changes (including setTempo() and setTempoAdjust()) therefore only apply to events
+   * that have not yet been queued.
+   *
+   * \return the number of events in the queue.
+   */
+  uint8_t queueEvents(void);
+
+  /**
+   * Dispatch the events that are due from the queue
+   *
+   * This is the consumer side of queue mode. It is safe to call from an interrupt 
+   * service routine, normally a periodic hardware timer. All the events that are due
+   * are passed to the MIDI callback in the context of the caller. 
+   *
+   * The value returned can be used to arm a one-shot timer for the next event.
+   *
+   * \return the number of microseconds until the next queued event is due, or 0xffffffff 
+   * if the queue is empty or playback is paused.
+   */
+  uint32_t dispatchQueue(void);
+
+  /**
+   * Get the number of queued events
+   *
+   * \return the number of events in the queue.
+   */
+  inline uint8_t getQueueCount(void) { return(_queue.count()); }
+  /** @} */
+#endif // MIDI_QUEUE_SIZE
+
+#if MIDI_PIPELINE
+  //--------------------------------------------------------------
+  /** \name Methods for pipelined playback
+   * @{
+   */
+  /**
+   * Set the pipeline mode for SMF playback
+   *
+   * The pipeline is queue mode (queueMode()) with the reading of the SMF and the
+   * sending of the events run on different cores, so neither the SD card nor the 
+   * output is held up by the other or by the application:
+   * - ESP32: a task on MIDI_PIPELINE_READ_CORE calls queueEvents() and a task on 
+   * MIDI_PIPELINE_SEND_CORE calls dispatchQueue(). The SYSEX and META callbacks 
+   * run in the read task and the MIDI callback in the send task.
+   * - RP2040: the second core calls dispatchQueue() and pipelineLoop() calls 
+   * queueEvents(). The sketch should not define setup1() and loop1().
+   * - other processors: pipelineLoop() calls queueEvents() and dispatchQueue().
+   *
+   * The SMF should be loaded before the pipeline is started. While the pipeline is 
+   * running any call that changes the SMF, such as pause(), restart(), seekTick(), 
+   * close() or the tempo, must be made between pipelineLock() and pipelineUnlock().
+   * When looping the SMF is restarted by the pipeline, so isEOF() should not be used.
+   *
+   * \sa pipelineLoop(), pipelineLock()
+   *
+   * \param bMode Set true to start the pipeline, false to stop it.
+   * \return true if the mode was set, false if the tasks could not be started.
+   */
+  bool pipelineMode(bool bMode);
+
+  /**
+   * Get the current pipeline mode
+   *
+   * \sa pipelineMode()
+   *
+   * \return Current pipeline mode.
+   */
+  inline bool isPipelineMode(void) { return(_pipeRun); }
+
+  /**
+   * Run the part of the pipeline for the main loop
+   *
+   * Call as often as possible from loop() in pipeline mode. Does nothing on ESP32,
+   * as both sides of the pipeline are run by tasks.
+   *
+   * \sa pipelineMode()
+   *
+   * \return the number of events in the queue.
+   */
+  uint8_t pipelineLoop(void);
+
+  /**
+   * Hold the pipeline for changes to the SMF
+   *
+   * Waits until the pipeline is stopped between events on both cores. No events
+   * are read or sent until pipelineUnlock() is called, so the lock should be held
+   * for as short a time as possible.
+   *
+   * \sa pipelineUnlock()
+   *
+   * \return No return data.
+   */
+  void pipelineLock(void);
+
+  /**
+   * Release the pipeline after pipelineLock()
+   *
+   * \sa pipelineLock()
+   *
+   * \return No return data.
+   */
+  inline void pipelineUnlock(void) { MIDI_QUEUE_BARRIER(); _pipeHold = false; }
+  /** @} */
+#endif // MIDI_PIPELINE
+
+#if MIDI_TEMPO_MAP_SIZE
+  //--------------------------------------------------------------
+  /** \name Methods for the tempo map
+   * @{
+   */
+  /**
+   * Convert a tick to playing time
+   *
+   * Uses the tempo map built by load() to work out the playing time from the start 
+   * of the SMF to the absolute tick specified, taking account of all the tempo changes
+   * in the SMF and the current tempo adjustment. The map is searched with a binary 
+   * search and the tick time for each tempo is precalculated, so no division is needed.
+   *
+   * Times are held in 32 bits and are only valid for the first 71 minutes of the SMF.
+   * The tempo map holds the first MIDI_TEMPO_MAP_SIZE tempo changes. Any further 
+   * changes are ignored.
+   *
+   * \sa microsToTick(), getDuration()
+   *
+   * \param tick the absolute tick.
+   * \return the time to the tick in microseconds.
+   */
+  uint32_t tickToMicros(uint32_t tick);
+
+  /**
+   * Convert playing time to a tick
+   *
+   * Uses the tempo map built by load() to work out the absolute tick reached after 
+   * the time specified from the start of the SMF. One division is needed, for the 
+   * time after the last tempo change. Otherwise the same as tickToMicros().
+   *
+   * \sa tickToMicros()
+   *
+   * \param us the playing time in microseconds.
+   * \return the absolute tick at the time.
+   */
+  uint32_t microsToTick(uint32_t us);
+
+  /**
+   * Get the playing time of the SMF
+   *
+   * The time from the start of the SMF to the last event in any track, from the 
+   * tempo map built by load(). 
+   *
+   * \sa tickToMicros(), getEndTick()
+   *
+   * \return the playing time of the SMF in microseconds.
+   */
+  inline uint32_t getDuration(void) { return(tickToMicros(_endTick)); }
+
+  /**
+   * Get the length of the SMF in ticks
+   *
+   * The absolute tick of the last event in any track, found when the tempo map is
+   * built by load().
+   *
+   * \sa getDuration()
+   *
+   * \return the last tick in the SMF.
+   */
+  inline uint32_t getEndTick(void) { return(_endTick); }
+  /** @} */
+#endif // MIDI_TEMPO_MAP_SIZE
+
+#if MIDI_SEEK_CHECKPOINTS
+  //--------------------------------------------------------------
+  /** \name Methods for fast seek
+   * @{
+   */
+  /**
+   * Move playback to a tick in the SMF
+   *
+   * Playback is moved to the absolute tick specified, counted from the start of the 
+   * SMF. The tracks are scanned silently from the nearest earlier checkpoint in the 
+   * seek index, adding checkpoints to the index as new parts of the SMF are scanned.
+   * Tempo and time signature changes are applied as they are found. The last program 
+   * change, channel pressure, pitch bend and the common controllers (bank select, 
+   * modulation, volume, pan, expression, sustain, reverb and chorus) for each channel 
+   * are chased and sent to the MIDI callback once the new position is reached, so the 
+   * synth is set up correctly for the events that follow. No other MIDI, SYSEX or META 
+   * callbacks are invoked during the seek. The chased messages have the track set to 0.
+   *
+   * Events due at the tick itself are played once playback continues. The pause 
+   * mode is not changed. In queue mode any events in the queue are discarded.
+   *
+   * Seeking past the end of the SMF scans the whole file, which can be used to 
+   * build the complete seek index in advance.
+   *
+   * \sa seekMillis()
+   *
+   * \param tick the tick to move to.
+   * \return true if the position was found, false if it is past the end of the SMF.
+   */
+  inline bool seekTick(uint32_t tick) { return(seek(tick, 0xffffffff)); }
+
+  /**
+   * Move playback to a time in the SMF
+   *
+   * Playback is moved to the time specified, in milliseconds from the start of the 
+   * SMF. The time is worked out from the tempo changes in the SMF as it is scanned and 
+   * assumes the tempo adjustment (setTempoAdjust()) has not changed since the seek 
+   * index was built.  Otherwise the same as seekTick().
+   *
+   * \sa seekTick()
+   *
+   * \param ms the time to move to in milliseconds.
+   * \return true if the position was found, false if it is past the end of the SMF.
+   */
+  inline bool seekMillis(uint32_t ms) { return(seek(0xffffffff, ms)); }
+  /** @} */
+#endif // MIDI_SEEK_CHECKPOINTS
+
+#if MIDI_LOOP_REGION
+  //--------------------------------------------------------------
+  /** \name Methods for the loop region
+   * @{
+   */
+  /**
+   * Set the loop region in ticks
+   *
+   * Once playback reaches tickB it wraps back to tickA, for as long as the loop 
+   * region is set. Both ticks are absolute ticks counted from the start of the SMF.
+   * The events at tickA are played on each pass and the events at tickB are never 
+   * played. Any ticks counted past tickB carry on from tickA, so the loop keeps 
+   * time. When MIDI_ACTIVE_NOTES is enabled the notes sounding are turned off at 
+   * each wrap. Any events before tickB still waiting because of the budget set by 
+   * setProcessBudget() are not played.
+   *
+   * The state of each track (position, running status) and the tempo and time 
+   * signature are saved when playback reaches tickA, so the wrap is a restore of 
+   * the saved state. If playback is already past tickA the SMF seeks to tickA at the 
+   * first wrap when MIDI_SEEK_CHECKPOINTS is enabled, otherwise the loop starts the 
+   * next time playback reaches tickA. Setting a new region discards the saved state.
+   *
+   * The loop is only applied to the ticks counted by getNextEvent() and 
+   * processEvents(), not by render() or queueEvents().
+   *
+   * \sa setLoopMarkers(), clearLoopRegion()
+   *
+   * \param tickA the tick at the start of the loop.
+   * \param tickB the tick at the end of the loop, after tickA.
+   * \return true if the region was set, false if tickB is not after tickA.
+   */
+  bool setLoopRegion(uint32_t tickA, uint32_t tickB);
+
+  /**
+   * Set the loop region from markers in the SMF
+   *
+   * The tracks are scanned for the first Marker META event (type 0x06) with the
+   * text markA, and then for the first Marker with the text markB after it. The 
+   * text must match exactly. The same text can be used for both markers. The loop
+   * region is then set as for setLoopRegion().
+   *
+   * The scan restarts the SMF, so this should be called after load() and before 
+   * playback is started.
+   *
+   * \sa setLoopRegion(), clearLoopRegion()
+   *
+   * \param markA the text of the marker at the start of the loop.
+   * \param markB the text of the marker at the end of the loop.
+   * \return true if both markers were found and the region was set.
+   */
+  bool setLoopMarkers(const char *markA, const char *markB);
+
+  /**
+   * Clear the loop region
+   *
+   * Playback carries on from the current position to the end of the SMF. The 
+   * loop region is also cleared when the SMF is closed.
+   *
+   * \sa setLoopRegion(), setLoopMarkers()
+   *
+   * \return No return data.
+   */
+  void clearLoopRegion(void);
+
+  /**
+   * Check if a loop region is set
+   *
+   * \return true if a loop region is set.
+   */
+  inline bool isLoopRegion(void) { return(_loopEnd != 0); }
+
+  /**
+   * Get the start of the loop region
+   *
+   * \return the absolute tick at the start of the loop region.
+   */
+  inline uint32_t getLoopStart(void) { return(_loopStart); }
+
+  /**
+   * Get the end of the loop region
+   *
+   * \return the absolute tick at the end of the loop region, 0 if there is no loop region.
+   */
+  inline uint32_t getLoopEnd(void) { return(_loopEnd); }
+
+  /**
+   * Get the number of times playback has wrapped
+   *
+   * The count is reset when the loop region is set or cleared.
+   *
+   * \return the number of times playback has wrapped to the start of the loop region.
+   */
+  inline uint16_t getLoopCount(void) { return(_loopCount); }
+  /** @} */
+#endif // MIDI_LOOP_REGION
+
+#if MIDI_CLOCK_SYNC
+  //--------------------------------------------------------------
+  /** \name Methods for external MIDI clock sync
+   * @{
+   */
+  /**
+   * Follow an external MIDI clock
+   *
+   * When enabled the SMF ticks in getNextEvent() are worked out from the MIDI clock 
+   * messages passed to clockEvent() and the tempo in the SMF is ignored. Playback 
+   * waits for a Start or Continue message. When disabled the library clock takes 
+   * over again from the current position. The clock period starts at the current 
+   * tempo of the SMF until the clock messages are received.
+   *
+   * Sync mode is not used by queueEvents().
+   *
+   * \sa clockEvent(), clockSongPosition()
+   *
+   * \param bEnable true to follow the external clock, false to use the library clock.
+   * \return No return data
+   */
+  void setClockSync(bool bEnable);
+
+  /**
+   * Check if playback follows an external MIDI clock
+   *
+   * \sa setClockSync()
+   *
+   * \return true if sync mode is enabled.
+   */
+  inline bool getClockSync(void) { return(_syncMode); }
+
+  /**
+   * Pass a MIDI real time message to the clock sync
+   *
+   * The application calls this method for every MIDI Clock (0xF8), Start (0xFA), 
+   * Continue (0xFB) and Stop (0xFC) message received, with the time the message 
+   * was received. The closer the time is to the arrival of the message the less 
+   * jitter there is to remove. Other status bytes, and all messages when sync mode 
+   * is not enabled, are ignored.
+   *
+   * Clock messages update the clock period even when stopped, so playback starts at 
+   * the right tempo. Start moves the SMF back to the beginning, with the first event 
+   * played on the next clock. Stop pauses playback and Continue carries on, from the 
+   * position set by clockSongPosition() if there was one, on the next clock.
+   *
+   * The method is not safe to call from an interrupt handler.
+   *
+   * \sa setClockSync(), clockSongPosition()
+   *
+   * \param status the MIDI status byte received.
+   * \param t the time the message was received, from micros().
+   * \return No return data
+   */
+  void clockEvent(uint8_t status, uint32_t t);
+
+  /**
+   * Pass a MIDI Song Position Pointer to the clock sync
+   *
+   * The position is the 14 bit value from the Song Position Pointer (0xF2) message, 
+   * counted in MIDI beats (16th notes, 6 clocks) from the start of the SMF. The SMF is 
+   * moved to the tick at the position with seekTick() and playback continues from 
+   * there on the next clock after a Continue. Without the seek index 
+   * (MIDI_SEEK_CHECKPOINTS) only a position of 0 moves the SMF, back to its start.
+   *
+   * \sa clockEvent()
+   *
+   * \param beats the song position in MIDI beats.
+   * \return No return data
+   */
+  void clockSongPosition(uint16_t beats);
+
+  /**
+   * Get the smoothed external clock period
+   *
+   * The time between MIDI clocks worked out by the phase locked loop. The tempo of
+   * the master in beats per minute is 2,500,000 / period.
+   *
+   * \sa clockEvent()
+   *
+   * \return the MIDI clock period in microseconds.
+   */
+  inline uint32_t getClockPeriod(void) { return(_syncPeriod >> 8); }
+
+  /**
+   * Check if the external clock is running
+   *
+   * \sa clockEvent()
+   *
+   * \return true after a Start or Continue until the next Stop.
+   */
+  inline bool isClockRunning(void) { return(_syncRunning); }
+  /** @} */
+#endif // MIDI_CLOCK_SYNC
+
+  //--------------------------------------------------------------
+  /** \name Methods for debugging
+   * @{
+   */
+  /** 
+   * Dump the SMF header data to the debug stream
+   *
+   * During debugging, this method provides a formatted dump of data to the debug
+   * output stream.
+   *
+   * The DUMP_DATA macro define must be set to 1 to enable this method.
+   */
+  void dump(void);
+  /** @} */
+
+protected:
+  void    calcTickTime(void); ///< called internally to update the tick time when parameters change
+  void    tickTimeFor(uint32_t m, uint32_t *tt, uint16_t *frac); ///< work out the tick time for a tempo
+  void    initialise(void);   ///< initialize class variables all in one place
+  void    synchTracks(void);  ///< synchronize the start of all tracks
+  uint16_t tickClock(void);   ///< work out the number of ticks since the last event check
+  uint16_t pollTicks(void);   ///< start the time line if needed and count the ticks since the last check
+  void    processTimed(uint16_t ticks); ///< process the events for ticks counted from the clock
+#if MIDI_MULTI_SONGS
+  bool    eventDue(uint16_t ticks, uint16_t *step, uint32_t *late); ///< check for an event due within the ticks not yet processed
+#endif
+
+  void    handleMidi(midi_event *pev); ///< pass a MIDI event to the callback or the queue
+  void    sendMidi(midi_event *pev);   ///< pass a MIDI event to the callback or the batch
+  void    sendSysex(sysex_event *pev); ///< pass a SYSEX event to the callback
+  void    sendMeta(const meta_event *pev); ///< pass a META event to the callback
+#if MIDI_STREAM_CHUNK_SIZE
+  void    sendStream(const stream_event *pev); ///< pass a SYSEX or META chunk to the stream callback
+  inline bool isStreaming(void) { return(_streamHandler != nullptr || _streamHandlerCtx != nullptr); } ///< true if there is a stream callback
+#endif
+  inline void callMidi(midi_event *pev) ///< call the MIDI callback
+    { if (_midiHandler != nullptr) (_midiHandler)(pev); else if (_midiHandlerCtx != nullptr) (_midiHandlerCtx)(pev, _midiCtx); }
+#if MIDI_BATCH_SIZE
+  void    flushBatch(void);            ///< pass the events collected in the batch to the callback
+  inline bool isBatch(void) { return(_midiBatchHandler != nullptr || _midiBatchHandlerCtx != nullptr); } ///< true if there is a batch callback
+  inline void callBatch(midi_event *pev, uint8_t count) ///< call the MIDI batch callback
+    { if (_midiBatchHandler != nullptr) (_midiBatchHandler)(pev, count); else if (_midiBatchHandlerCtx != nullptr) (_midiBatchHandlerCtx)(pev, count, _midiBatchCtx); }
+  inline void batchTick(uint32_t tick) ///< pass the batch on when the tick of the next event is different
+    { if ((_batchCount != 0) && (tick != _batchTick)) flushBatch(); _batchTick = tick; }
+#else
+  inline void flushBatch(void) {}      ///< pass the events collected in the batch to the callback
+  inline void batchTick(uint32_t) {} ///< pass the batch on when the tick of the next event is different
+#endif
+  bool    heapBefore(uint8_t a, uint8_t b); ///< true if track a is scheduled before track b
+  void    heapSiftDown(uint16_t idx); ///< restore the heap order below idx
+  void    heapBuild(void);            ///< schedule all the active tracks
+  void    heapUpdateTop(void);        ///< reschedule the track at the top of the heap
+  void    trackEvent(uint8_t i);      ///< process the next event on track i
+  inline bool isBudgetUsed(uint16_t n, uint32_t start) ///< true if processEvents() has used its budget
+    { return((_eventBudget != 0 && n >= _eventBudget) || (_timeBudget != 0 && micros() - start >= _timeBudget)); }
+#if MIDI_TRACK_ARENA
+  bool    arenaCarve(uint8_t tracks); ///< lay out the tracks in the arena
+#endif
+
+#if MIDI_TEMPO_MAP_SIZE
+  void    tempoMapBuild(void);        ///< scan the SMF for the tempo map
+  void    tempoMapStart(void);        ///< start a new tempo map with the MIDI default tempo
+  bool    tempoMapScan(uint8_t i, uint16_t events); ///< scan the next events of track i for the tempo map, true at the end of the track
+  void    tempoMapAdd(uint32_t tick, uint32_t m); ///< add a tempo change to the map
+  void    tempoMapCalc(void);         ///< work out the time of each tempo change
+  uint8_t tempoMapFind(uint32_t v, bool byTime); ///< find the tempo in effect at a tick or time
+#endif
+
+#if MIDI_SEEK_CHECKPOINTS
+  bool    seek(uint32_t tick, uint32_t ms);   ///< move to the tick or time, whichever is first
+  void    seekReset(void);                    ///< clear the seek index
+  void    seekCheckpoint(uint32_t tick, uint32_t ms, uint16_t us, uint16_t phase); ///< save a checkpoint in the seek index
+  void    addTickTime(uint32_t ticks, uint32_t *ms, uint16_t *us, uint16_t *phase); ///< add the time for ticks at the current tempo
+  void    chaseEvent(const midi_event *pev);  ///< save the MIDI channel state from the event
+  void    chaseSend(void);                    ///< send the saved MIDI channel state
+  inline bool isSeeking(void) { return(_seeking); }  ///< true if a seek is scanning the tracks
+#else
+  inline bool isSeeking(void) { return(false); }     ///< true if a seek is scanning the tracks
+#endif
+
+#if MIDI_PIPELINE
+#if MIDI_PIPELINE_TASKS
+  void    pipelineRead(void);         ///< the read side of the pipeline, run until the pipeline stops
+  static void pipelineReadTask(void *p);  ///< FreeRTOS task for the read side of the pipeline
+  static void pipelineSendTask(void *p);  ///< FreeRTOS task for the send side of the pipeline
+#endif
+#if MIDI_PIPELINE_CORE1
+  static void pipelineCore1(void);    ///< second core entry for the send side of the pipeline
+#endif
+  void    pipelineSend(void);         ///< the send side of the pipeline, run until the pipeline stops
+  inline bool pipelineHeld(volatile bool *idle) ///< true if the side with the idle flag should wait for pipelineUnlock()
+  {
+    *idle = false;
+    MIDI_QUEUE_BARRIER();   // the other core sees the flag change before _pipeHold is checked
+    if (!_pipeHold)
+      return(false);
+    *idle = true;
+    return(true);
+  }
+#endif
+
+#if MIDI_LOOP_REGION
+  uint16_t loopCheck(uint16_t ticks); ///< deal with the loop points in the next ticks, returning the ticks left
+  void    loopSave(void);             ///< save the state at the start of the loop region
+  void    loopRestore(void);          ///< restore the state at the start of the loop region
+#endif
+
+#if MIDI_ACTIVE_NOTES
+  inline void noteActive(const midi_event *pev) ///< keep track of the notes sounding
+  {
+    if ((pev->data[0] & 0xe0) == 0x80)   // note off or note on
+    {
+      uint8_t *p = &_activeNotes[(pev->channel << 4) | ((pev->data[1] & 0x7f) >> 3)];
+      uint8_t bit = (1 << (pev->data[1] & 7));
+
+      if ((pev->data[0] == 0x90) && (pev->data[2] != 0))
+        *p |= bit;
+      else
+        *p &= ~bit;
+    }
+  }
+
+  uint8_t _activeNotes[16 * 128 / 8]; ///< one bit for each note sounding, 16 bytes per channel
+#endif
+
+#if MIDI_PLAYLIST_SIZE
+  uint32_t getEndTime(void);  ///< the time the last event in the SMF was due
+
+  bool    _scanDefer;         ///< if true load() leaves the load time scans to the MD_MIDIPlaylist preload
+#endif
+
+#if MIDI_CLOCK_OUT
+  static const uint8_t CLOCK_IDLE = 0;  ///< _clockState when Start is sent before the next clock
+  static const uint8_t CLOCK_RUN = 1;   ///< _clockState when clocks are being sent
+  static const uint8_t CLOCK_STOP = 2;  ///< _clockState when Continue is sent before the next clock
+
+  void    clockTick(uint16_t ticks);  ///< send the clock messages due in the ticks
+  void    clockStop(uint8_t state);   ///< send Stop if the clock is running and set the new state
+  void    clockPosition(void);        ///< send the Song Position Pointer for the current tick
+  void    sendClock(uint8_t status, uint16_t beats); ///< pass a clock message to the callback
+  inline bool isClockOut(void) { return(_clockHandler != nullptr || _clockHandlerCtx != nullptr); } ///< true if there is a clock callback
+
+  void (*_clockHandler)(const uint8_t *data, uint8_t size);  ///< callback into user code to send MIDI clock messages
+  void (*_clockHandlerCtx)(const uint8_t *data, uint8_t size, void *ctx);  ///< callback with context into user code to send MIDI clock messages
+  void    *_clockCtx;         ///< user context for the clock callback
+  uint8_t  _clockState;       ///< CLOCK_* state of the clock output
+  int32_t  _clockAcc;         ///< 24ths of a tick since the last clock, the next clock is sent at _ticksPerQuarterNote
+#endif
+
+#if MIDI_CLOCK_SYNC
+  uint16_t syncClock(void);   ///< work out the number of ticks from the external clock
+  void    syncPosition(void); ///< set the ticks played to the current clock position
+
+  bool     _syncMode;         ///< true if the ticks follow the external clock
+  bool     _syncRunning;      ///< true between Start or Continue and Stop
+  bool     _syncLocked;       ///< true once the loop has a clock time to work from
+  bool     _syncFirst;        ///< true if the next clock is at the current position, not the one after
+  uint32_t _syncPeriod;       ///< smoothed clock period in microseconds, 24.8 fixed point
+  uint32_t _syncLast;         ///< smoothed time of the last clock
+  uint32_t _syncRaw;          ///< time the last clock was received
+  uint32_t _syncBase;         ///< SMF tick at the start of the quarter note of the last clock
+  uint8_t  _syncClock;        ///< clock number within the quarter note of the last clock (0-23)
+  uint32_t _syncTick;         ///< SMF tick played up to by the sync
+#endif
+
+  int     loadFinish(void);           ///< get the tracks ready to play at the end of load()
+#if MIDI_COMPILED_STREAM
+  int     loadStream(void);           ///< load the header and track of a compiled stream
+#endif
+
+#if MIDI_LOAD_SCAN
+  int     scan(void);                 ///< check all the events in the SMF and collect the statistics
+
+  scan_stats _scanStats;      ///< the statistics from the load scan
+#endif
+
+#if MIDI_TIMING_STATS
+  void    statsEvent(uint32_t ticks);  ///< record an event processed the number of ticks after it was due
+  inline void statsRead(uint32_t us)   ///< record the time for a read from the data source
+    { _stats.reads++; _stats.readTotal += us; if (us > _stats.readMax) _stats.readMax = us; }
+
+  timing_stats _stats;        ///< the playback timing statistics
+  uint32_t _statsTickDue;     ///< time the current tick was due, while getNextEvent() processes events
+  bool     _statsTimed;       ///< true when _statsTickDue is valid
+#endif
+
+#if MIDI_EVENT_FILTER
+  inline bool isMidiFiltered(const midi_event *pev) ///< true if the MIDI event is skipped by the filters
+    { return(((_statusFilter >> ((pev->data[0] >> 4) - 8)) & 1) || ((_channelFilter >> pev->channel) & 1)); }
+  inline bool isMetaFiltered(uint8_t type) ///< true if the META event type is skipped by the filter
+    { return(type < 128 && (_metaFilter[type >> 3] & (1 << (type & 7)))); }
+
+  uint8_t  _statusFilter;     ///< MIDI_FILTER_* bits for the events skipped
+  uint16_t _channelFilter;    ///< bit n set skips MIDI channel n
+  uint8_t  _metaFilter[16];   ///< bit set for each META type (0-127) skipped
+#endif
+
+  void (*_midiHandler)(midi_event *pev);   ///< callback into user code to process MIDI stream
+  void (*_midiHandlerCtx)(midi_event *pev, void *ctx);   ///< callback with context into user code to process MIDI stream
+  void (*_sysexHandlerCtx)(sysex_event *pev, void *ctx); ///< callback with context into user code to process SYSEX stream
+  void (*_metaHandlerCtx)(const meta_event *pev, void *ctx); ///< callback with context into user code to process META stream
+  void *_midiCtx;     ///< user context for the MIDI callback
+  void *_sysexCtx;    ///< user context for the SYSEX callback
+  void *_metaCtx;     ///< user context for the META callback
+#if MIDI_STREAM_CHUNK_SIZE
+  void (*_streamHandler)(const stream_event *pev);  ///< callback into user code to process SYSEX and META streams
+  void (*_streamHandlerCtx)(const stream_event *pev, void *ctx); ///< callback with context into user code to process SYSEX and META streams
+  void *_streamCtx;   ///< user context for the stream callback
+#endif
+#if MIDI_BATCH_SIZE
+  void (*_midiBatchHandler)(midi_event *pev, uint8_t count); ///< callback into user code to process MIDI events in batches
+  void (*_midiBatchHandlerCtx)(midi_event *pev, uint8_t count, void *ctx); ///< callback with context into user code to process MIDI events in batches
+  void *_midiBatchCtx;                     ///< user context for the MIDI batch callback
+  midi_event _batch[MIDI_BATCH_SIZE];      ///< the MIDI events collected for the batch callback
+  uint8_t   _batchCount;                   ///< the number of events in the batch
+  uint32_t  _batchTick;                    ///< the tick of the events in the batch
+#endif
+  void (*_sysexHandler)(sysex_event *pev); ///< callback into user code to process SYSEX stream
+  void (*_metaHandler)(const meta_event *pev); ///< callback into user code to process META stream
+
+  const char *_fileName;      ///< MIDI file name buffer in user code
+
+  uint8_t _format;            ///< file format - 0: single track, 1: multiple track, 2: multiple song
+  uint8_t _trackCount;        ///< number of tracks in file
+
+  uint16_t  _ticksPerQuarterNote; ///< time base of file
+  uint32_t  _tickTime;            ///< calculated per tick based on other data for MIDI file
+  uint16_t  _tickFrac;            ///< fraction of a microsecond in the tick time, 16 bit fixed point
+  uint16_t  _tickPhase;           ///< fraction of a microsecond carried to the next tick, 16 bit fixed point
+  uint32_t  _lastTickError;       ///< time brought forward from last tick check
+  uint32_t  _lastTickCheckTime;   ///< the last time (microsec) an tick check was performed
+  uint32_t  _tickCount;           ///< absolute tick count since the tracks were last synchronized
+  uint32_t  _tickBase;            ///< absolute tick in the SMF when the tracks were last synchronized
+
+  bool    _synchDone;             ///< sync up at the start of all tracks
+  bool    _paused;                ///< if true we are currently paused
+  bool    _looping;               ///< if true we are currently looping
+
+  uint32_t  _usPerQN;             ///< tempo for this file in microseconds per quarter note
+  uint16_t  _tempo;               ///< tempo for this file in beats per minute
+  int16_t   _tempoDelta;          ///< tempo offset adjustment in beats per minute
+
+  uint8_t   _timeSignature[2];    ///< time signature [0] = numerator, [1] = denominator
+
+  // file handling
+  uint8_t   _selectSD;          ///< SDFat select line
+  SDFAT     *_sd;                ///< SDFat library descriptor supplied by calling program
+  MD_MFSource   *_src;          ///< the data source for the SMF being processed
+  MD_MFSourceSD _srcSD;         ///< data source for SMF on the SD card
+  MD_MFSourceMem _srcMem;       ///< data source for SMF in memory
+#if MIDI_TRACK_ARENA
+  uint8_t   *_arena;            ///< the memory for the tracks, supplied by user code
+  uint32_t  _arenaSize;         ///< the size of the arena in bytes
+  MD_MFTrack   *_track;         ///< the track data for this file, in the arena
+  uint8_t   *_heap;             ///< min-heap of track numbers ordered by next event tick, in the arena
+#else
+  MD_MFTrack   _track[MIDI_MAX_TRACKS]; ///< the track data for this file
+  uint8_t   _heap[MIDI_MAX_TRACKS]; ///< min-heap of track numbers ordered by next event tick
+#endif
+  uint8_t   _heapCount;         ///< number of tracks in the heap
+  uint8_t   _eventOrder;        ///< ORDER_* for the events due in processEvents()
+  uint16_t  _eventBudget;       ///< maximum events for one processEvents() call, 0 for no limit
+  uint16_t  _timeBudget;        ///< maximum time for one processEvents() call in microseconds, 0 for no limit
+  bool      _carryOver;         ///< true if the last processEvents() call left events due
+  uint32_t  _renderTime;        ///< time of _tickCount in render(), microseconds from the start
+  uint16_t  _renderPhase;       ///< fraction of a microsecond carried in _renderTime, 16 bit fixed point
+
+#if MIDI_QUEUE_SIZE
+  // interrupt driven playback
+  bool      _queueMode;         ///< if true events are queued for dispatchQueue()
+  MD_MFQueue _queue;            ///< events waiting to be dispatched
+  uint32_t  _queueTime;         ///< time of the current tick being read ahead, microseconds from start
+  uint16_t  _queuePhase;        ///< fraction of a microsecond carried in _queueTime, 16 bit fixed point
+  volatile uint32_t _queueBase; ///< micros() value at the start of playback for queued events
+  uint32_t  _queuePauseTime;    ///< micros() value when the queue was paused
+#endif
+
+#if MIDI_PIPELINE
+  // pipelined playback
+  volatile bool _pipeRun;       ///< true while the pipeline is running
+  volatile bool _pipeHold;      ///< true when pipelineLock() is holding the pipeline
+  volatile bool _pipeReadIdle;  ///< true while the read side is waiting for _pipeHold to clear
+  volatile bool _pipeSendIdle;  ///< true while the send side is waiting for _pipeHold to clear
+  volatile bool _pipeReadDone;  ///< true once the read side has stopped
+  volatile bool _pipeSendDone;  ///< true once the send side has stopped
+#endif
+
+#if MIDI_TEMPO_MAP_SIZE
+  // tempo map
+  tempo_map _tempoMap[MIDI_TEMPO_MAP_SIZE]; ///< the tempo changes in the SMF, in tick order
+  uint8_t   _tempoMapCount;     ///< number of entries in the tempo map
+  uint32_t  _endTick;           ///< absolute tick of the last event in the SMF
+#endif
+
+#if MIDI_SEEK_CHECKPOINTS
+  // fast seek
+  bool      _seeking;           ///< if true events are being chased by a seek
+  midi_chase _chase[16];        ///< chased state for each MIDI channel during a seek
+  seek_checkpoint _cp[MIDI_SEEK_CHECKPOINTS]; ///< the seek index
+  uint8_t   _cpCount;           ///< number of checkpoints in the seek index
+  uint32_t  _cpInterval;        ///< ticks between checkpoints
+  uint32_t  _cpNextTick;        ///< the tick for the next checkpoint to be saved
+#endif
+
+#if MIDI_LOOP_REGION
+  // loop region
+  uint32_t  _loopStart;         ///< absolute tick at the start of the loop region
+  uint32_t  _loopEnd;           ///< absolute tick at the end of the loop region, 0 for no loop
+  uint16_t  _loopCount;         ///< number of wraps to the start of the loop region
+  bool      _loopSaved;         ///< true when the state at the start of the loop region is saved
+  uint32_t  _loopBase;          ///< _tickBase for the saved state
+  uint32_t  _loopTick;          ///< _tickCount for the saved state, one tick before the loop start
+  uint32_t  _loopUsPerQN;       ///< tempo for the saved state in microseconds per quarter note
+  uint8_t   _loopTimeSignature[2]; ///< time signature for the saved state
+#endif
+};
+
+/**
+ * Default handler for MD_MIDIFilePlayer
+ *
+ * A handler class for MD_MIDIFilePlayer may inherit from this class and only
+ * define the methods it needs. The methods are not virtual, the player calls the 
+ * handler class methods directly.
+ */
+struct MD_MFHandler
+{
+  inline void midi(midi_event *) {}         ///< process a MIDI event
+  inline void sysex(sysex_event *) {}       ///< process a SYSEX event
+  inline void meta(const meta_event *) {}   ///< process a META event
+};
+
+/**
+ * Chain of transform stages for MD_MIDIFilePlayer
+ *
+ * Each stage is a class with a method
+ *
+ *     inline bool midi(midi_event *pev)
+ *
+ * that changes the MIDI event in place and returns false if the event should be 
+ * dropped. The stages are run in the order given and stop at the first stage that 
+ * drops the event. As the chain is fixed when it is compiled, each stage is inlined
+ * into the player MIDI callback and an empty chain, MD_MFTransform<>, compiles to 
+ * nothing.
+ *
+ * The first stage is the member stage and the rest of the chain is the member next,
+ * so the parameters of the stages are set with, for example, 
+ * \code
+ *   player.transform().stage.semitones = 2;       // first stage
+ *   player.transform().next.stage.scale = 96;     // second stage
+ * \endcode
+ *
+ * \tparam S the classes for the stages, in order.
+ */
+template <class... S> struct MD_MFTransform;
+
+/**
+ * Empty chain of transform stages, the end of every chain
+ */
+template <> struct MD_MFTransform<>
+{
+  static const bool active = false; ///< there are no stages in the chain
+
+  inline bool midi(midi_event *) { return(true); }  ///< pass the event on unchanged
+};
+
+/**
+ * Chain of transform stages with at least one stage, see MD_MFTransform
+ *
+ * \tparam F the class for the first stage.
+ * \tparam R the classes for the rest of the stages.
+ */
+template <class F, class... R> struct MD_MFTransform<F, R...>
+{
+  static const bool active = true;  ///< there are stages in the chain
+
+  F stage;                    ///< the first stage
+  MD_MFTransform<R...> next;  ///< the rest of the stages
+
+  inline bool midi(midi_event *pev) { return(stage.midi(pev) && next.midi(pev)); } ///< run the event through all the stages
+};
+
+/**
+ * Transform stage to transpose notes
+ *
+ * Moves Note Off, Note On and Polyphonic Key Pressure events up or down by a number
+ * of semitones. Events moved outside the range of MIDI notes are dropped. Only the 
+ * channels set in the channel mask are changed, so the drum channel can be left out.
+ *
+ * If the transposition changes while notes are sounding their Note Off will be 
+ * moved to a different note, so change it between songs or after silenceActiveNotes().
+ */
+struct MD_MFTranspose
+{
+  int8_t semitones;   ///< the number of semitones to move the notes, negative is down
+  uint16_t channels;  ///< bit mask of the channels changed, bit 0 for channel 1
+
+  /**
+   * Class Constructor
+   *
+   * \param n    the number of semitones.
+   * \param mask the channel mask, default all channels.
+   */
+  MD_MFTranspose(int8_t n = 0, uint16_t mask = 0xffff) : semitones(n), channels(mask) {}
+
+  inline bool midi(midi_event *pev) ///< transpose the note in the event
+  {
+    if ((pev->data[0] < 0xb0) && (channels & (1 << pev->channel)))   // note off, note on and key pressure
+    {
+      int16_t note = pev->data[1] + semitones;
+
+      if ((note < 0) || (note > 127))
+        return(false);
+      pev->data[1] = note;
+    }
+    return(true);
+  }
+};
+
+/**
+ * Transform stage to scale note velocity
+ *
+ * The velocity of Note On events is multiplied by scale/128, so 128 leaves it 
+ * unchanged, and limited to [1..127] so a Note On is never made into a Note Off.
+ */
+struct MD_MFVelocity
+{
+  uint8_t scale;      ///< velocity multiplier, 128 for no change
+
+  /**
+   * Class Constructor
+   *
+   * \param s the velocity multiplier, default no change.
+   */
+  MD_MFVelocity(uint8_t s = 128) : scale(s) {}
+
+  inline bool midi(midi_event *pev) ///< scale the velocity in the event
+  {
+    if ((pev->data[0] == 0x90) && (pev->data[2] != 0))
+    {
+      uint16_t v = ((uint16_t)pev->data[2] * scale) >> 7;
+
+      pev->data[2] = (v == 0 ? 1 : (v > 127 ? 127 : v));
+    }
+    return(true);
+  }
+};
+
+/**
+ * Transform stage to remap MIDI channels
+ *
+ * Each channel [0..15] is replaced by the channel in the map. A channel mapped to
+ * a value above 15 is dropped, so a channel can also be muted.
+ */
+struct MD_MFChannelMap
+{
+  uint8_t map[16];    ///< the new channel for each channel, above 15 to drop the channel 
+
+  /**
+   * Class Constructor
+   *
+   * The map is set to leave all the channels unchanged.
+   */
+  MD_MFChannelMap(void) { for (uint8_t i = 0; i < 16; i++) map[i] = i; }
+
+  inline bool midi(midi_event *pev) ///< remap the channel of the event
+  {
+    uint8_t c = map[pev->channel];
+
+    if (c > 15)
+      return(false);
+    pev->channel = c;
+    return(true);
+  }
+};
+
+/**
+ * SMF player with a handler object
+ *
+ * The handler object of class H is held in the player and is passed each event 
+ * through its midi(), sysex() and meta() methods, so each player instance can have
+ * its own output state without global variables. The handler methods are called 
+ * from one small function for each event type, into which the compiler can inline 
+ * the handler, so there is a single indirect call for each event.
+ *
+ * MIDI events are first passed through the transform chain T (see MD_MFTransform), 
+ * which is inlined in the same function. The chain changes the event in place, 
+ * without a copy, and any events it drops are not passed to the handler. The
+ * status and channel are put back afterwards as the track uses them for running 
+ * status.
+ *
+ * The handler methods are set up when the player is created and should not be 
+ * replaced by the MD_MIDIFile set*Handler() methods.
+ *
+ * \code
+ *   MD_MIDIFilePlayer<MyHandler, MD_MFTransform<MD_MFTranspose, MD_MFChannelMap>> player;
+ * \endcode
+ *
+ * \tparam H the handler class, with methods as in MD_MFHandler.
+ * \tparam T the transform chain for the MIDI events, default none.
+ */
+template <class H, class T = MD_MFTransform<> >
+class MD_MIDIFilePlayer : public MD_MIDIFile
+{
+public:
+  /**
+   * Class Constructor
+   *
+   * Instantiate a new player with a default constructed handler.
+   *
+   * \return No return data.
+   */
+  MD_MIDIFilePlayer(void) { setHandlers(); }
+
+  /**
+   * Class Constructor
+   *
+   * Instantiate a new player with a copy of the handler.
+   *
+   * \param h the handler object to copy.
+   * \return No return data.
+   */
+  MD_MIDIFilePlayer(const H &h) : _handler(h) { setHandlers(); }
+
+  /**
+   * Class Constructor
+   *
+   * Instantiate a new player with a copy of the handler and the transform chain.
+   *
+   * \param h the handler object to copy.
+   * \param t the transform chain to copy.
+   * \return No return data.
+   */
+  MD_MIDIFilePlayer(const H &h, const T &t) : _handler(h), _transform(t) { setHandlers(); }
+
+  /**
+   * Get the handler object
+   *
+   * \return reference to the handler object held in this player.
+   */
+  inline H &handler(void) { return(_handler); }
+
+  /**
+   * Get the transform chain
+   *
+   * \return reference to the transform chain held in this player.
+   */
+  inline T &transform(void) { return(_transform); }
+
+protected:
+  H _handler;   ///< the handler object for this player
+  T _transform; ///< the transform chain for the MIDI events
+
+  static void midiCB(midi_event *pev, void *ctx)    ///< MIDI callback
+  {
+    MD_MIDIFilePlayer *p = static_cast<MD_MIDIFilePlayer *>(ctx);
+    uint8_t status = pev->data[0];  // running status for the track is kept in the event
+    uint8_t channel = pev->channel;
+
+    if (p->_transform.midi(pev))
+      p->_handler.midi(pev);
+
+    if (T::active)    // put back the running status if the chain changed it
+    {
+      pev->data[0] = status;
+      pev->channel = channel;
+    }
+  }
+  static void sysexCB(sysex_event *pev, void *ctx) { static_cast<H *>(ctx)->sysex(pev); }        ///< SYSEX callback
+  static void metaCB(const meta_event *pev, void *ctx) { static_cast<H *>(ctx)->meta(pev); }     ///< META callback
+
+  void setHandlers(void)  ///< point the callbacks at the handler object
+  {
+    setMidiHandler(midiCB, this);
+    setSysexHandler(sysexCB, &_handler);
+    setMetaHandler(metaCB, &_handler);
+  }
+};
+
+#if MIDI_MULTI_SONGS
+/**
+ * Engine to play more than one SMF at the same time
+ *
+ * Each song is held in a MD_MIDIFile object supplied by the user code and added 
+ * to the engine with addSong(). The MD_MIDIFile methods for each song are used to 
+ * load the SMF and to set its tempo, looping and pause state. The engine takes over
+ * the callbacks for all the songs and passes all the events, tagged with the song 
+ * number, to one set of callbacks.
+ *
+ * The events are merged in time order from one scheduler in getNextEvent(). The 
+ * ticks due for each song are counted from its own clock, then the song with the 
+ * event that has been due the longest is processed up to that event, and so on. 
+ * The reads from the SD card are made in the same order as the events, from the
+ * one main loop call. Each song is still a separate file with its own file handle.
+ *
+ * When MIDI_TRACK_ARENA is not 0 the tracks and read-ahead buffers of all the songs
+ * can be taken from one arena set with setArena(), with each SMF loaded by load() 
+ * using only the memory it needs.
+ */
+class MD_MIDIMulti
+{
+public:
+  /**
+   * Class Constructor
+   *
+   * Instantiate a new engine with no songs.
+   *
+   * \return No return data.
+   */
+  MD_MIDIMulti(void);
+
+  /**
+   * Add a song to the engine
+   *
+   * The MD_MIDIFile object must already be initialized with begin(). The callbacks
+   * of the object are replaced by the engine.
+   *
+   * \param pmf pointer to the MD_MIDIFile object for the song.
+   * \return the song number [0..MIDI_MULTI_SONGS-1], or -1 if there is no room.
+   */
+  int addSong(MD_MIDIFile *pmf);
+
+  /**
+   * Get the number of songs
+   *
+   * \return the number of songs added to the engine.
+   */
+  inline uint8_t getSongCount(void) { return(_songCount); }
+
+  /**
+   * Get the MD_MIDIFile object for a song
+   *
+   * The object is used to load the SMF and control the playback of the song.
+   *
+   * \param song the song number returned by addSong().
+   * \return pointer to the MD_MIDIFile object, nullptr if the song number is invalid.
+   */
+  inline MD_MIDIFile *getSong(uint8_t song) { return(song < _songCount ? _song[song].mf : nullptr); }
+
+#if MIDI_TRACK_ARENA
+  /**
+   * Set the memory arena shared by the songs
+   *
+   * The tracks and read-ahead buffers for the songs loaded with load() are carved 
+   * from this memory, so a song with a small SMF leaves more room for the other 
+   * songs. The memory belongs to the user code and must persist while the songs are 
+   * loaded. All the songs are closed. The songs must be added before the arena is set.
+   *
+   * \sa load(), MD_MIDIFile::getArenaSize()
+   *
+   * \param mem  pointer to the memory for the arena.
+   * \param size the size of the arena in bytes.
+   * \return No return data.
+   */
+  void setArena(void *mem, uint32_t size);
+
+  /**
+   * Load the SMF for a song from the shared arena
+   *
+   * The song is closed and the SMF is loaded into the largest space left in the 
+   * arena set with setArena(). Only the memory for the tracks of the SMF is kept, 
+   * the rest is left for the other songs. If the space is too small the load fails
+   * with E_TRACKS. Songs that use the shared arena should only be loaded with this 
+   * method.
+   *
+   * \param song  the song number returned by addSong().
+   * \param fname pointer to a user buffered string with the file name.
+   * \return Error code with one of the MD_MIDIFile::E_* error values.
+   */
+  int load(uint8_t song, const char *fname);
+#endif
+
+  /**
+   * Process the events due for all the songs
+   *
+   * Call this frequently from the main loop, in place of MD_MIDIFile::getNextEvent()
+   * for each of the songs. Songs that have reached the end of the SMF are checked
+   * so that looping songs restart.
+   *
+   * \return true if any song had events processed.
+   */
+  bool getNextEvent(void);
+
+  /**
+   * Get the time until the next event is due
+   *
+   * \sa MD_MIDIFile::getMicrosToNextEvent()
+   *
+   * \return the shortest time for all the songs in microseconds, 0xffffffff if none are playing.
+   */
+  uint32_t getMicrosToNextEvent(void);
+
+  /**
+   * Check if all the songs have finished
+   *
+   * \return true if all the songs are at the end of the SMF and not looping.
+   */
+  bool isEOF(void);
+
+  /**
+   * Pause or unpause all the songs
    *
-   * The DUMP_DATA macro define must be set to 1 to enable this method.
+   * \param bMode true to pause, false to unpause.
+   * \return No return data.
+   */
+  void pause(bool bMode);
+
+  /**
+   * Restart all the songs together
    *
    * \return No return data.
    */
-  void dump(void);
-  /** @} */
+  void restart(void);
 
-protected:
   /**
-   * Process the event from the physical file
+   * Set the MIDI callback function
    *
-   * Read and process the next event for this track from the file.
+   * As MD_MIDIFile::setMidiHandler() but the callback is also passed the song number.
    *
-   * \param mf  pointer tho the MIDIFile object with the file to process.
+   * \param mh  the address of the function to be called from the library.
+   * \param ctx the context pointer passed to the callback.
+   * \return No return data
+   */
+  inline void setMidiHandler(void (*mh)(uint8_t song, midi_event *pev, void *ctx), void *ctx = nullptr) { _midiHandler = mh; _midiCtx = ctx; };
+
+  /**
+   * Set the SYSEX callback function
    *
-   * \return No return data.
+   * As MD_MIDIFile::setSysexHandler() but the callback is also passed the song number.
+   *
+   * \param sh  the address of the function to be called from the library.
+   * \param ctx the context pointer passed to the callback.
+   * \return No return data
    */
-  void  parseEvent(MD_MIDIFile *mf);
+  inline void setSysexHandler(void (*sh)(uint8_t song, sysex_event *pev, void *ctx), void *ctx = nullptr) { _sysexHandler = sh; _sysexCtx = ctx; };
 
   /**
-   * Initialize the class all in one place
+   * Set the META callback function
    *
-   * \return No return data.
+   * As MD_MIDIFile::setMetaHandler() but the callback is also passed the song number.
+   *
+   * \param mh  the address of the function to be called from the library.
+   * \param ctx the context pointer passed to the callback.
+   * \return No return data
    */
-  void  reset(void);
+  inline void setMetaHandler(void (*mh)(uint8_t song, const meta_event *pev, void *ctx), void *ctx = nullptr) { _metaHandler = mh; _metaCtx = ctx; };
 
-  uint8_t   _trackId;       ///< the id for this track
-  uint32_t  _length;        ///< length of track in bytes
-  uint32_t  _startOffset;   ///< start of the track in bytes from start of file
-  uint32_t  _currOffset;    ///< offset from start of the track for the next read of SD data
-  bool      _endOfTrack;    ///< true when we have reached end of track or we have encountered an undefined event
-  uint32_t  _elapsedTicks;  ///< the total number of elapsed ticks since last event
-  midi_event  _mev;         ///< data for MIDI callback function - persists between calls for run-on messages
+protected:
+  /**
+   * Song definition structure
+   */
+  typedef struct
+  {
+    MD_MIDIMulti *engine; ///< the engine the song belongs to
+    MD_MIDIFile *mf;      ///< the song
+    uint8_t id;           ///< the song number
+#if MIDI_TRACK_ARENA
+    uint32_t arenaStart;  ///< offset of the memory for the song in the shared arena
+    uint32_t arenaLen;    ///< bytes of the shared arena used by the song, 0 for none
+#endif
+  } multi_song;
+
+  multi_song _song[MIDI_MULTI_SONGS]; ///< the songs
+  uint8_t   _songCount;               ///< number of songs added
+#if MIDI_TRACK_ARENA
+  uint8_t   *_arena;                  ///< the memory shared by the songs
+  uint32_t  _arenaSize;               ///< the size of the shared arena in bytes
+#endif
+
+  void (*_midiHandler)(uint8_t song, midi_event *pev, void *ctx);   ///< callback into user code to process MIDI stream
+  void (*_sysexHandler)(uint8_t song, sysex_event *pev, void *ctx); ///< callback into user code to process SYSEX stream
+  void (*_metaHandler)(uint8_t song, const meta_event *pev, void *ctx); ///< callback into user code to process META stream
+  void *_midiCtx;     ///< user context for the MIDI callback
+  void *_sysexCtx;    ///< user context for the SYSEX callback
+  void *_metaCtx;     ///< user context for the META callback
+
+  static void midiCB(midi_event *pev, void *ctx);         ///< MIDI callback for each song
+  static void sysexCB(sysex_event *pev, void *ctx);       ///< SYSEX callback for each song
+  static void metaCB(const meta_event *pev, void *ctx);   ///< META callback for each song
 };
+#endif
 
+#if MIDI_PLAYLIST_SIZE
 /**
- * Core object for the MD_MIDIFile library
+ * Player for a list of SMF played one after the other with no gap
  *
- * This is the class to handle a MIDI file, including all tracks, and is the only one 
- * available to user programs.
+ * The playlist uses two MD_MIDIFile objects supplied by the user code. While one 
+ * plays the current SMF, the next SMF in the list is loaded into the other and the
+ * first block of each track is read, in small steps when there is time to spare 
+ * before the next event. At the end of the current SMF the playlist changes to the 
+ * next one, with its time line starting from the time the last event of the 
+ * current SMF was due, so there is no gap or timing jump between the songs.
+ *
+ * The MD_MIDIFile objects must be initialized with begin(), and should have the same
+ * callbacks and folder set, before they are given to the playlist. The playlist is
+ * not intended for use with queue mode.
  */
-class MD_MIDIFile 
+class MD_MIDIPlaylist
 {
 public:
-  friend class MD_MFTrack;
-
-  /** Error codes as constants
-   */
-  static const int E_OK = 0;       ///< No errors
-  static const int E_NO_FILE = 1;  ///< Blank file name
-  static const int E_NO_OPEN = 2;  ///< Can't open file specified
-  static const int E_NOT_MIDI = 3; ///< File is not MIDI format
-  static const int E_HEADER = 4;   ///< MIDI header size incorrect
-  static const int E_FORMAT = 5;   ///< File format type not 0 or 1
-  static const int E_FORMAT0 = 6;  ///< File format 0 but more than 1 track
-  static const int E_TRACKS = 7;   ///< More than MIDI_MAX_TRACKS required
-
-  // Errors >= 10
-  static const int E_CHUNK_ID = 0;   ///< error >= 10; n0 Track n track chunk not found
-  static const int E_CHUNK_EOF = 1;  ///< error >= 10; n1 Track n chunk size past end of file
-
   /**
    * Class Constructor
    *
-   * Instantiate a new instance of the class.
-   *
-   * \return No return data.
-   */
-  MD_MIDIFile(void);
-  
-  /** 
-   * Class Destructor
-   *
-   * Released allocated memory and does the necessary to clean up once the object is
-   * no longer required.
+   * Instantiate a new empty playlist.
    *
    * \return No return data.
    */
-  ~MD_MIDIFile(void);
- 
-  /** 
-   * Initialize the object
+  MD_MIDIPlaylist(void);
+
+  /**
+   * Initialize the playlist
    *
-   * Initialize the object data. This needs to be called during setup() to initialize new 
-   * data for the class that cannot be done during the object creation.
-   * 
-   * The main purpose if to pass in a pointer to the SDFat object will be used for file 
-   * operations on the SMF.  A copy of this pointer is retained by the library for the life 
-   * of the MD_MIDIFile object. The SDFs object should be initialized before calling this 
-   * method.
+   * Set the two MD_MIDIFile objects that are used in turn to play the SMF. Any 
+   * SMF already loaded in the objects are closed.
    *
-   * \param psd Pointer to the SDFat object.
+   * \param pmf0 pointer to the first MD_MIDIFile object.
+   * \param pmf1 pointer to the second MD_MIDIFile object.
    * \return No return data.
    */
-  void begin(SDFAT *psd);
+  void begin(MD_MIDIFile *pmf0, MD_MIDIFile *pmf1);
 
-  //--------------------------------------------------------------
-  /** \name Methods for MIDI time base
-   * @{
-   */
-  /** 
-   * Get the internally calculated tick time
+  /**
+   * Add a SMF to the end of the playlist
    *
-   * Changes to tempo, TPQN and time signature all affect the tick time. This returns the
-   * number of microseconds for each tick.
-   * 
-   * \return the tick time in microseconds
-   */
-  inline uint32_t getTickTime(void) { return (_tickTime); }
-
-  /** 
-   * Get the overall tempo
+   * Only the pointer to the file name is kept, so the name must stay valid until 
+   * the SMF has been loaded.
    *
-   * Retrieve the overall tempo for the MIDI playback. Tempo is set by the SMF and the
-   * setTempo() method. 
-   * 
-   * \return the tempo.
+   * \param fname the SMF file name.
+   * \return false if the playlist is full.
    */
-  inline uint16_t getTempo(void) { return(_tempo); }
+  bool add(const char *fname);
 
-  /** 
-   * Get the tempo adjust offset
+  /**
+   * Remove all the SMF waiting in the playlist
    *
-   * Retrieve the tempo adjustment offset for the MIDI playback. Tempo adjust is set by 
-   * the setTempoAdjust() method. 
-   * 
-   * \return the tempo.
-   */
-  inline int16_t getTempoAdjust(void) { return(_tempoDelta); }
-
-  /** 
-   * Get the number of ticks per quarter note
+   * The current SMF keeps playing. A SMF that is already loaded to play next is 
+   * also removed.
    *
-   * Retrieve the number of ticks per quarter note for the MIDI playback. TPQN is set by 
-   * the SMF and the setTicksPerQuarterNote() method. 
-   * 
-   * \return the number of TPQN.
+   * \return No return data.
    */
-  inline uint16_t getTicksPerQuarterNote(void) { return(_ticksPerQuarterNote); }
+  void clear(void);
 
-  /** 
-   * Get the Time Signature
+  /**
+   * Get the number of SMF waiting to be played
    *
-   * Retrieve the time signature for the MIDI playback. Time Signature is set by the SMF 
-   * and the setTimeSignature() method. 
-   * 
-   * \return the time signature (numerator in the top byte and the denominator in the lower byte).
+   * \return the number of SMF in the playlist after the current one.
    */
-  inline uint16_t getTimeSignature(void) { return((_timeSignature[0]<<8) + _timeSignature[1]); }
+  inline uint8_t getCount(void) { return(_count + (_primeTrack != PRIME_NONE ? 1 : 0)); }
 
-  /** 
-   * Set the internal tick time
+  /**
+   * Get the SMF that is playing
    *
-   * Set the number of microseconds per quarter note directly. Normally this is calculated 
-   * from the tempo and ticks per quarter note.
+   * The object may be used to change the tempo or looping of the current SMF, or to
+   * get its file name.
    *
-   * \param m the number of microseconds per quarter note.
-   * \return No return data.
+   * \return pointer to the MD_MIDIFile object playing, nullptr if none.
    */
-  void setMicrosecondPerQuarterNote(uint32_t m);
+  inline MD_MIDIFile *getSong(void) { return(_playing ? _mf[_cur] : nullptr); }
 
-  /** 
-   * Set the overall tempo
+  /**
+   * Get the last load error
    *
-   * Set the overall tempo for the MIDI playback. Tempo is set by the SMF but can be 
-   * changed through this method. 
-   * 
-   * The default MIDI tempo if not specified is 120 beats/minute.
+   * A SMF that cannot be loaded is skipped and the error from load() is saved.
    *
-   * \param t the tempo required.
-   * \return No return data.
+   * \return the error code from the last load(), E_OK if there were no errors.
    */
-  void setTempo(uint16_t t);
+  inline int getLoadError(void) { return(_loadError); }
 
-  /** 
-   * Set the tempo adjustment offset 
+  /**
+   * Set the time needed before the next event to preload
    *
-   * Set the tempo offset for all tempo settings. This is useful to speed up
-   * a whole SMF by a set amount for the MIDI playback. The offset from SMF
-   * specified may be 
-   * The Tempo set by the SMF can be increased changed through this method. 
-   * 
-   * The default tempo offset if not specified is 0 beats/minute.
+   * Each step of the preload is only done when the current SMF has no events due for
+   * at least this time. The default is 5 ms.
    *
-   * \param t the tempo adjustment required.
+   * \param us the time in microseconds.
    * \return No return data.
    */
-  void setTempoAdjust(int16_t t);
+  inline void setPreloadTime(uint32_t us) { _preloadTime = us; }
 
-  /** 
-   * Set number of ticks per quarter note (TPQN)
-   *
-   * Set the overall ticks per quarter note tempo for the MIDI playback. TPQN is set by the SMF 
-   * but can be changed through this method. 
+  /**
+   * Play the playlist
    *
-   * The default if not specified is 48 TPQN.
+   * This is called as often as possible from the main loop, as for 
+   * MD_MIDIFile::getNextEvent(). The next SMF is also preloaded and started 
+   * from here.
    *
-   * \param ticks the number of ticks per quarter note.
-   * \return No return data.
+   * \return true if a tick has passed in the SMF playing.
    */
-  void setTicksPerQuarterNote(uint16_t ticks);
+  bool getNextEvent(void);
 
-  /** 
-   * Set Time Signature for the SMF
+  /**
+   * Get the time until the next event is due
    *
-   * Set the time signature for the MIDI playback. Time signature is specified in 2 parts defined
-   * by the numerator and the denominator of the normal notation.
-   * 
-   * The default if not specified is 4/4.
+   * \sa MD_MIDIFile::getMicrosToNextEvent()
    *
-   * \param n numerator of the time signature.
-   * \param d denominator of the time signature.
-   * \return No return data.
+   * \return the time in microseconds, 0 if there is work to do now, 0xffffffff if the playlist has ended.
    */
-  void setTimeSignature(uint8_t n, uint8_t d);
-  /** @} */
+  uint32_t getMicrosToNextEvent(void);
 
-  //--------------------------------------------------------------
-  /** \name Methods for SMF file handling
-   * @{
-   */
-  /** 
-   * Close the SMF
-   *
-   * Before a new SMF is processed the current SMF must be closed. All tracks are stopped and 
-   * the file name is reset. A new file can then be started using load().
+  /**
+   * Check if the playlist has ended
    *
-   * \return No return data.
+   * \return true if the last SMF has finished and there are none waiting.
    */
-  void close(void);
+  bool isEOF(void);
 
   /**
-   * Check if SMF is and end of file
+   * Pause or un-pause the SMF playing
    *
-   * An SMF is at EOF when there is nothing left to play (ie, all tracks have finished).
-   * The method will return EOF true when this condition is reached.
+   * \sa MD_MIDIFile::pause()
    *
-   * \return true if the SMF is at EOF, false otherwise.
+   * \param bMode Set true to pause, false to continue.
+   * \return No return data.
    */
-  bool isEOF(void);
+  void pause(bool bMode);
 
-  /** 
-   * Get the name of the SMF
+protected:
+  static const uint8_t PRIME_NONE = 0xff; ///< _primeTrack value when there is no SMF loaded to play next
+#if MIDI_TEMPO_MAP_SIZE
+  static const uint16_t SCAN_EVENTS = 64; ///< events scanned for the tempo map in each preload step
+#endif
+
+  bool    preloadStep(void);  ///< do the next step of loading the next SMF, true if there is more to do
+  void    swap(void);         ///< start playing the SMF that has been loaded
+
+  MD_MIDIFile *_mf[2];        ///< the two SMF objects used in turn
+  uint8_t    _cur;            ///< index of the object playing
+  bool       _playing;        ///< true when _mf[_cur] has a SMF to play
+  bool       _ready;          ///< true when the next SMF is ready to play
+  uint8_t    _primeTrack;     ///< the next track to read the first block for, or PRIME_NONE
+#if MIDI_TEMPO_MAP_SIZE
+  uint8_t    _scanTrack;      ///< the next track to scan for the tempo map
+#endif
+  uint32_t   _preloadTime;    ///< time before the next event needed for each preload step
+  int        _loadError;      ///< error code from the last load()
+
+  const char *_list[MIDI_PLAYLIST_SIZE]; ///< the SMF names waiting, as a ring buffer
+  uint8_t    _head;           ///< index of the next name in _list
+  uint8_t    _count;          ///< number of names in _list
+};
+#endif
+
+#if MIDI_OUT_BUFFER_SIZE
+/**
+ * Serial output for MIDI events with running status
+ *
+ * The MIDI and SYSEX events from one or more MD_MIDIFile objects are encoded to MIDI 
+ * bytes, leaving out repeated status bytes, and written to a Print object (eg, a 
+ * HardwareSerial port) through a transmit buffer. The port must support 
+ * availableForWrite() so the bytes are only written when there is room for them.
+ */
+class MD_MIDIOut
+{
+public:
+  /**
+   * Class Constructor
    *
-   * Gets a pointer to the buffer containing the name of the SMF.
+   * Instantiate a new output with an empty buffer.
    *
-   * This is a pointer to a user defined buffer passed to the load()
-   * method when the file is opened. The scope and persistence of this
-   * buffer depends on what the user code does, so the pointer returned
-   * *may* be invalid if the pointer references a buffer that has become 
-   * out of scope.
-   * 
-   * \return character pointer to the name string
+   * \return No return data.
    */
-  const char* getFilename(void) { return(_fileName); };
+  MD_MIDIOut(void);
 
-  /** 
-   * Set the name of the SMF
-   *
-   * THIS METHOD IS DEPRECATED.
-   * Use play() with the file name.
-   *
-   * Stores the pointer reference to the supplied name.
-   * The file name buffer is located in user code and must persist
-   * at least until the load() method is invoked.
-   *
-   * The file specified can include path or just a file name. If not
-   * fully specified the file is located in the current working folder,
-   * which is the root folder by default. For files not in the root 
-   * folder, change the current folder using the setFileFolder() method.
+  /**
+   * Initialize the output
    *
-   * \sa setFileFolder(), load()
+   * Set the port the bytes are written to. The buffer is emptied and the next 
+   * message is sent with its status byte.
    *
-   * \param aname pointer to a string with the file name.
+   * \param out pointer to the Print object to write to.
    * \return No return data.
    */
-  void setFilename(const char* aname) { _fileName = aname; }
+  void begin(Print *out);
 
   /**
-   * Set the current folder for the SMF
-   *
-   * Sets the current working folder to the specified path.
-   * All subsequent simple (ie, not fully qualified) file names passed 
-   * to setFilename() are referenced to this folder location.
-   *
-   * The default file location is the root folder denoted by "/"
+   * Send the events from a SMF to this output
    *
-   * \sa setFilename
+   * Sets the MIDI and SYSEX callbacks of the MD_MIDIFile object, and the clock 
+   * callback when MIDI_CLOCK_OUT is enabled, to pass the events to this output.
    *
-   * \param apath pointer to a string with the path name.
+   * \param pmf pointer to the MD_MIDIFile object.
    * \return No return data.
    */
-  void setFileFolder(const char* apath) { if (apath != nullptr && _sd->chdir(apath)) _sd->chvol(); }
+  void attach(MD_MIDIFile *pmf);
 
-  /** 
-   * Load the named SMF
+  /**
+   * Send a MIDI channel message
    *
-   * Before it can be processed, a file must be opened, loaded and the
-   * MIDI playback initialized by invoking this method.
+   * The message is put into the buffer, without the status byte if it is the same
+   * as the last status sent.
    *
-   * The file name specified can include path or just a file name.
-   * If not fully specified the file is located in the current working
-   * folder, which is the root folder by default. For files not in the 
-   * root folder, change the current folder using the setFileFolder() 
-   * method.
+   * \param pev pointer to the MIDI event.
+   * \return false if there was no room for the message in the buffer.
+   */
+  bool midi(const midi_event *pev);
+
+  /**
+   * Send a SYSEX message
    *
-   * The file name buffer is located in user code and must persist during 
-   * this call. 
+   * The data is put into the buffer as it is. Running status is cancelled, so the
+   * next MIDI message is sent with its status byte. SYSEX events too long to be 
+   * held in the sysex_event are not sent.
    *
-   * \sa setFileFolder()
+   * \param pev pointer to the SYSEX event.
+   * \return false if the message was not sent.
+   */
+  bool sysex(const sysex_event *pev);
+
+  /**
+   * Send a system message
    *
-   * \param fname pointer to a user buffered string with the file name.
-   * \return Error code with one of the E_* error values
+   * System common messages (0xF1 to 0xF7) are put into the buffer and cancel running 
+   * status. System real time messages (0xF8 to 0xFF) do not change running status 
+   * and are written straight to the port if it has room, ahead of the bytes waiting 
+   * in the buffer, so MIDI clocks are not delayed by the messages in the buffer.
+   *
+   * \param data pointer to the message bytes.
+   * \param size the number of bytes.
+   * \return false if there was no room for the message.
    */
-  int load(const char *fname);
+  bool system(const uint8_t *data, uint8_t size);
 
-  /** @} */
+  /**
+   * Write the buffered bytes to the port
+   *
+   * Writes as many bytes from the buffer as the port can take without waiting. This 
+   * is also done each time a message is added, but should be called from loop() so 
+   * the buffer keeps moving between events.
+   *
+   * \return the number of bytes still waiting in the buffer.
+   */
+  uint16_t transmit(void);
 
-  //--------------------------------------------------------------
-  /** \name Methods for SMF header data
-   * @{
+  /**
+   * Send the status byte with the next message
+   *
+   * Some receivers lose running status when they are connected or reset. Calling 
+   * this method (eg, at the start of each SMF) makes sure the next message is sent 
+   * in full.
+   *
+   * \return No return data.
    */
-  /** 
-   * Get the format of the SMF
+  inline void resetRunningStatus(void) { _runStatus = 0; }
+
+  /**
+   * Send Note Off as Note On with velocity 0
    *
-   *  The SMF header specifies which of three SMF formats applies to the file
-   * - Type 0 file contains the entire performance, merged onto a single track
-   * - Type 1 files may contain any number of tracks, running synchronously.
-   * - Type 2 files may contain any number of tracks, running asynchronously. This type
-   * is rarely used and not supported by this library..
+   * The two are the same to receivers, but sending only Note On allows running status
+   * to be used for all the notes on a channel. The release velocity of Note Off 
+   * is lost. The default is off.
    *
-   * The load() method must be invoked to read the SMF header information.
-   * 
-   * \return number [0..2] representing the format.
+   * \param bMode true to send Note Off as Note On with velocity 0.
+   * \return No return data.
    */
-  inline uint8_t getFormat(void) { return(_format); };
+  inline void setNoteOffAsNoteOn(bool bMode) { _noteOffAsOn = bMode; }
 
-  /** 
-   * Get the number of tracks in the file
+  /**
+   * Get the number of bytes waiting in the buffer
    *
-   * The SMF header specifies the number of MIDI tracks in the file. This must be
-   * between [0..MIDI_MAX_TRACKS-1] for the SMF to be successfully processed.
-   * 
-   * The load() method must be invoked to read the SMF header information.
-   * 
-   * \return the number of tracks in the file
+   * \return the number of bytes in the buffer.
    */
-  inline uint8_t getTrackCount(void) { return (_trackCount); };
-  /** @} */
+  inline uint16_t getBufferCount(void) { return(_count); }
 
-  //--------------------------------------------------------------
-  /** \name Methods for MIDI playback control
-   * @{
+  /**
+   * Get the largest number of bytes waiting in the buffer
+   *
+   * The peak since begin() or resetStats(), which shows how close the buffer has 
+   * come to being full.
+   *
+   * \return the peak number of bytes in the buffer.
    */
-  /** 
-   * Set the looping mode for SMF playback
+  inline uint16_t getBufferPeak(void) { return(_peak); }
+
+  /**
+   * Get the size of the buffer
    *
-   * A SMF can be set to automatically loop to the start once it has completed.
-   * For SMF file type 0 (1 track only) the single track is looped. 
-   * For file type 1, all tracks except track 0 (the first) is looped. Track 0 contains
-   * global setup information that does not need to be repeated and would delay the restart
-   * of the looped tracks.
-   * 
-   * \param bMode Set true to enable mode, false to disable.
-   * \return No return data.
+   * \return the size of the buffer in bytes, MIDI_OUT_BUFFER_SIZE.
    */
-  inline void looping(bool bMode) { _looping = bMode; }
+  inline uint16_t getBufferSize(void) { return(MIDI_OUT_BUFFER_SIZE); }
 
   /**
-   * Get the current looping mode
+   * Get the number of messages thrown away
    *
-   * Returns the currently set looping mode.
+   * The number of messages with no room in the buffer since begin() or resetStats().
    *
-   * \sa looping()
+   * \return the number of messages not sent.
+   */
+  inline uint32_t getDropCount(void) { return(_drops); }
+
+  /**
+   * Get the number of status bytes saved
    *
-   * \return Current looping mode.
+   * The number of status bytes left out by running status since begin() or 
+   * resetStats().
+   *
+   * \return the number of bytes saved.
    */
-  inline bool isLooping(void) { return(_looping); }
+  inline uint32_t getBytesSaved(void) { return(_saved); }
 
   /**
-   * Pause or un-pause SMF playback
+   * Reset the output statistics
    *
-   * SMF playback can be paused (true) or un-paused (false) using this method. Whilst in pause 
-   * mode, all callbacks are suspended. 
-   * 
-   * Note that this call only stops the library from processing the file and has no effect 
-   * on the playback device. Silencing the MIDI playback device during the pause is the 
-   * responsibility of the user application.
-   * 
-   * \param bMode Set true to enable mode, false to disable.
+   * Resets the buffer peak, the drop count and the bytes saved.
    *
    * \return No return data.
    */
-  void pause(bool bMode);
+  inline void resetStats(void) { _peak = _count; _drops = _saved = 0; }
+
+protected:
+  bool    put(const uint8_t *data, uint16_t size);  ///< copy the bytes into the buffer, all or none
+
+  static void midiCB(midi_event *pev, void *ctx);     ///< MIDI callback for attach()
+  static void sysexCB(sysex_event *pev, void *ctx);   ///< SYSEX callback for attach()
+#if MIDI_CLOCK_OUT
+  static void clockCB(const uint8_t *data, uint8_t size, void *ctx); ///< clock callback for attach()
+#endif
 
+  Print    *_out;             ///< the port written to
+  uint8_t  _buf[MIDI_OUT_BUFFER_SIZE]; ///< the transmit ring buffer
+  uint16_t _head;             ///< index of the next byte to write to the port
+  uint16_t _count;            ///< number of bytes in the buffer
+  uint16_t _peak;             ///< largest _count
+  uint8_t  _runStatus;        ///< the running status, 0 for none
+  bool     _noteOffAsOn;      ///< true to send Note Off as Note On velocity 0
+  uint32_t _drops;            ///< messages thrown away
+  uint32_t _saved;            ///< status bytes left out
+};
+#endif
+
+#if MIDI_CATALOG_NAME_SIZE
+/**
+ * Catalog of the SMF in a folder, held in an index file on the SD card
+ *
+ * Finding the format, tracks and playing time of each SMF on a card means loading 
+ * every file, which takes a long time for a large library. The catalog does this 
+ * once, in build(), and writes a catalog_entry for each SMF in the folder to an 
+ * index file in the same folder. The entries are all the same size, so entry n is 
+ * read directly from the index with no search.
+ *
+ * When build() is run again, only the SMF that are new or have a different size or
+ * modified time are loaded, and the index is only written again if it has changed.
+ * open() uses the index as it is, with no check of the folder.
+ *
+ * The MD_MIDIFile object given to begin() is used to load the SMF and has the 
+ * current folder set by build() and open(), so it should not be playing.
+ */
+class MD_MIDICatalog
+{
+public:
   /**
-   * Get the current pause mode
-   *
-   * Returns the currently set pause mode.
+   * Class Constructor
    *
-   * \sa looping()
+   * Instantiate a new catalog with no index open.
    *
-   * \return Current paused mode.
+   * \return No return data.
    */
-  inline bool isPaused(void) { return(_paused); }
+  MD_MIDICatalog(void);
 
   /**
-   * Force the SMF to be restarted
+   * Initialize the catalog
    *
-   * SMF playback can be reset back to the beginning of all tracks using this method. The method
-   * can be invoked at any time during playback and has immediate effect.
+   * The MD_MIDIFile object must already be initialized with begin().
    *
+   * \param pmf pointer to the MD_MIDIFile object used to load the SMF.
    * \return No return data.
    */
-  void restart(void);
-  /** @} */
+  void begin(MD_MIDIFile *pmf);
 
-  //--------------------------------------------------------------
-  /** \name Methods for data handling
-   * @{
-   */
-  /** 
-   * Read and process the next event from the SMF
+  /**
+   * Build or update the index for a folder
    *
-   * Once a SMF is ready for processing, this method is called as frequently as possible to
-   * process the next MIDI, SYSEX or META from the tracks in the SMF.
-   * 
-   * This method will generate the tick timing from the Arduino microsecond clock.
-   * If an event needs to be processed this function will call processEvents() to do the work.
-   * 
-   * \return true if a 'tick' has passed since the last call.
+   * Lists the folder and makes an entry for each file with a .mid extension, in the
+   * order they are found. The details are copied from the index already in the folder
+   * for SMF that are not new and have not changed, otherwise the SMF is loaded. The new 
+   * index is written to a temporary file that replaces the index once it is complete,
+   * so the old index is kept if there is an error. The index is left open ready for 
+   * getEntry(), and the folder is set as the current folder for the MD_MIDIFile 
+   * object.
+   *
+   * \sa open(), getLoadCount()
+   *
+   * \param folder the path of the folder, eg "/" for the root folder.
+   * \param index  the name of the index file in the folder.
+   * \return false if the folder could not be listed or the index could not be written.
    */
-  boolean getNextEvent(void);
+  bool build(const char *folder, const char *index = "MIDICAT.IDX");
 
- /** 
-   * Read and process the next event from the SMF
+  /**
+   * Open the index for a folder
    *
-   * This method processes the events in the SMF that are due to be processed, given the 
-   * number of ticks that have passed since the last call to the method. No tick timer 
-   * calculations or other checks are performed, so this function is suitable to be called 
-   * from user code that implements timer synchronization with an external MIDI clock.
-   * 
-   * Events in the SMF are processed in sequential order in one of 2 different ways:
-   * - process all events on one track before moving on to the next track (TRACK_PRIORITY)
-   * - process one event from each track and cycling through all tracks round robin fashion 
-   * until no events are left to be processed (EVENT_PRIORITY).
+   * The index in the folder is used as it is, so this is the fastest start when the 
+   * files are known not to have changed. The folder is set as the current folder for 
+   * the MD_MIDIFile object.
    *
-   * The TRACK_PRIORITY define selects which is used. In practice there is little or no
-   * difference between the two methods.
+   * \sa build()
    *
-   * Each MIDI and SYSEX event is passed back to the calling program for processing though the 
-   * callback functions set up by setMidiHandler() and setSysexHandler().
-   * 
-   * \param ticks the number of ticks since the last call to this method.
-   * \return No return data
+   * \param folder the path of the folder, eg "/" for the root folder.
+   * \param index  the name of the index file in the folder.
+   * \return false if there is no index or it was built with a different configuration.
    */
-  void processEvents(uint16_t ticks);
+  bool open(const char *folder, const char *index = "MIDICAT.IDX");
 
- /** 
-   * Set the MIDI callback function
+  /**
+   * Close the index
    *
-   * The callback function is called from the library when a MIDI events read from a track 
-   * needs to be processed.
-   *  
-   * The callback function has one parameter of type midi_event. 
-   * The pointer passed to the callback will be initialized with the event data for the 
-   * callback to process. Once the function returns from the callback the pointer 
-   * may no longer be valid (ie, don't rely on it!).
-   * 
-   * \param mh  the address of the function to be called from the library.
-   * \return No return data
+   * \return No return data.
    */
-  inline void setMidiHandler(void (*mh)(midi_event *pev)) { _midiHandler = mh; };
+  void close(void);
 
-  /** 
-   * Set the SYSEX callback function
+  /**
+   * Get the number of SMF in the catalog
    *
-   * The callback function is called from the library when a SYSEX events read from a track 
-   * needs to be processed.
-   *  
-   * The callback function has one parameter of type sysex_event.
-   * The pointer passed to the callback will be initialized with the event data for the 
-   * callback to process. Once the function returns from the callback the pointer
-   * may no longer be valid (ie, don't rely on it!).
-   * 
-   * \param sh  the address of the function to be called from the library.
-   * \return No return data
+   * \return the number of entries in the index, 0 if it is not open.
    */
-  inline void setSysexHandler(void (*sh)(sysex_event *pev)) { _sysexHandler = sh; };
+  inline uint16_t getCount(void) { return(_count); }
 
-  /** 
-   * Set the META callback function
+  /**
+   * Get the details of a SMF
    *
-   * The callback function is called from the library when a META events read from a track 
-   * needs to be processed.
-   * 
-   * The callback function has one parameter of type meta_event.
-   * The pointer passed to the callback will be initialized with the meta data for the 
-   * callback to process. Once the function returns from the callback the pointer
-   * may no longer be valid (ie, don't rely on it!).
-   * 
-   * \param mh  the address of the function to be called from the library.
-   * \return No return data
+   * The entry is read from the index file.
+   *
+   * \param idx the entry number [0..getCount()-1].
+   * \param pe  pointer to the structure to fill in.
+   * \return false if the entry number is not valid or could not be read.
    */
-  inline void setMetaHandler(void (*mh)(const meta_event *mev)) { _metaHandler = mh; };
-  /** @} */
+  bool getEntry(uint16_t idx, catalog_entry *pe);
 
-  //--------------------------------------------------------------
-  /** \name Methods for debugging
-   * @{
-   */
-  /** 
-   * Dump the SMF header data to the debug stream
+  /**
+   * Get the number of SMF loaded by build()
    *
-   * During debugging, this method provides a formatted dump of data to the debug
-   * output stream.
+   * Once the index has been built this is the number of new or changed SMF.
    *
-   * The DUMP_DATA macro define must be set to 1 to enable this method.
+   * \return the number of SMF loaded by the last build().
    */
-  void dump(void);
-  /** @} */
+  inline uint16_t getLoadCount(void) { return(_loads); }
 
 protected:
-  void    calcTickTime(void); ///< called internally to update the tick time when parameters change
-  void    initialise(void);   ///< initialize class variables all in one place
-  void    synchTracks(void);  ///< synchronize the start of all tracks
-  uint16_t tickClock(void);   ///< work out the number of ticks since the last event check
-
-  void (*_midiHandler)(midi_event *pev);   ///< callback into user code to process MIDI stream
-  void (*_sysexHandler)(sysex_event *pev); ///< callback into user code to process SYSEX stream
-  void (*_metaHandler)(const meta_event *pev); ///< callback into user code to process META stream
-
-  const char *_fileName;      ///< MIDI file name buffer in user code
-
-  uint8_t _format;            ///< file format - 0: single track, 1: multiple track, 2: multiple song
-  uint8_t _trackCount;        ///< number of tracks in file
-
-  uint16_t  _ticksPerQuarterNote; ///< time base of file
-  uint32_t  _tickTime;            ///< calculated per tick based on other data for MIDI file
-  uint16_t  _lastTickError;       ///< error brought forward from last tick check
-  uint32_t  _lastTickCheckTime;   ///< the last time (microsec) an tick check was performed
-
-  bool    _synchDone;             ///< sync up at the start of all tracks
-  bool    _paused;                ///< if true we are currently paused
-  bool    _looping;               ///< if true we are currently looping
-
-  uint16_t  _tempo;               ///< tempo for this file in beats per minute
-  int16_t   _tempoDelta;          ///< tempo offset adjustment in beats per minute
-
-  uint8_t   _timeSignature[2];    ///< time signature [0] = numerator, [1] = denominator
-
-  // file handling
-  uint8_t   _selectSD;          ///< SDFat select line
-  SDFAT     *_sd;                ///< SDFat library descriptor supplied by calling program
-  SDFILE    _fd;                ///< SDFat file descriptor
-  MD_MFTrack   _track[MIDI_MAX_TRACKS]; ///< the track data for this file
+  /**
+   * Index file header structure
+   */
+  typedef struct
+  {
+    uint32_t magic;     ///< CATALOG_MAGIC for an index file
+    uint16_t entrySize; ///< sizeof(catalog_entry), so a different configuration is rejected
+    uint16_t count;     ///< the number of entries after the header
+  } catalog_header;
+
+  static const uint32_t CATALOG_MAGIC = 0x5443464d; ///< "MFCT" marks an index file
+
+  bool    openIndex(const char *index);   ///< open the index in the current folder and check the header
+  bool    readEntry(SDFILE *pf, uint16_t idx, catalog_entry *pe); ///< read an entry from the index file
+  bool    startIndex(SDFILE *pf, uint16_t count); ///< create the new index and copy the first entries from the old one
+  int32_t findEntry(catalog_entry *pe);   ///< find the SMF in the open index and fill in the details, -1 if not found
+  void    loadEntry(catalog_entry *pe);   ///< load the SMF and fill in the details
+
+  MD_MIDIFile *_mf;     ///< the object used to load the SMF
+  SDFILE   _fd;         ///< the index file
+  uint16_t _count;      ///< the number of entries in the index
+  uint16_t _hint;       ///< the entry findEntry() looks at first
+  uint16_t _loads;      ///< the number of SMF loaded by the last build()
 };
+#endif
 
 #endif /* _MDMIDIFILE_H */
@@ -28,7 +28,7 @@
  * \brief Main file for helper functions implementation
  */
 
-uint32_t readMultiByte(SDFILE *f, uint8_t nLen)
+uint32_t readMultiByte(MD_MFSource *f, uint8_t nLen)
 // read fixed length parameter from input
 {
   uint32_t  value = 0L;
@@ -41,7 +41,7 @@ uint32_t readMultiByte(SDFILE *f, uint8_t nLen)
   return(value);
 }
 
-uint32_t readVarLen(SDFILE *f)
+uint32_t readVarLen(MD_MFSource *f)
 // read variable length parameter from input
 {
   uint32_t  value = 0;
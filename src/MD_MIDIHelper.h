@@ -33,6 +33,11 @@
 #define MTHD_HDR_SIZE 4         ///< SMF marker length
 #define MTRK_HDR      "MTrk"    ///< SMF track header marker
 #define MTRK_HDR_SIZE 4         ///< SMF track header marker length
+#define MFST_HDR      "MFst"    ///< compiled stream marker
+#define MFST_HDR_SIZE 4         ///< compiled stream marker length
+#define MFST_HDR_LEN  16        ///< compiled stream header length, including the marker
+#define MFST_VERSION  3         ///< compiled stream format version
+#define MFST_RECORD   8         ///< compiled stream record size, the records and data blocks all start on a multiple of this
 
 #define BUF_SIZE(x)   (sizeof(x)/sizeof(x[0]))  ///< Buffer size macro
 
@@ -46,24 +51,24 @@
 /**
  * Read a multi byte value from the input stream
  *
- * SMF contain numbers that are fixed length. This function reads these from the input file.
+ * SMF contain numbers that are fixed length. This function reads these from the input source.
  * 
- * \param *f    pointer to SDFile object to use for reading.
+ * \param *f    pointer to data source object to use for reading.
  * \param nLen  one of MB_LONG, MB_TRYTE, MB_WORD, MB_BYTE to specify the number of bytes to read.
  * \return the value read as a 4 byte integer. This should be cast to the expected size if required.
  */
-uint32_t readMultiByte(SDFILE *f, uint8_t nLen);
+uint32_t readMultiByte(MD_MFSource *f, uint8_t nLen);
 
 /**
  * Read a variable length parameter from the input stream
  *
  * SMF contain numbers that are variable length, with the last byte of the number identified with bit 7 set.
- * This function reads these from the input file.
+ * This function reads these from the input source.
  *
- * \param *f    pointer to SDFile object to use for reading.
+ * \param *f    pointer to data source object to use for reading.
  * \return the value read as a 4 byte integer. This should be cast to the expected size if required.
  */
-uint32_t readVarLen(SDFILE *f);   
+uint32_t readVarLen(MD_MFSource *f);   
 
 /** 
  * Dump a block of data stream
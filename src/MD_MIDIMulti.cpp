@@ -0,0 +1,270 @@
+/*
+  MD_MIDIMulti.cpp - An Arduino library for processing Standard MIDI Files (SMF).
+  Copyright (C) 2012 Marco Colli
+  All rights reserved.
+
+  See MD_MIDIFile.h for complete comments
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+#include "MD_MIDIFile.h"
+
+/**
+ * \file
+ * \brief Main file for the MD_MIDIMulti class implementation
+ */
+
+#if MIDI_MULTI_SONGS
+
+MD_MIDIMulti::MD_MIDIMulti(void) : _songCount(0)
+{
+#if MIDI_TRACK_ARENA
+  _arena = nullptr;
+  _arenaSize = 0;
+#endif
+  setMidiHandler(nullptr);
+  setSysexHandler(nullptr);
+  setMetaHandler(nullptr);
+}
+
+int MD_MIDIMulti::addSong(MD_MIDIFile *pmf)
+{
+  multi_song *ps;
+
+  if (pmf == nullptr || _songCount >= MIDI_MULTI_SONGS)
+    return(-1);
+
+  ps = &_song[_songCount];
+  ps->engine = this;
+  ps->mf = pmf;
+  ps->id = _songCount;
+#if MIDI_TRACK_ARENA
+  ps->arenaStart = ps->arenaLen = 0;
+#endif
+
+  // the song passes its events back through the engine
+  pmf->setMidiHandler(midiCB, ps);
+  pmf->setSysexHandler(sysexCB, ps);
+  pmf->setMetaHandler(metaCB, ps);
+
+  return(_songCount++);
+}
+
+void MD_MIDIMulti::midiCB(midi_event *pev, void *ctx)
+{
+  multi_song *ps = (multi_song *)ctx;
+  MD_MIDIMulti *pe = ps->engine;
+
+  if (pe->_midiHandler != nullptr)
+    (pe->_midiHandler)(ps->id, pev, pe->_midiCtx);
+}
+
+void MD_MIDIMulti::sysexCB(sysex_event *pev, void *ctx)
+{
+  multi_song *ps = (multi_song *)ctx;
+  MD_MIDIMulti *pe = ps->engine;
+
+  if (pe->_sysexHandler != nullptr)
+    (pe->_sysexHandler)(ps->id, pev, pe->_sysexCtx);
+}
+
+void MD_MIDIMulti::metaCB(const meta_event *pev, void *ctx)
+{
+  multi_song *ps = (multi_song *)ctx;
+  MD_MIDIMulti *pe = ps->engine;
+
+  if (pe->_metaHandler != nullptr)
+    (pe->_metaHandler)(ps->id, pev, pe->_metaCtx);
+}
+
+#if MIDI_TRACK_ARENA
+void MD_MIDIMulti::setArena(void *mem, uint32_t size)
+{
+  for (uint8_t i = 0; i < _songCount; i++)
+  {
+    _song[i].mf->close();
+    _song[i].arenaStart = _song[i].arenaLen = 0;
+  }
+
+  _arena = (uint8_t *)mem;
+  _arenaSize = (mem == nullptr ? 0 : size);
+}
+
+int MD_MIDIMulti::load(uint8_t song, const char *fname)
+// Load the SMF for the song into the largest space left in the shared arena
+{
+  multi_song *ps;
+  uint32_t start = 0, len = 0;    // the largest free space
+  uint32_t pos = 0;
+
+  if (song >= _songCount)
+    return(MD_MIDIFile::E_NO_FILE);
+
+  // free the space used by the song
+  ps = &_song[song];
+  ps->mf->close();
+  ps->arenaLen = 0;
+
+  // Look at the spaces between the songs, taking the songs in the order they 
+  // are in the arena. There are only a few songs, so just look for the next each time.
+  while (true)
+  {
+    uint8_t next = _songCount;
+
+    for (uint8_t i = 0; i < _songCount; i++)
+      if ((_song[i].arenaLen != 0) && (_song[i].arenaStart >= pos) &&
+        ((next == _songCount) || (_song[i].arenaStart < _song[next].arenaStart)))
+        next = i;
+
+    uint32_t end = (next == _songCount ? _arenaSize : _song[next].arenaStart);
+
+    if (end - pos > len)
+    {
+      start = pos;
+      len = end - pos;
+    }
+
+    if (next == _songCount)
+      break;
+    pos = _song[next].arenaStart + _song[next].arenaLen;
+  }
+
+  if (_arena == nullptr)
+    len = 0;
+
+  // load into the space, then keep only what the SMF uses
+  ps->mf->setArena(_arena + start, len);
+
+  int err = ps->mf->load(fname);
+
+  if (err == MD_MIDIFile::E_OK)
+  {
+    ps->arenaStart = start;
+    ps->arenaLen = ps->mf->getArenaSize(ps->mf->getTrackCount());
+    ps->mf->_arenaSize = ps->arenaLen;
+  }
+
+  return(err);
+}
+#endif
+
+bool MD_MIDIMulti::getNextEvent(void)
+// Each song keeps its own tick clock. The ticks due for all the songs are 
+// counted first, then the song with the event that has been due the longest is 
+// moved on to the tick of that event, and so on until no events are due. The 
+// events of all the songs come out in time order, even when a song catches up 
+// on more than one tick.
+{
+  uint16_t ticks[MIDI_MULTI_SONGS];     // ticks counted but not processed
+  uint32_t tickTime[MIDI_MULTI_SONGS];  // tick time the ticks were counted at
+  uint32_t error[MIDI_MULTI_SONGS];     // time since the last tick counted
+  uint8_t held = 0;     // songs that used their process budget
+  bool b = false;
+
+  // The time an event has been due is worked out from the tick time when the 
+  // ticks were counted, as a tempo change processed on the way does not change
+  // the time of the ticks already counted.
+  for (uint8_t i = 0; i < _songCount; i++)
+  {
+    MD_MIDIFile *pmf = _song[i].mf;
+
+    ticks[i] = 0;
+    if (!pmf->isEOF() && !pmf->isPaused())   // isEOF() also restarts a looping song
+      ticks[i] = pmf->pollTicks();
+    tickTime[i] = pmf->_tickTime;
+    error[i] = pmf->_lastTickError;
+  }
+
+  while (true)
+  {
+    uint8_t s = _songCount;
+    uint16_t step = 0;
+    uint32_t late = 0;
+
+    // the song with the earliest event, the lower song number first for the same time
+    for (uint8_t i = 0; i < _songCount; i++)
+    {
+      uint16_t n;
+      uint32_t l;
+
+      if ((held & (1 << i)) || !_song[i].mf->eventDue(ticks[i], &n, &l))
+        continue;
+
+      // how long ago the event was due in microseconds
+      l = (l > (0xffffffff - error[i]) / (tickTime[i] + 1) ? 0xffffffff : (l * tickTime[i]) + error[i]);
+      if ((s == _songCount) || (l > late))
+      {
+        s = i;
+        step = n;
+        late = l;
+      }
+    }
+
+    if (s == _songCount)
+      break;
+
+    _song[s].mf->processTimed(step);
+    ticks[s] -= step;
+    b = true;
+
+    if (_song[s].mf->_carryOver)   // the rest of the events are left for the next call
+      held |= (1 << s);
+  }
+
+  // count the rest of the ticks, with no events due except for a song that used its budget
+  for (uint8_t i = 0; i < _songCount; i++)
+    if (ticks[i] != 0)
+      _song[i].mf->processTimed(ticks[i]);
+
+  return(b);
+}
+
+uint32_t MD_MIDIMulti::getMicrosToNextEvent(void)
+{
+  uint32_t t = 0xffffffff;
+
+  for (uint8_t i = 0; i < _songCount; i++)
+  {
+    uint32_t n = _song[i].mf->getMicrosToNextEvent();
+
+    if (n < t) t = n;
+  }
+
+  return(t);
+}
+
+bool MD_MIDIMulti::isEOF(void)
+{
+  bool bEof = true;
+
+  for (uint8_t i = 0; i < _songCount; i++)
+    bEof = _song[i].mf->isEOF() && bEof;   // check all, so looping songs restart
+
+  return(bEof);
+}
+
+void MD_MIDIMulti::pause(bool bMode)
+{
+  for (uint8_t i = 0; i < _songCount; i++)
+    _song[i].mf->pause(bMode);
+}
+
+void MD_MIDIMulti::restart(void)
+{
+  for (uint8_t i = 0; i < _songCount; i++)
+    _song[i].mf->restart();
+}
+
+#endif // MIDI_MULTI_SONGS
@@ -0,0 +1,176 @@
+/*
+  MD_MIDIOut.cpp - An Arduino library for processing Standard MIDI Files (SMF).
+  Copyright (C) 2012 Marco Colli
+  All rights reserved.
+
+  See MD_MIDIFile.h for complete comments
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+#include "MD_MIDIFile.h"
+
+/**
+ * \file
+ * \brief Main file for the MD_MIDIOut class implementation
+ */
+
+#if MIDI_OUT_BUFFER_SIZE
+
+MD_MIDIOut::MD_MIDIOut(void) :
+  _out(nullptr), _head(0), _count(0), _peak(0), _runStatus(0),
+  _noteOffAsOn(false), _drops(0), _saved(0)
+{
+}
+
+void MD_MIDIOut::begin(Print *out)
+{
+  _out = out;
+  _head = _count = 0;
+  _runStatus = 0;
+  _peak = 0;
+  _drops = _saved = 0;
+}
+
+void MD_MIDIOut::attach(MD_MIDIFile *pmf)
+{
+  pmf->setMidiHandler(midiCB, this);
+  pmf->setSysexHandler(sysexCB, this);
+#if MIDI_CLOCK_OUT
+  pmf->setClockHandler(clockCB, this);
+#endif
+}
+
+void MD_MIDIOut::midiCB(midi_event *pev, void *ctx) { ((MD_MIDIOut *)ctx)->midi(pev); }
+void MD_MIDIOut::sysexCB(sysex_event *pev, void *ctx) { ((MD_MIDIOut *)ctx)->sysex(pev); }
+#if MIDI_CLOCK_OUT
+void MD_MIDIOut::clockCB(const uint8_t *data, uint8_t size, void *ctx) { ((MD_MIDIOut *)ctx)->system(data, size); }
+#endif
+
+bool MD_MIDIOut::put(const uint8_t *data, uint16_t size)
+// Add the whole message to the buffer or none of it, so a message that has 
+// no room never leaves part of itself on the wire.
+{
+  if (size > MIDI_OUT_BUFFER_SIZE - _count)
+    transmit();     // make room if the port can take some bytes now
+  if (size > MIDI_OUT_BUFFER_SIZE - _count)
+  {
+    _drops++;
+    return(false);
+  }
+
+  for (uint16_t i = 0, t = (_head + _count) & (MIDI_OUT_BUFFER_SIZE - 1); i < size; i++)
+  {
+    _buf[t] = data[i];
+    t = (t + 1) & (MIDI_OUT_BUFFER_SIZE - 1);
+  }
+  _count += size;
+  if (_count > _peak) _peak = _count;
+
+  transmit();
+
+  return(true);
+}
+
+bool MD_MIDIOut::midi(const midi_event *pev)
+{
+  uint8_t msg[3];
+  uint8_t status = (pev->data[0] & 0xf0) | (pev->channel & 0xf);
+  uint8_t size = pev->size;
+  bool skip;
+
+  if (size < 2 || size > 3 || status < 0x80 || status >= 0xf0)
+    return(false);    // not a channel message
+
+  memcpy(msg, pev->data, size);
+  if (_noteOffAsOn && (status & 0xf0) == 0x80 && size == 3)
+  {
+    status |= 0x10;
+    msg[2] = 0;
+  }
+  msg[0] = status;
+
+  skip = (status == _runStatus);
+  if (!put(skip ? &msg[1] : msg, skip ? size - 1 : size))
+    return(false);
+
+  if (skip)
+    _saved++;
+  _runStatus = status;
+
+  return(true);
+}
+
+bool MD_MIDIOut::sysex(const sysex_event *pev)
+{
+  if (pev->size > ARRAY_SIZE(pev->data))   // truncated when read, so not complete
+  {
+    _drops++;
+    return(false);
+  }
+
+  if (!put(pev->data, pev->size))
+    return(false);
+
+  _runStatus = 0;
+  return(true);
+}
+
+bool MD_MIDIOut::system(const uint8_t *data, uint8_t size)
+{
+  if (size == 0 || data[0] < 0xf0)
+    return(false);
+
+  if (data[0] >= 0xf8)    // real time
+  {
+    // Real time messages may be sent between any bytes, so they can go 
+    // straight out ahead of the buffer if the port has room.
+    if (_out != nullptr && _out->availableForWrite() > 0)
+    {
+      _out->write(data[0]);
+      return(true);
+    }
+    return(put(data, 1));
+  }
+
+  if (!put(data, size))
+    return(false);
+
+  _runStatus = 0;
+  return(true);
+}
+
+uint16_t MD_MIDIOut::transmit(void)
+{
+  int n;
+
+  if (_out == nullptr)
+    return(_count);
+
+  while (_count > 0 && (n = _out->availableForWrite()) > 0)
+  {
+    uint16_t len = MIDI_OUT_BUFFER_SIZE - _head;    // up to the end of the ring
+
+    if (len > _count) len = _count;
+    if ((int)len > n) len = n;
+
+    _out->write(&_buf[_head], len);
+    _head = (_head + len) & (MIDI_OUT_BUFFER_SIZE - 1);
+    _count -= len;
+  }
+
+  return(_count);
+}
+
+#endif // MIDI_OUT_BUFFER_SIZE
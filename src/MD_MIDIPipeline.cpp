@@ -0,0 +1,190 @@
+/*
+  MD_MIDIPipeline.cpp - An Arduino library for processing Standard MIDI Files (SMF).
+  Copyright (C) 2012 Marco Colli
+  All rights reserved.
+
+  See MD_MIDIFile.h for complete comments
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+#include "MD_MIDIFile.h"
+
+/**
+ * \file
+ * \brief Main file for the MD_MIDIFile pipelined playback implementation
+ */
+
+#if MIDI_PIPELINE
+
+#if MIDI_PIPELINE_CORE1
+#include <pico/multicore.h>
+
+static MD_MIDIFile *pipeCore1MF = nullptr;  // the SMF sending events from the second core
+
+void MD_MIDIFile::pipelineCore1(void)
+{
+  pipeCore1MF->pipelineSend();
+}
+#endif
+
+#if MIDI_PIPELINE_TASKS
+void MD_MIDIFile::pipelineReadTask(void *p)
+{
+  ((MD_MIDIFile *)p)->pipelineRead();
+  vTaskDelete(nullptr);
+}
+
+void MD_MIDIFile::pipelineSendTask(void *p)
+{
+  ((MD_MIDIFile *)p)->pipelineSend();
+  vTaskDelete(nullptr);
+}
+#endif
+
+bool MD_MIDIFile::pipelineMode(bool bMode)
+{
+  if (bMode == _pipeRun)
+    return(true);
+
+  if (!bMode)
+  {
+    // let both sides finish what they are doing and stop
+    _pipeRun = false;
+    MIDI_QUEUE_BARRIER();
+    while (!_pipeReadDone || !_pipeSendDone)
+      delay(1);
+#if MIDI_PIPELINE_CORE1
+    multicore_reset_core1();
+#endif
+    _pipeHold = false;
+    queueMode(false);
+
+    return(true);
+  }
+
+  queueMode(true);
+  _pipeHold = false;
+  _pipeReadIdle = _pipeSendIdle = false;
+  _pipeReadDone = _pipeSendDone = false;
+  _pipeRun = true;
+
+#if MIDI_PIPELINE_TASKS
+  if (xTaskCreatePinnedToCore(pipelineReadTask, "SMF read", MIDI_PIPELINE_STACK, this,
+      MIDI_PIPELINE_READ_PRIORITY, nullptr, MIDI_PIPELINE_READ_CORE) != pdPASS)
+    _pipeReadIdle = _pipeReadDone = true;
+  if (xTaskCreatePinnedToCore(pipelineSendTask, "SMF send", MIDI_PIPELINE_STACK, this,
+      MIDI_PIPELINE_SEND_PRIORITY, nullptr, MIDI_PIPELINE_SEND_CORE) != pdPASS)
+    _pipeSendIdle = _pipeSendDone = true;
+
+  if (_pipeReadDone || _pipeSendDone)   // stop the task that did start
+  {
+    pipelineMode(false);
+    return(false);
+  }
+#elif MIDI_PIPELINE_CORE1
+  // the read side is pipelineLoop(), in the main loop
+  _pipeReadIdle = _pipeReadDone = true;
+  pipeCore1MF = this;
+  multicore_launch_core1(pipelineCore1);
+#else
+  // single core, both sides are pipelineLoop()
+  _pipeReadIdle = _pipeReadDone = true;
+  _pipeSendIdle = _pipeSendDone = true;
+#endif
+
+  return(true);
+}
+
+uint8_t MD_MIDIFile::pipelineLoop(void)
+{
+#if !MIDI_PIPELINE_TASKS
+  if (_pipeRun)
+  {
+    if ((_heapCount == 0) && _looping)
+      restart();    // the pipeline loops the SMF, as isEOF() would
+
+    queueEvents();
+#if !MIDI_PIPELINE_CORE1
+    dispatchQueue();
+#endif
+  }
+#endif
+
+  return(_queue.count());
+}
+
+void MD_MIDIFile::pipelineLock(void)
+{
+  _pipeHold = true;
+  MIDI_QUEUE_BARRIER();   // set before the idle flags are checked
+
+  while (!_pipeReadIdle || !_pipeSendIdle)
+    delay(1);
+}
+
+#if MIDI_PIPELINE_TASKS
+void MD_MIDIFile::pipelineRead(void)
+{
+  while (_pipeRun)
+  {
+    if (pipelineHeld(&_pipeReadIdle))
+    {
+      vTaskDelay(1);
+      continue;
+    }
+
+    if ((_heapCount == 0) && _looping)
+      restart();    // the pipeline loops the SMF, as isEOF() would
+
+    if ((queueEvents() >= MIDI_QUEUE_SIZE) || _paused || (_heapCount == 0))
+      vTaskDelay(1);    // nothing more to read for now
+  }
+
+  _pipeReadIdle = _pipeReadDone = true;
+}
+#endif
+
+void MD_MIDIFile::pipelineSend(void)
+{
+  while (_pipeRun)
+  {
+    uint32_t wait;
+
+    if (pipelineHeld(&_pipeSendIdle))
+    {
+#if MIDI_PIPELINE_TASKS
+      vTaskDelay(1);
+#endif
+      continue;
+    }
+
+    wait = dispatchQueue();
+
+#if MIDI_PIPELINE_TASKS
+    // Sleep for the whole RTOS ticks before the next event is due and spin for 
+    // the rest, so the event is sent on time and other tasks can run meanwhile.
+    if (wait == 0xffffffff)
+      vTaskDelay(1);
+    else if (wait / 1000 >= 2 * portTICK_PERIOD_MS)
+      vTaskDelay(wait / 1000 / portTICK_PERIOD_MS - 1);
+#else
+    (void)wait;     // the second core has nothing else to do
+#endif
+  }
+
+  _pipeSendIdle = _pipeSendDone = true;
+}
+
+#endif // MIDI_PIPELINE
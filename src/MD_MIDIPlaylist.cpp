@@ -0,0 +1,207 @@
+/*
+  MD_MIDIPlaylist.cpp - An Arduino library for processing Standard MIDI Files (SMF).
+  Copyright (C) 2012 Marco Colli
+  All rights reserved.
+
+  See MD_MIDIFile.h for complete comments
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+#include "MD_MIDIFile.h"
+
+/**
+ * \file
+ * \brief Main file for the MD_MIDIPlaylist class implementation
+ */
+
+#if MIDI_PLAYLIST_SIZE
+
+MD_MIDIPlaylist::MD_MIDIPlaylist(void) :
+  _cur(0), _playing(false), _ready(false), _primeTrack(PRIME_NONE),
+  _preloadTime(5000), _loadError(MD_MIDIFile::E_OK), _head(0), _count(0)
+{
+  _mf[0] = _mf[1] = nullptr;
+}
+
+void MD_MIDIPlaylist::begin(MD_MIDIFile *pmf0, MD_MIDIFile *pmf1)
+{
+  _mf[0] = pmf0;
+  _mf[1] = pmf1;
+  _mf[0]->close();
+  _mf[1]->close();
+
+  _cur = 0;
+  _playing = _ready = false;
+  _primeTrack = PRIME_NONE;
+  _loadError = MD_MIDIFile::E_OK;
+}
+
+bool MD_MIDIPlaylist::add(const char *fname)
+{
+  if (fname == nullptr || _count >= MIDI_PLAYLIST_SIZE)
+    return(false);
+
+  _list[(_head + _count) % MIDI_PLAYLIST_SIZE] = fname;
+  _count++;
+
+  return(true);
+}
+
+void MD_MIDIPlaylist::clear(void)
+{
+  _head = _count = 0;
+
+  if (_primeTrack != PRIME_NONE)    // throw away the next SMF as well
+  {
+    _mf[_cur ^ 1]->close();
+    _primeTrack = PRIME_NONE;
+    _ready = false;
+  }
+}
+
+bool MD_MIDIPlaylist::preloadStep(void)
+// Each call does one part of the preload, so no call takes long:
+// - close the last SMF and load the next one (open, header and track chunks)
+// - scan a few events of the tracks for the tempo map, in place of the load time scans
+// - read the first block and delta time of each track in turn
+// - set up the tracks ready to play
+{
+  MD_MIDIFile *pmf = _mf[_cur ^ 1];
+
+  if (_ready || pmf == nullptr)
+    return(false);
+
+  if (_primeTrack == PRIME_NONE)
+  {
+    const char *fname;
+
+    if (_count == 0)    // nothing to load
+      return(false);
+
+    fname = _list[_head];
+    _head = (_head + 1) % MIDI_PLAYLIST_SIZE;
+    _count--;
+
+    pmf->close();
+    pmf->_scanDefer = true;
+    _loadError = pmf->load(fname);
+    pmf->_scanDefer = false;
+    if (_loadError == MD_MIDIFile::E_OK)
+    {
+      _primeTrack = 0;
+#if MIDI_TEMPO_MAP_SIZE
+      _scanTrack = 0;
+      pmf->tempoMapStart();
+#endif
+    }
+
+    return(true);       // the next file is tried next time if this failed
+  }
+
+#if MIDI_TEMPO_MAP_SIZE
+  if (_scanTrack < pmf->getTrackCount())
+  {
+    if (pmf->tempoMapScan(_scanTrack, SCAN_EVENTS) && (++_scanTrack == pmf->getTrackCount()))
+      pmf->tempoMapCalc();
+    return(true);
+  }
+#endif
+
+  if (_primeTrack < pmf->getTrackCount())
+  {
+    pmf->_track[_primeTrack++].readDelta(pmf);
+    return(true);
+  }
+
+  // all the tracks have their first event ready, so build the schedule now
+  // and stop getNextEvent() from doing it again when the SMF starts
+  pmf->synchTracks();
+  pmf->_synchDone = true;
+  _ready = true;
+
+  return(false);
+}
+
+void MD_MIDIPlaylist::swap(void)
+// Start the next SMF with its time line carrying on from the end of the
+// current SMF, so any time already past is caught up on the first ticks.
+{
+  MD_MIDIFile *pmf = _mf[_cur ^ 1];
+
+  pmf->_lastTickCheckTime = (_playing ? _mf[_cur]->getEndTime() : micros());
+  pmf->_lastTickError = 0;
+  pmf->_tickPhase = 0;
+
+  _cur ^= 1;
+  _playing = true;
+  _ready = false;
+  _primeTrack = PRIME_NONE;
+}
+
+bool MD_MIDIPlaylist::getNextEvent(void)
+{
+  bool b = false;
+
+  if (_playing && !_mf[_cur]->isEOF())
+    b = _mf[_cur]->getNextEvent();
+
+  if (!_playing || _mf[_cur]->isEOF())
+  {
+    // nothing playing, so finish any preload now and start the next SMF
+    while (preloadStep())
+      ;
+
+    if (_ready)
+    {
+      swap();
+      b = _mf[_cur]->getNextEvent() || b;
+    }
+  }
+  else if (_mf[_cur]->getMicrosToNextEvent() >= _preloadTime)
+    preloadStep();
+
+  return(b);
+}
+
+uint32_t MD_MIDIPlaylist::getMicrosToNextEvent(void)
+{
+  uint32_t t;
+
+  if (_playing && !_mf[_cur]->isEOF())
+  {
+    t = _mf[_cur]->getMicrosToNextEvent();
+
+    // wake up for the preload if there is time for it
+    if ((t >= _preloadTime) && !_ready && (_count != 0 || _primeTrack != PRIME_NONE))
+      t = 0;
+  }
+  else
+    t = (_ready || _count != 0 || _primeTrack != PRIME_NONE ? 0 : 0xffffffff);
+
+  return(t);
+}
+
+bool MD_MIDIPlaylist::isEOF(void)
+{
+  return((!_playing || _mf[_cur]->isEOF()) && !_ready && (_count == 0) && (_primeTrack == PRIME_NONE));
+}
+
+void MD_MIDIPlaylist::pause(bool bMode)
+{
+  if (_playing)
+    _mf[_cur]->pause(bMode);
+}
+
+#endif // MIDI_PLAYLIST_SIZE
@@ -0,0 +1,58 @@
+/*
+  MD_MIDISource.cpp - An Arduino library for processing Standard MIDI Files (SMF).
+  Copyright (C) 2012 Marco Colli
+  All rights reserved.
+
+  See MD_MIDIFile.h for complete comments
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+#include <string.h>
+#include "MD_MIDIFile.h"
+
+/**
+ * \file
+ * \brief Main file for the SMF data source classes implementation
+ */
+
+int MD_MFSourceMem::read(void)
+// read the next byte of data or -1 at the end
+{
+  if (_pos >= _size)
+    return(-1);
+
+  if (_progmem)
+    return(pgm_read_byte(_data + _pos++));
+  
+  return(_data[_pos++]);
+}
+
+int MD_MFSourceMem::read(void *buf, uint16_t len)
+// read a block of data and return the number of bytes read
+{
+  if (_pos >= _size)
+    return(0);
+
+  if (len > _size - _pos)
+    len = _size - _pos;
+
+  if (_progmem)
+    memcpy_P(buf, _data + _pos, len);
+  else
+    memcpy(buf, _data + _pos, len);
+  _pos += len;
+
+  return(len);
+}
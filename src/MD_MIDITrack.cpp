@@ -34,6 +34,9 @@ void MD_MFTrack::reset(void)
   _startOffset = 0;   // start of the track in bytes from start of file
   restart();
   _trackId = 255;
+#if MIDI_COMPILED_STREAM
+  _stream = false;
+#endif
 }
 
 MD_MFTrack::MD_MFTrack(void)
@@ -62,9 +65,11 @@ bool MD_MFTrack::getEndOfTrack(void)
   return _endOfTrack;
 }
 
-void MD_MFTrack::syncTime(void)
+void MD_MFTrack::syncTime(uint32_t tickCount)
 {
-  _elapsedTicks = 0;
+  // keep any pending event the same distance away in the new time base
+  if (_deltaRead)
+    _nextEventTick = (_nextEventTick > tickCount ? _nextEventTick - tickCount : 0);
 }
 
 void MD_MFTrack::restart(void)
@@ -72,63 +77,777 @@ void MD_MFTrack::restart(void)
 {
   _currOffset = 0;
   _endOfTrack = false;
-  _elapsedTicks = 0;
+  _deltaRead = false;
+  _nextEventTick = 0;
+  _bufPtr = nullptr;
+  _bufIdx = _bufLen = 0;
 }
 
-bool MD_MFTrack::getNextEvent(MD_MIDIFile *mf, uint16_t tickCount)
-// track_event = <time:v> + [<midi_event> | <meta_event> | <sysex_event>]
+#if MIDI_SEEK_CHECKPOINTS || MIDI_PLAYLIST_SIZE || MIDI_LOOP_REGION
+void MD_MFTrack::readDelta(MD_MIDIFile *mf)
+// make sure the tick for the next event is known
 {
-  uint32_t deltaT;
+  if (_deltaRead || _endOfTrack)
+    return;
 
-  // is there anything to process?
-  if (_endOfTrack)
-    return(false);
+#if !MIDI_TRACK_BUFFER_SIZE
+  seekCurrent(mf);
+#endif
+
+  _nextEventTick += readDeltaTime(mf);
+  _deltaRead = true;
+}
+#endif
+
+#if MIDI_SEEK_CHECKPOINTS || MIDI_LOOP_REGION
+void MD_MFTrack::saveState(track_checkpoint *pcp)
+// save where we are in the track
+{
+  pcp->offset = _currOffset;
+  pcp->tick = _nextEventTick;
+  pcp->status = _mev.data[0] | _mev.channel;
+  pcp->size = _mev.size;
+  pcp->endOfTrack = _endOfTrack;
+}
+
+void MD_MFTrack::loadState(const track_checkpoint *pcp)
+// restore the track to a saved position
+{
+  _currOffset = pcp->offset;
+  _nextEventTick = pcp->tick;
+  _endOfTrack = pcp->endOfTrack;
+  _deltaRead = true;    // positions are only saved with the next event time known
+
+  // running status carries over from the event before the saved position
+  _mev.data[0] = pcp->status & 0xf0;
+  _mev.channel = pcp->status & 0xf;
+  _mev.size = pcp->size;
+
+  // force the data to be read from the new position
+  _bufPtr = nullptr;
+  _bufIdx = _bufLen = 0;
+}
+#endif // MIDI_SEEK_CHECKPOINTS || MIDI_LOOP_REGION
+
+#if MIDI_TEMPO_MAP_SIZE || MIDI_LOOP_REGION || MIDI_CATALOG_NAME_SIZE || MIDI_LOAD_SCAN
+int16_t MD_MFTrack::skipEvent(MD_MIDIFile *mf, uint8_t eType, uint32_t *len)
+// Read past the event with the status byte eType, already read, for the scans.
+// MIDI messages are left in _mev, which keeps the running status, and the SYSEX
+// and META data is left for the caller to read or skip.
+{
+  *len = 0;
+
+#if MIDI_COMPILED_STREAM
+  if (_stream)
+    return(skipRecord(mf, eType, len));
+#endif
+
+  switch (eType)
+  {
+  case 0x00 ... 0x7f: // MIDI run on message, first data byte already read
+    if (_mev.size == 0)   // no status to run on
+      return(EVENT_INVALID);
+    _mev.data[1] = eType;
+    for (uint8_t i = 2; i < _mev.size; i++)
+      _mev.data[i] = readByte(mf);
+    break;
+
+  case 0x80 ... 0xef: // MIDI message with 1 (0xc0 - 0xdf) or 2 parameters
+    _mev.size = ((eType & 0xe0) == 0xc0 ? 2 : 3);
+    _mev.channel = eType & 0xf;
+    _mev.data[0] = eType & 0xf0;
+    for (uint8_t i = 1; i < _mev.size; i++)
+      _mev.data[i] = readByte(mf);
+    break;
+
+  case 0xf0:  // SYSEX
+  case 0xf7:
+    *len = readVarLen(mf);
+    break;
+
+  case 0xff:  // META
+  {
+    uint8_t mType = readByte(mf);
+
+    *len = readVarLen(mf);
+    return(mType);
+  }
+
+  default:    // playing would abort the track here
+    return(EVENT_INVALID);
+  }
+
+  return(EVENT_SKIPPED);
+}
+
+#if MIDI_COMPILED_STREAM
+int16_t MD_MFTrack::skipRecord(MD_MIDIFile *mf, uint8_t eType, uint32_t *len)
+// Read past the rest of the compiled stream record with the status byte eType,
+// as skipEvent() does for the SMF events.
+{
+  switch (eType)
+  {
+  case 0x80 ... 0xef: // MIDI message, always 2 data bytes in the record
+    _mev.size = ((eType & 0xe0) == 0xc0 ? 2 : 3);
+    _mev.channel = eType & 0xf;
+    _mev.data[0] = eType & 0xf0;
+    _mev.data[1] = readByte(mf);
+    _mev.data[2] = readByte(mf);
+    break;
+
+  case 0xf0:  // SYSEX
+  case 0xf7:
+    *len = readMultiByte(mf, MB_WORD);
+    break;
+
+  case 0xff:  // META, the type is the first byte of the data blocks
+    *len = readMultiByte(mf, MB_WORD);
+    return(readByte(mf));
+
+  default:    // playing would abort the track here
+    return(EVENT_INVALID);
+  }
+
+  return(EVENT_SKIPPED);
+}
+#endif
+#endif
+
+#if MIDI_TEMPO_MAP_SIZE
+bool MD_MFTrack::scanTempo(MD_MIDIFile *mf, uint16_t events, uint32_t *tick)
+// Run through the next events in the track data, passing the tempo changes to 
+// the tempo map. The tick is kept in _nextEventTick and the running status in 
+// _mev between calls.
+{
+  if (_currOffset == 0)   // the start of the track
+  {
+    restart();
+    _mev.size = 0;        // no running status yet
+  }
+
+#if !MIDI_TRACK_BUFFER_SIZE
+  seekCurrent(mf);    // move the file pointer to where we left off if reading directly
+#endif
+
+  for (; events > 0; events--)
+  {
+    int16_t mType;
+    uint32_t mLen;
+
+    if (_endOfTrack || (_currOffset >= _length))
+    {
+      *tick = _nextEventTick;
+      restart();
+      return(true);
+    }
 
-  // move the file pointer to where we left off
-  mf->_fd.seekSet(_startOffset+_currOffset);
+    _nextEventTick += readDeltaTime(mf);
+    mType = skipEvent(mf, readStatus(mf), &mLen);
 
-  // Work out new total elapsed ticks - include the overshoot from
-  // last event.
-  _elapsedTicks += tickCount;
+    if ((mType == 0x51) && (mLen >= 3))     // set tempo
+    {
+      mf->tempoMapAdd(_nextEventTick, readMultiByte(mf, MB_TRYTE));
+      mLen -= 3;
+    }
+    else if ((mType == 0x2f) || (mType == EVENT_INVALID))  // end of track
+      _endOfTrack = true;
+
+    skipBytes(mf, mLen);
+  }
+
+  return(false);
+}
+#endif // MIDI_TEMPO_MAP_SIZE
+
+#if MIDI_LOOP_REGION
+uint32_t MD_MFTrack::scanMarker(MD_MIDIFile *mf, const char *name, uint32_t from)
+// run through the track data looking for a marker with the text
+{
+  uint32_t tick = 0;
+  uint32_t found = 0xffffffff;
+  uint16_t len = strlen(name);
+
+  restart();
+  _mev.size = 0;    // no running status yet
+#if !MIDI_TRACK_BUFFER_SIZE
+  mf->_src->seekSet(_startOffset);
+#endif
+
+  while (!_endOfTrack && (_currOffset < _length) && (found == 0xffffffff))
+  {
+    int16_t mType;
+    uint32_t mLen;
+
+    tick += readDeltaTime(mf);
+    mType = skipEvent(mf, readStatus(mf), &mLen);
+
+    if ((mType == 0x06) && (tick >= from) && (mLen == len))   // marker
+    {
+      bool match = true;
+
+      // compare all the text, so the track is left at the next event
+      for (uint16_t i = 0; i < len; i++)
+        match = (readByte(mf) == (uint8_t)name[i]) && match;
+
+      if (match)
+        found = tick;
+      mLen = 0;
+    }
+    else if ((mType == 0x2f) || (mType == EVENT_INVALID))  // end of track
+      _endOfTrack = true;
+
+    skipBytes(mf, mLen);
+  }
+
+  restart();
+
+  return(found);
+}
+#endif // MIDI_LOOP_REGION
+
+#if MIDI_CATALOG_NAME_SIZE
+bool MD_MFTrack::scanTitle(MD_MIDIFile *mf, char *buf, uint16_t len)
+// run through the events at the start of the track looking for the name
+{
+  bool found = false;
+
+  buf[0] = '\0';
+  restart();
+  _mev.size = 0;    // no running status yet
+#if !MIDI_TRACK_BUFFER_SIZE
+  mf->_src->seekSet(_startOffset);
+#endif
+
+  while (!_endOfTrack && (_currOffset < _length) && !found && (readDeltaTime(mf) == 0))
+  {
+    int16_t mType;
+    uint32_t mLen;
+
+    mType = skipEvent(mf, readStatus(mf), &mLen);
+
+    if (mType == 0x03)                      // sequence/track name
+    {
+      uint16_t n = 0;
+
+      for (; (mLen > 0) && (n < len - 1); mLen--)
+        buf[n++] = readByte(mf);
+      buf[n] = '\0';
+      found = true;
+    }
+    else if ((mType == 0x2f) || (mType == EVENT_INVALID))  // end of track
+      _endOfTrack = true;
+
+    skipBytes(mf, mLen);
+  }
+
+  restart();
+
+  return(found);
+}
+#endif // MIDI_CATALOG_NAME_SIZE
+
+#if MIDI_LOAD_SCAN
+void MD_MFTrack::scanStart(MD_MIDIFile *mf)
+// get ready to scan the track from the start
+{
+  restart();
+  _eventCount = 0;
+  _mev.size = 0;    // no running status yet
+
+  if (_length == 0)
+  {
+    _endOfTrack = true;
+    return;
+  }
+
+#if !MIDI_TRACK_BUFFER_SIZE
+  mf->_src->seekSet(_startOffset);
+#endif
+  _nextEventTick = readDeltaTime(mf);
+  _deltaRead = true;
+}
+
+int16_t MD_MFTrack::scanEvent(MD_MIDIFile *mf, midi_event *pev, uint32_t *len)
+// check the next event and read ahead the time of the one after
+{
+  int16_t status;
+  int16_t mType;
+  uint32_t mLen;
+  uint8_t eType;
+
+#if !MIDI_TRACK_BUFFER_SIZE
+  seekCurrent(mf);    // move the file pointer to where we left off if reading directly
+#endif
 
-  // Get the DeltaT from the file in order to see if enough ticks have
-  // passed for the event to be active.
-  deltaT = readVarLen(&mf->_fd);
+  eType = readStatus(mf);
+  mType = skipEvent(mf, eType, len);
+  mLen = *len;
 
-  // If not enough ticks, just return without saving the file pointer and 
-  // we will go back to the same spot next time.
-  if (_elapsedTicks < deltaT)
+  if (mType == EVENT_INVALID)
+    return(-1);
+
+  if (mType >= 0)   // META
+  {
+    if (mType & 0x80)   // META types are 0-127
+      return(-1);
+#if MIDI_TEMPO_MAP_SIZE
+    if ((mType == 0x51) && (mLen >= 3))   // set tempo
+    {
+      mf->tempoMapAdd(_nextEventTick, readMultiByte(mf, MB_TRYTE));
+      mLen -= 3;
+    }
+#endif
+    if (mType == 0x2f)                    // end of track
+      _endOfTrack = true;
+  }
+  skipBytes(mf, mLen);
+
+  // MIDI data bytes all have the top bit clear
+  if (eType < 0xf0)
+  {
+    for (uint8_t i = 1; i < _mev.size; i++)
+      if (_mev.data[i] & 0x80)
+        return(-1);
+    *pev = _mev;
+    status = _mev.data[0];
+  }
+  else
+    status = eType;
+
+  _eventCount++;
+
+  // read ahead the DeltaT for the next event
+  if (!_endOfTrack && (_currOffset < _length))
+    _nextEventTick += readDeltaTime(mf);
+  else
+    _endOfTrack = true;
+
+  // the event must all be inside the track chunk
+  if (_currOffset > _length)
+    return(-1);
+
+  return(status);
+}
+#endif // MIDI_LOAD_SCAN
+
+bool MD_MFTrack::getNextEvent(MD_MIDIFile *mf, uint32_t tickCount)
+// track_event = <time:v> + [<midi_event> | <meta_event> | <sysex_event>]
+{
+  // is there anything to process? If the delta time for the next event 
+  // has already been read, this needs no file access.
+  if (!isEventDue(tickCount))
     return(false);
 
-  // Adjust the total elapsed time to the error against actual DeltaT to avoid 
-  // accumulation of errors, as we only check for _elapsedTicks being >= ticks,
-  // giving positive biased errors every time.
-  _elapsedTicks -= deltaT;
+#if !MIDI_TRACK_BUFFER_SIZE
+  seekCurrent(mf);    // move the file pointer to where we left off if reading directly
+#endif
+
+  // Get the first DeltaT from the file if we don't have it yet (ie, after 
+  // the track has been loaded or restarted).
+  if (!_deltaRead)
+  {
+    _nextEventTick += readDeltaTime(mf);
+    _deltaRead = true;
+
+    // If not enough ticks, just return and the saved time is checked next time
+    if (tickCount < _nextEventTick)
+      return(false);
+  }
 
-  DUMP("\ndT: ", deltaT);
-  DUMP(" + ", _elapsedTicks);
+  // The due tick is kept as an absolute value against the running tick count 
+  // to avoid accumulation of errors, as we only check for the tick count 
+  // being >= the due tick, giving positive biased errors every time.
+  DUMP("\nT: ", _nextEventTick);
+  DUMP(" + ", tickCount - _nextEventTick);
   DUMPS("\t");
 
+#if MIDI_TIMING_STATS
+  mf->statsEvent(tickCount - _nextEventTick);
+#endif
+  mf->batchTick(_nextEventTick);  // events on a different tick are a new batch
+#if MIDI_COMPILED_STREAM
+  if (_stream)
+    playRecord(mf);
+  else
+#endif
   parseEvent(mf);
 
-  // remember the offset for next time
-  _currOffset = mf->_fd.curPosition() - _startOffset;
-
   // catch end of track when there is no META event  
   _endOfTrack = _endOfTrack || (_currOffset >= _length);
   if (_endOfTrack) DUMPS(" - OUT OF TRACK");
 
+  // read ahead the DeltaT for the next event while the data is at hand
+  if (!_endOfTrack)
+    _nextEventTick += readDeltaTime(mf);
+
+  return(true);
+}
+
+#if MIDI_COMPILED_STREAM
+void MD_MFTrack::playRecord(MD_MIDIFile *mf)
+// process the next record of a compiled stream
+// stream_record = <delta:4> + <track:1> + <status:1> + [<data:2> | <length:2> + <data_blocks>]
+{
+  uint8_t tmp[MFST_RECORD - 4];
+  const uint8_t *p = readRecord(mf, tmp, sizeof(tmp));    // the record after the delta time
+  uint8_t eType = p[1];
+
+  _trackId = _mev.track = p[0];
+
+  switch (eType)
+  {
+  case 0x80 ... 0xef: // MIDI message, with the status filled in and always 2 data bytes
+    _mev.size = ((eType & 0xe0) == 0xc0 ? 2 : 3);
+    _mev.channel = eType & 0xf;
+    _mev.data[0] = eType & 0xf0;
+    _mev.data[1] = p[2];
+    _mev.data[2] = p[3];
+    DUMP("[MREC] Ch: ", _mev.channel);
+    DUMPX(" Data: ", _mev.data[0]);
+    DUMPX(" ", _mev.data[1]);
+    DUMPX(" ", _mev.data[2]);
+
+#if !DUMP_DATA
+#if MIDI_EVENT_FILTER
+    if (!mf->isMidiFiltered(&_mev))
+#endif
+    mf->handleMidi(&_mev);
+#endif
+    break;
+
+  case 0xf0:  // SYSEX, the data blocks hold the SMF data
+  case 0xf7:
+    parseData(mf, eType, 0, ((uint16_t)p[2] << 8) | p[3]);
+    break;
+
+  case 0xff:  // META, the data blocks hold the type and then the SMF data
+  {
+    uint16_t mLen = ((uint16_t)p[2] << 8) | p[3];
+
+    parseData(mf, eType, readByte(mf), mLen);
+  }
+  break;
+
+  default:
+    // stop playing as the record is not valid
+    _endOfTrack = true;
+    DUMPX("[UKNOWN 0x", eType);
+    DUMPS("] Stream aborted");
+    break;
+  }
+}
+
+int32_t MD_MFTrack::compileEvent(MD_MIDIFile *mf, Print *out, uint32_t *last)
+// stream_record = <delta:4> + <track:1> + <status:1> + [<data:2> | <length:2> + <data_blocks>]
+{
+  uint8_t buf[MFST_RECORD];   // the record and then each data block is built up here
+  uint8_t n = 0;              // bytes in buf for the data blocks
+  int32_t total = 0;          // bytes written
+  uint32_t len = 0;           // SYSEX or META data bytes to copy
+  int16_t mType = -1;         // META type, the first byte of the data blocks
+  bool record = true;         // false if there is no record for the event
+  uint8_t eType;
+
+#if !MIDI_TRACK_BUFFER_SIZE
+  seekCurrent(mf);    // move the file pointer to where we left off if reading directly
+#endif
+
+  // the first call only gets the time of the first event
+  if (!_deltaRead)
+  {
+    _nextEventTick += readVarLen(mf);
+    _deltaRead = true;
+    return(0);
+  }
+
+  // the record header, with the time from the last record written
+  putRecord(buf, _nextEventTick - *last, _trackId, 0, 0, 0);
+
+  eType = readByte(mf);
+
+  switch (eType)
+  {
+  case 0x00 ... 0x7f: // MIDI run on message, so put the status back in
+    if (_mev.size == 0)   // no status to run on
+    {
+      _endOfTrack = true;
+      record = false;
+      break;
+    }
+    buf[5] = _mev.data[0] | _mev.channel;
+    buf[6] = eType;
+    if (_mev.size == 3)
+      buf[7] = readByte(mf);
+    break;
+
+  case 0x80 ... 0xef: // MIDI message with 1 (0xc0 - 0xdf) or 2 parameters
+    _mev.size = ((eType & 0xe0) == 0xc0 ? 2 : 3);
+    _mev.channel = eType & 0xf;
+    _mev.data[0] = eType & 0xf0;
+    buf[5] = eType;
+    buf[6] = readByte(mf);
+    if (_mev.size == 3)
+      buf[7] = readByte(mf);
+    break;
+
+  case 0xf0:  // SYSEX
+  case 0xf7:
+    len = readVarLen(mf);
+    buf[5] = eType;
+    break;
+
+  case 0xff:  // META
+    mType = readByte(mf);
+    len = readVarLen(mf);
+    if (mType == 0x2f)  // end of track, one is added for the whole stream
+    {
+      _endOfTrack = true;
+      skipBytes(mf, len);
+      len = 0;
+      record = false;
+      break;
+    }
+    buf[5] = eType;
+    break;
+
+  default:    // playing would abort the track here
+    _endOfTrack = true;
+    record = false;
+    break;
+  }
+
+  if (record)
+  {
+    if (len > 0xffff)   // too long for the record length
+      return(-1);
+
+    if (eType >= 0xf0)
+    {
+      buf[6] = (len >> 8) & 0xff;
+      buf[7] = len & 0xff;
+    }
+    if (out->write(buf, MFST_RECORD) != MFST_RECORD)
+      return(-1);
+    total += MFST_RECORD;
+
+    // the data blocks, padded to the record size
+    if (mType >= 0)
+      buf[n++] = mType;
+    while ((n != 0) || (len != 0))
+    {
+      while ((len > 0) && (n < MFST_RECORD))
+      {
+        buf[n++] = readByte(mf);
+        len--;
+      }
+      while (n < MFST_RECORD)
+        buf[n++] = 0;
+
+      if (out->write(buf, MFST_RECORD) != MFST_RECORD)
+        return(-1);
+      total += MFST_RECORD;
+      n = 0;
+    }
+
+    *last = _nextEventTick;
+  }
+
+  // catch end of track when there is no META event  
+  _endOfTrack = _endOfTrack || (_currOffset >= _length);
+
+  // the time for the next event
+  if (!_endOfTrack)
+    _nextEventTick += readVarLen(mf);
+
+  return(total);
+}
+
+void MD_MFTrack::putRecord(uint8_t *p, uint32_t delta, uint8_t track, uint8_t status, uint8_t d1, uint8_t d2)
+// fill in the fields of a compiled stream record
+{
+  p[0] = (delta >> 24) & 0xff;
+  p[1] = (delta >> 16) & 0xff;
+  p[2] = (delta >> 8) & 0xff;
+  p[3] = delta & 0xff;
+  p[4] = track;
+  p[5] = status;
+  p[6] = d1;
+  p[7] = d2;
+}
+#endif
+
+bool MD_MFTrack::fillBuffer(MD_MIDIFile *mf)
+// refill the read-ahead buffer from the current track offset
+{
+  uint32_t pos = _startOffset + _currOffset;
+  const uint8_t *p = mf->_src->getData();
+
+  _bufIdx = 0;
+
+  if (p != nullptr)   // directly addressable, so use the data in place
+  {
+    uint32_t size = mf->_src->size();
+    uint32_t n = (pos < size ? size - pos : 0);
+
+    _bufPtr = p + pos;
+    _bufLen = (n > 0xffff ? 0xffff : n);
+    return(true);
+  }
+
+#if MIDI_TRACK_BUFFER_SIZE
+  int n;
+#if MIDI_TIMING_STATS
+  uint32_t t = micros();
+#endif
+
+  if (mf->_src->curPosition() != pos)   // not already there from the last refill
+    mf->_src->seekSet(pos);
+  n = mf->_src->read(_buf, MIDI_TRACK_BUFFER_SIZE);
+#if MIDI_TIMING_STATS
+  mf->statsRead(micros() - t);
+#endif
+
+  _bufPtr = _buf;
+  _bufLen = (n > 0 ? n : 0);
   return(true);
+#else
+  _bufLen = 0;
+  return(false);
+#endif
+}
+
+uint8_t MD_MFTrack::readByte(MD_MIDIFile *mf)
+// read the next byte of track data
+{
+  if (_bufIdx >= _bufLen)
+  {
+    if (!fillBuffer(mf))    // not buffered, read directly from the source
+    {
+      _currOffset++;
+      return(mf->_src->read());
+    }
+
+    if (_bufLen == 0)       // nothing left in the source
+    {
+      _endOfTrack = true;
+      return(0);
+    }
+  }
+
+  _currOffset++;
+  return(_bufPtr[_bufIdx++]);
+}
+
+#if !MIDI_TRACK_BUFFER_SIZE
+void MD_MFTrack::seekCurrent(MD_MIDIFile *mf)
+// Move the file pointer to the next track data when reading directly. It is only
+// moved if another track or a scan has read from somewhere else, so a track read 
+// on its own, such as a compiled stream, has no seek for each event.
+{
+  uint32_t pos = _startOffset + _currOffset;
+
+  if ((_bufIdx >= _bufLen) && (mf->_src->curPosition() != pos))
+    mf->_src->seekSet(pos);
+}
+#endif
+
+void MD_MFTrack::skipBytes(MD_MIDIFile *mf, uint32_t n)
+// skip over track data we are not interested in
+{
+  _currOffset += n;
+
+  if (n < (uint32_t)(_bufLen - _bufIdx))
+    _bufIdx += n;
+  else
+  {
+    _bufIdx = _bufLen = 0;  // force a refill at the new offset
+#if !MIDI_TRACK_BUFFER_SIZE
+    mf->_src->seekSet(_startOffset + _currOffset);
+#else
+    (void)mf;     // the refill moves the file pointer
+#endif
+  }
 }
 
+uint32_t MD_MFTrack::readMultiByte(MD_MIDIFile *mf, uint8_t nLen)
+// read fixed length parameter from track data
+{
+  uint32_t  value = 0L;
+  
+  for (uint8_t i=0; i<nLen; i++)
+    value = (value << 8) + readByte(mf);
+  
+  return(value);
+}
+
+uint32_t MD_MFTrack::readVarLen(MD_MIDIFile *mf)
+// read variable length parameter from track data
+{
+  uint32_t  value = 0;
+  uint8_t   c;
+  
+  do
+  {
+    c = readByte(mf);
+    value = (value << 7) + (c & 0x7f);
+  }  while (c & 0x80);
+  
+  return(value);
+}
+
+#if MIDI_COMPILED_STREAM
+uint32_t MD_MFTrack::readDeltaTime(MD_MIDIFile *mf)
+// read the delta time as a fixed or variable length value
+{
+  uint8_t tmp[MFST_RECORD];
+  const uint8_t *p;
+
+  if (!_stream)
+    return(readVarLen(mf));
+
+  // read past the padding of the data blocks, rather than seek, to keep the reads sequential
+  if ((_currOffset & (MFST_RECORD - 1)) != 0)
+    readRecord(mf, tmp, MFST_RECORD - (_currOffset & (MFST_RECORD - 1)));
+
+  p = readRecord(mf, tmp, 4);
+  return(((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3]);
+}
+
+const uint8_t *MD_MFTrack::readRecord(MD_MIDIFile *mf, uint8_t *tmp, uint8_t len)
+// point to the next len bytes of a compiled stream, in place if they are all in the buffer
+{
+  if ((uint16_t)(_bufLen - _bufIdx) >= len)
+  {
+    const uint8_t *p = _bufPtr + _bufIdx;
+
+    _bufIdx += len;
+    _currOffset += len;
+    return(p);
+  }
+
+  for (uint8_t i = 0; i < len; i++)
+    tmp[i] = readByte(mf);
+
+  return(tmp);
+}
+
+uint8_t MD_MFTrack::readStatus(MD_MIDIFile *mf)
+// read the status byte, and the track it came from for a compiled stream
+{
+  if (_stream)
+    _trackId = _mev.track = readByte(mf);
+
+  return(readByte(mf));
+}
+#endif
+
 void MD_MFTrack::parseEvent(MD_MIDIFile *mf)
 // process the event from the physical file
 {
   uint8_t eType;
-  uint32_t mLen;
 
   // now we have to process this event
-  eType = mf->_fd.read();
+  eType = readStatus(mf);
 
   switch (eType)
   {
@@ -143,15 +862,17 @@ void MD_MFTrack::parseEvent(MD_MIDIFile *mf)
     _mev.data[0] = eType;
     _mev.channel = _mev.data[0] & 0xf;  // mask off the channel
     _mev.data[0] = _mev.data[0] & 0xf0; // just the command byte
-    _mev.data[1] = mf->_fd.read();
-    _mev.data[2] = mf->_fd.read();
+    _mev.data[1] = readByte(mf);
+    _mev.data[2] = readByte(mf);
     DUMP("[MID2] Ch: ", _mev.channel);
     DUMPX(" Data: ", _mev.data[0]);
     DUMPX(" ", _mev.data[1]);
     DUMPX(" ", _mev.data[2]);
 #if !DUMP_DATA
-    if (mf->_midiHandler != nullptr)
-      (mf->_midiHandler)(&_mev);
+#if MIDI_EVENT_FILTER
+    if (!mf->isMidiFiltered(&_mev))
+#endif
+    mf->handleMidi(&_mev);
 #endif // !DUMP_DATA
   break;
 
@@ -160,14 +881,16 @@ void MD_MFTrack::parseEvent(MD_MIDIFile *mf)
     _mev.data[0] = eType;
     _mev.channel = _mev.data[0] & 0xf;  // mask off the channel
     _mev.data[0] = _mev.data[0] & 0xf0; // just the command byte
-    _mev.data[1] = mf->_fd.read();
+    _mev.data[1] = readByte(mf);
     DUMP("[MID1] Ch: ", _mev.channel);
     DUMPX(" Data: ", _mev.data[0]);
     DUMPX(" ", _mev.data[1]);
 
 #if !DUMP_DATA
-    if (mf->_midiHandler != nullptr)
-      (mf->_midiHandler)(&_mev);
+#if MIDI_EVENT_FILTER
+    if (!mf->isMidiFiltered(&_mev))
+#endif
+    mf->handleMidi(&_mev);
 #endif
   break;
 
@@ -185,7 +908,7 @@ void MD_MFTrack::parseEvent(MD_MIDIFile *mf)
     _mev.data[1] = eType;
     for (uint8_t i = 2; i < _mev.size; i++)
     {
-      _mev.data[i] = mf->_fd.read();  // next byte
+      _mev.data[i] = readByte(mf);  // next byte
     } 
 
     DUMP("[MID+] Ch: ", _mev.channel);
@@ -196,8 +919,10 @@ void MD_MFTrack::parseEvent(MD_MIDIFile *mf)
     }
 
 #if !DUMP_DATA
-    if (mf->_midiHandler != nullptr)
-      (mf->_midiHandler)(&_mev);
+#if MIDI_EVENT_FILTER
+    if (!mf->isMidiFiltered(&_mev))
+#endif
+    mf->handleMidi(&_mev);
 #endif
   }
   break;
@@ -205,241 +930,404 @@ void MD_MFTrack::parseEvent(MD_MIDIFile *mf)
 // ---------------------------- SYSEX
   case 0xf0:  // sysex_event = 0xF0 + <len:1> + <data_bytes> + 0xF7 
   case 0xf7:  // sysex_event = 0xF7 + <len:1> + <data_bytes> + 0xF7 
+    parseData(mf, eType, 0, readVarLen(mf));
+    break;
+
+// ---------------------------- META
+  case 0xff:  // meta_event = 0xFF + <meta_type:1> + <length:v> + <event_data_bytes>
   {
-    sysex_event sev;
-    uint16_t index = 0;
+    uint8_t mType = readByte(mf);
 
-    // collect all the bytes until the 0xf7 - boundaries are included in the message
-    sev.track = _trackId;
-    mLen = readVarLen(&mf->_fd);
-    sev.size = mLen;
-    if (eType==0xF0)       // add space for 0xF0
-    {
-      sev.data[index++] = eType;
-      sev.size++;
-    }
-    uint16_t minLen = min((uint32_t)sev.size, ARRAY_SIZE(sev.data));
-    // The length parameter includes the 0xF7 but not the start boundary.
-    // However, it may be bigger than our buffer will allow us to store.
-    for (uint16_t i=index; i<minLen; ++i)
-      sev.data[i] = mf->_fd.read();
-    if (sev.size>minLen)
-      mf->_fd.seekCur(sev.size-minLen);
+    parseData(mf, eType, mType, readVarLen(mf));
+  }
+  break;
+  
+// ---------------------------- UNKNOWN
+  default:
+    // stop playing this track as we cannot identify the eType
+    _endOfTrack = true;
+    DUMPX("[UKNOWN 0x", eType);
+    DUMPS("] Track aborted");
+    break;
+  }
+}
+
+void MD_MFTrack::parseData(MD_MIDIFile *mf, uint8_t eType, uint8_t mType, uint32_t mLen)
+// pass a SYSEX or META event on to be processed, with the data still to be read
+{
+#if MIDI_EVENT_FILTER
+  if ((eType != 0xff) && (mf->_statusFilter & MIDI_FILTER_SYSEX))
+  {
+    skipBytes(mf, mLen);
+    return;
+  }
+#endif
+#if MIDI_STREAM_CHUNK_SIZE && !DUMP_DATA
+  if (mf->isStreaming())
+  {
+    streamEvent(mf, eType, mType, mLen);
+    return;
+  }
+#endif
+  if (eType == 0xff)
+    parseMeta(mf, mType, mLen);
+  else
+    parseSysex(mf, eType, mLen);
+}
+
+// The SYSEX and META events are handled in their own functions, not inlined, so 
+// the event buffers are only on the stack while these events are processed.
+__attribute__((noinline)) void MD_MFTrack::parseSysex(MD_MIDIFile *mf, uint8_t eType, uint32_t mLen)
+// process a SYSEX event from the physical file
+{
+  sysex_event sev;
+  uint16_t index = 0;
+
+  // collect all the bytes until the 0xf7 - boundaries are included in the message
+  sev.track = _trackId;
+  sev.size = mLen;
+  if (eType==0xF0)       // add space for 0xF0
+  {
+    sev.data[index++] = eType;
+    sev.size++;
+  }
+  uint16_t minLen = min((uint32_t)sev.size, ARRAY_SIZE(sev.data));
+  // The length parameter includes the 0xF7 but not the start boundary.
+  // However, it may be bigger than our buffer will allow us to store.
+  for (uint16_t i=index; i<minLen; ++i)
+    sev.data[i] = readByte(mf);
+  if (sev.size>minLen)
+    skipBytes(mf, sev.size-minLen);
 
 #if DUMP_DATA
-    DUMPS("[SYSX] Data:");
-    for (uint16_t i = 0; i<minLen; i++)
-    {
-      DUMPX(" ", sev.data[i]);
-    }
-    if (sev.size>minLen)
-      DUMPS("...");
+  DUMPS("[SYSX] Data:");
+  for (uint16_t i = 0; i<minLen; i++)
+  {
+    DUMPX(" ", sev.data[i]);
+  }
+  if (sev.size>minLen)
+    DUMPS("...");
 #else
-    if (mf->_sysexHandler != nullptr)
-      (mf->_sysexHandler)(&sev);
+  mf->sendSysex(&sev);
 #endif
-  }
-  break;
+}
 
-// ---------------------------- META
-  case 0xff:  // meta_event = 0xFF + <meta_type:1> + <length:v> + <event_data_bytes>
+__attribute__((noinline)) void MD_MFTrack::parseMeta(MD_MIDIFile *mf, uint8_t eType, uint32_t mLen)
+// process a META event from the physical file
+{
+  meta_event mev;
+
+#if MIDI_EVENT_FILTER
+  // The META events that change the playback are always processed
+  bool skip = mf->isMetaFiltered(eType);
+
+  if (skip && (eType != 0x2f) && (eType != 0x51) && (eType != 0x58))
   {
-    meta_event mev;
+    skipBytes(mf, mLen);
+    return;
+  }
+#endif
 
-    eType = mf->_fd.read();
-    mLen =  readVarLen(&mf->_fd);
+  mev.track = _trackId;
+  mev.size = mLen;
+  mev.type = eType;
 
-    mev.track = _trackId;
-    mev.size = mLen;
-    mev.type = eType;
+  DUMPX("[META] Type: 0x", eType);
+  DUMP("\tLen: ", mLen);
+  DUMPS("\t");
 
-    DUMPX("[META] Type: 0x", eType);
-    DUMP("\tLen: ", mLen);
-    DUMPS("\t");
+  switch (eType)
+  {
+    case 0x2f:  // End of track
+    {
+      _endOfTrack = true;
+      DUMPS("END OF TRACK");
+    }
+    break;
 
-    switch (eType)
+    case 0x51:  // set Tempo - really the microseconds per tick
     {
-      case 0x2f:  // End of track
-      {
-        _endOfTrack = true;
-        DUMPS("END OF TRACK");
-      }
-      break;
+      uint32_t value = readMultiByte(mf, MB_TRYTE);
+      
+      mf->setMicrosecondPerQuarterNote(value);
+      
+      mev.data[0] = (value >> 16) & 0xFF;
+      mev.data[1] = (value >> 8) & 0xFF;
+      mev.data[2] = value & 0xFF;
+      
+      DUMP("SET TEMPO to ", mf->getTickTime());
+      DUMP(" us/tick or ", mf->getTempo());
+      DUMPS(" beats/min");
+    }
+    break;
 
-      case 0x51:  // set Tempo - really the microseconds per tick
-      {
-        uint32_t value = readMultiByte(&mf->_fd, MB_TRYTE);
-        
-        mf->setMicrosecondPerQuarterNote(value);
-        
-        mev.data[0] = (value >> 16) & 0xFF;
-        mev.data[1] = (value >> 8) & 0xFF;
-        mev.data[2] = value & 0xFF;
-        
-        DUMP("SET TEMPO to ", mf->getTickTime());
-        DUMP(" us/tick or ", mf->getTempo());
-        DUMPS(" beats/min");
-      }
-      break;
+    case 0x58:  // time signature
+    {
+      uint8_t n = readByte(mf);
+      uint8_t d = readByte(mf);
+      
+      mf->setTimeSignature(n, 1 << d);  // denominator is 2^n
+      skipBytes(mf, mLen - 2);
+
+      mev.data[0] = n;
+      mev.data[1] = d;
+      mev.data[2] = 0;
+      mev.data[3] = 0;
+
+      DUMP("SET TIME SIGNATURE to ", mf->getTimeSignature() >> 8);
+      DUMP("/", mf->getTimeSignature() & 0xf);
+    }
+    break;
 
-      case 0x58:  // time signature
-      {
-        uint8_t n = mf->_fd.read();
-        uint8_t d = mf->_fd.read();
-        
-        mf->setTimeSignature(n, 1 << d);  // denominator is 2^n
-        mf->_fd.seekCur(mLen - 2);
-
-        mev.data[0] = n;
-        mev.data[1] = d;
-        mev.data[2] = 0;
-        mev.data[3] = 0;
-
-        DUMP("SET TIME SIGNATURE to ", mf->getTimeSignature() >> 8);
-        DUMP("/", mf->getTimeSignature() & 0xf);
-      }
-      break;
+    case 0x59:  // Key Signature
+    {
+      DUMPS("KEY SIGNATURE");
+      int8_t sf = readByte(mf);
+      uint8_t mi = readByte(mf);
+      const char* aaa[] = {"Cb", "Gb", "Db", "Ab", "Eb", "Bb", "F", "C", "G", "D", "A", "E", "B", "F#", "C#", "G#", "D#", "A#"};
 
-      case 0x59:  // Key Signature
+      if (sf >= -7 && sf <= 7) 
       {
-        DUMPS("KEY SIGNATURE");
-        int8_t sf = mf->_fd.read();
-        uint8_t mi = mf->_fd.read();
-        const char* aaa[] = {"Cb", "Gb", "Db", "Ab", "Eb", "Bb", "F", "C", "G", "D", "A", "E", "B", "F#", "C#", "G#", "D#", "A#"};
-
-        if (sf >= -7 && sf <= 7) 
+        switch(mi)
         {
-          switch(mi)
-          {
-            case 0:
-              strcpy(mev.chars, aaa[sf+7]);
-              strcat(mev.chars, "M");
-              break;
-            case 1:
-              strcpy(mev.chars, aaa[sf+10]);
-              strcat(mev.chars, "m");
-              break;
-            default:
-              strcpy(mev.chars, "Err"); // error mi
-          }
-        } else
-          strcpy(mev.chars, "Err"); // error sf
-
-        mev.size = strlen(mev.chars); // change META length
-        DUMP(" ", mev.chars);
-      }
-      break;
+          case 0:
+            strcpy(mev.chars, aaa[sf+7]);
+            strcat(mev.chars, "M");
+            break;
+          case 1:
+            strcpy(mev.chars, aaa[sf+10]);
+            strcat(mev.chars, "m");
+            break;
+          default:
+            strcpy(mev.chars, "Err"); // error mi
+        }
+      } else
+        strcpy(mev.chars, "Err"); // error sf
+
+      mev.size = strlen(mev.chars); // change META length
+      DUMP(" ", mev.chars);
+    }
+    break;
 
-      case 0x00:  // Sequence Number
-      {
-        uint16_t x = readMultiByte(&mf->_fd, MB_WORD);
+    case 0x00:  // Sequence Number
+    {
+      uint16_t x = readMultiByte(mf, MB_WORD);
 
-        mev.data[0] = (x >> 8) & 0xFF;
-        mev.data[1] = x & 0xFF;
+      mev.data[0] = (x >> 8) & 0xFF;
+      mev.data[1] = x & 0xFF;
 
-        DUMP("SEQUENCE NUMBER ", mev.data[0]);
-        DUMP(" ", mev.data[1]);
-      }
-      break;
+      DUMP("SEQUENCE NUMBER ", mev.data[0]);
+      DUMP(" ", mev.data[1]);
+    }
+    break;
 
-      case 0x20:  // Channel Prefix
-      mev.data[0] = readMultiByte(&mf->_fd, MB_BYTE);
-      DUMP("CHANNEL PREFIX ", mev.data[0]);
-      break;
+    case 0x20:  // Channel Prefix
+    mev.data[0] = readMultiByte(mf, MB_BYTE);
+    DUMP("CHANNEL PREFIX ", mev.data[0]);
+    break;
 
-      case 0x21:  // Port Prefix
-      mev.data[0] = readMultiByte(&mf->_fd, MB_BYTE);
-      DUMP("PORT PREFIX ", mev.data[0]);
-      break;
+    case 0x21:  // Port Prefix
+    mev.data[0] = readMultiByte(mf, MB_BYTE);
+    DUMP("PORT PREFIX ", mev.data[0]);
+    break;
 
 #if SHOW_UNUSED_META
-      case 0x01:  // Text
-      DUMPS("TEXT ");
-      for (uint8_t i=0; i<mLen; i++)
-        DUMP("", (char)mf->_fd.read());
-      break;
+    case 0x01:  // Text
+    DUMPS("TEXT ");
+    for (uint8_t i=0; i<mLen; i++)
+      DUMP("", (char)readByte(mf));
+    break;
 
-      case 0x02:  // Copyright Notice
-      DUMPS("COPYRIGHT ");
-      for (uint8_t i=0; i<mLen; i++)
-        DUMP("", (char)mf->_fd.read());
-      break;
+    case 0x02:  // Copyright Notice
+    DUMPS("COPYRIGHT ");
+    for (uint8_t i=0; i<mLen; i++)
+      DUMP("", (char)readByte(mf));
+    break;
 
-      case 0x03:  // Sequence or Track Name
-      DUMPS("SEQ/TRK NAME ");
-      for (uint8_t i=0; i<mLen; i++)
-        DUMP("", (char)mf->_fd.read());
-      break;
+    case 0x03:  // Sequence or Track Name
+    DUMPS("SEQ/TRK NAME ");
+    for (uint8_t i=0; i<mLen; i++)
+      DUMP("", (char)readByte(mf));
+    break;
 
-      case 0x04:  // Instrument Name
-      DUMPS("INSTRUMENT ");
-      for (uint8_t i=0; i<mLen; i++)
-        DUMP("", (char)mf->_fd.read());
-      break;
+    case 0x04:  // Instrument Name
+    DUMPS("INSTRUMENT ");
+    for (uint8_t i=0; i<mLen; i++)
+      DUMP("", (char)readByte(mf));
+    break;
 
-      case 0x05:  // Lyric
-      DUMPS("LYRIC ");
-      for (uint8_t i=0; i<mLen; i++)
-        DUMP("", (char)mf->_fd.read());
-      break;
+    case 0x05:  // Lyric
+    DUMPS("LYRIC ");
+    for (uint8_t i=0; i<mLen; i++)
+      DUMP("", (char)readByte(mf));
+    break;
 
-      case 0x06:  // Marker
-      DUMPS("MARKER ");
-      for (uint8_t i=0; i<mLen; i++)
-        DUMP("", (char)mf->_fd.read());
-      break;
+    case 0x06:  // Marker
+    DUMPS("MARKER ");
+    for (uint8_t i=0; i<mLen; i++)
+      DUMP("", (char)readByte(mf));
+    break;
 
-      case 0x07:  // Cue Point
-      DUMPS("CUE POINT ");
-      for (uint8_t i=0; i<mLen; i++)
-        DUMP("", (char)mf->_fd.read());
-      break;
+    case 0x07:  // Cue Point
+    DUMPS("CUE POINT ");
+    for (uint8_t i=0; i<mLen; i++)
+      DUMP("", (char)readByte(mf));
+    break;
 
-      case 0x54:  // SMPTE Offset
-      DUMPS("SMPTE OFFSET");
-      for (uint8_t i=0; i<mLen; i++)
-      {
-        DUMP(" ", mf->_fd.read());
-      }
-      break;
+    case 0x54:  // SMPTE Offset
+    DUMPS("SMPTE OFFSET");
+    for (uint8_t i=0; i<mLen; i++)
+    {
+      DUMP(" ", readByte(mf));
+    }
+    break;
 
-      case 0x7F:  // Sequencer Specific Metadata
-      DUMPS("SEQ SPECIFIC");
-      for (uint8_t i=0; i<mLen; i++)
-      {
-        DUMPX(" ", mf->_fd.read());
-      }
-      break;
+    case 0x7F:  // Sequencer Specific Metadata
+    DUMPS("SEQ SPECIFIC");
+    for (uint8_t i=0; i<mLen; i++)
+    {
+      DUMPX(" ", readByte(mf));
+    }
+    break;
 #endif // SHOW_UNUSED_META
 
-      default:
+    default:
+    {
+      uint8_t minLen = min(ARRAY_SIZE(mev.data), (uint32_t)mLen);
+      
+      for (uint8_t i = 0; i < minLen; ++i)
+        mev.data[i] = readByte(mf); // read next
+
+      mev.chars[minLen] = '\0'; // in case it is a string
+      if (mLen > ARRAY_SIZE(mev.data))
+        skipBytes(mf, mLen-ARRAY_SIZE(mev.data));
+//    DUMPS("IGNORED");
+    }
+    break;
+  }
+#if MIDI_EVENT_FILTER
+  if (!skip)
+#endif
+  mf->sendMeta(&mev);
+}
+
+#if MIDI_STREAM_CHUNK_SIZE
+void MD_MFTrack::streamEvent(MD_MIDIFile *mf, uint8_t status, uint8_t type, uint32_t size)
+// pass the SYSEX or META event data to the stream callback in chunks
+{
+  stream_event sev;
+  uint8_t tmp[MIDI_STREAM_CHUNK_SIZE];  // only used if the track is not buffered
+
+  sev.track = _trackId;
+  sev.status = status;
+  sev.type = type;
+  sev.size = size;
+  sev.offset = 0;
+
+#if MIDI_EVENT_FILTER
+  bool skip = (status == 0xff && mf->isMetaFiltered(sev.type));
+
+  if (skip && (sev.type != 0x2f) && (sev.type != 0x51) && (sev.type != 0x58))
+  {
+    skipBytes(mf, sev.size);
+    return;
+  }
+#endif
+
+  // META events that change the playback are processed as well
+  if (status == 0xff)
+  {
+    switch (sev.type)
+    {
+    case 0x2f:  // End of track
+      _endOfTrack = true;
+      break;
+
+    case 0x51:  // set Tempo
+    case 0x58:  // time signature
       {
-        uint8_t minLen = min(ARRAY_SIZE(mev.data), (uint32_t)mLen);
-        
-        for (uint8_t i = 0; i < minLen; ++i)
-          mev.data[i] = mf->_fd.read(); // read next
-
-        mev.chars[minLen] = '\0'; // in case it is a string
-        if (mLen > ARRAY_SIZE(mev.data))
-          mf->_fd.seekCur(mLen-ARRAY_SIZE(mev.data));
-  //    DUMPS("IGNORED");
+        uint8_t d[4] = { 0 };
+        uint8_t n = (sev.size < sizeof(d) ? sev.size : sizeof(d));
+
+        for (uint8_t i = 0; i < n; i++)
+          d[i] = readByte(mf);
+        skipBytes(mf, sev.size - n);
+
+        if (sev.type == 0x51)
+          mf->setMicrosecondPerQuarterNote(((uint32_t)d[0] << 16) | ((uint32_t)d[1] << 8) | d[2]);
+        else
+          mf->setTimeSignature(d[0], 1 << d[1]);  // denominator is 2^n
+
+        sev.flags = MIDI_STREAM_FIRST | MIDI_STREAM_LAST;
+        sev.len = n;
+        sev.data = d;
+#if MIDI_EVENT_FILTER
+        if (!skip)
+#endif
+        mf->sendStream(&sev);
       }
-      break;
+      return;
     }
-    if (mf->_metaHandler != nullptr)
-      (mf->_metaHandler)(&mev);
   }
-  break;
-  
-// ---------------------------- UNKNOWN
-  default:
-    // stop playing this track as we cannot identify the eType
-    _endOfTrack = true;
-    DUMPX("[UKNOWN 0x", eType);
-    DUMPS("] Track aborted");
-    break;
+
+#if MIDI_EVENT_FILTER
+  if (skip)   // end of track
+    return;
+#endif
+
+  do
+  {
+    uint32_t left = sev.size - sev.offset;
+
+    sev.len = readChunk(mf, &sev.data, (left > MIDI_STREAM_CHUNK_SIZE ? MIDI_STREAM_CHUNK_SIZE : left), tmp);
+    sev.flags = (sev.offset == 0 ? MIDI_STREAM_FIRST : 0);
+    if ((sev.len == 0) || (sev.offset + sev.len >= sev.size))   // done or out of data
+      sev.flags |= MIDI_STREAM_LAST;
+
+    mf->sendStream(&sev);
+    sev.offset += sev.len;
+  } while (!(sev.flags & MIDI_STREAM_LAST));
+}
+
+uint8_t MD_MFTrack::readChunk(MD_MIDIFile *mf, const uint8_t **pp, uint8_t len, uint8_t *tmp)
+// point to the next len bytes of track data, or as many as are in the buffer
+{
+  uint16_t n;
+
+  if (len == 0)
+    return(0);
+
+  if (_bufIdx >= _bufLen)
+  {
+    if (!fillBuffer(mf))    // not buffered, read directly from the source
+    {
+      int r = mf->_src->read(tmp, len);
+
+      n = (r > 0 ? r : 0);
+      if (n == 0)
+        _endOfTrack = true;
+      _currOffset += n;
+      *pp = tmp;
+      return(n);
+    }
+
+    if (_bufLen == 0)       // nothing left in the source
+    {
+      _endOfTrack = true;
+      return(0);
+    }
   }
+
+  n = _bufLen - _bufIdx;
+  if (n > len) n = len;
+
+  *pp = _bufPtr + _bufIdx;
+  _bufIdx += n;
+  _currOffset += n;
+
+  return(n);
 }
+#endif
 
 int MD_MFTrack::load(uint8_t trackId, MD_MIDIFile *mf)
 // return -1 if success, 0 if malformed header, 1 if next track past end of file
@@ -448,13 +1336,19 @@ int MD_MFTrack::load(uint8_t trackId, MD_MIDIFile *mf)
 
   // save the trackid for use later
   _trackId = _mev.track = trackId;
+#if MIDI_COMPILED_STREAM
+  _stream = false;
+#endif
+#if MIDI_LOAD_SCAN
+  _eventCount = 0;
+#endif
   
   // Read the Track header
   // track_chunk = "MTrk" + <length:4> + <track_event> [+ <track_event> ...]
   {
     char    h[MTRK_HDR_SIZE+1]; // Header characters + nul
   
-    mf->_fd.fgets(h, MTRK_HDR_SIZE+1);
+    mf->_src->read(h, MTRK_HDR_SIZE);
     h[MTRK_HDR_SIZE] = '\0';
 
     if (strcmp(h, MTRK_HDR) != 0)
@@ -463,20 +1357,35 @@ int MD_MFTrack::load(uint8_t trackId, MD_MIDIFile *mf)
 
   // Row read track chunk size and in bytes. This is not really necessary 
   // since the track MUST end with an end of track meta event.
-  dat32 = readMultiByte(&mf->_fd, MB_LONG);
+  dat32 = ::readMultiByte(mf->_src, MB_LONG);
   _length = dat32;
 
   // save where we are in the file as this is the start of offset for this track
-  _startOffset = mf->_fd.curPosition();
-  _currOffset = 0;
+  _startOffset = mf->_src->curPosition();
+  restart();
 
   // Advance the file pointer to the start of the next track;
-  if (!mf->_fd.seekSet(_startOffset+_length))
+  if (!mf->_src->seekSet(_startOffset+_length))
     return(1);
 
   return(-1);
 }
 
+#if MIDI_COMPILED_STREAM
+void MD_MFTrack::loadStream(uint32_t offset, uint32_t length)
+// the records of a compiled stream are one track with no header
+{
+  _trackId = _mev.track = 0;
+  _stream = true;
+#if MIDI_LOAD_SCAN
+  _eventCount = 0;
+#endif
+  _length = length;
+  _startOffset = offset;
+  restart();
+}
+#endif
+
 #if DUMP_DATA
 void MD_MFTrack::dump(void)
 {
@@ -486,6 +1395,7 @@ void MD_MFTrack::dump(void)
   DUMP("\nFile Location:\t\t", _startOffset);
   DUMP("\nEnd of Track:\t\t", _endOfTrack);
   DUMP("\nCurrent buffer offset:\t", _currOffset);
+  DUMP("\nNext event tick:\t", _nextEventTick);
 }
 #endif // DUMP_DATA
 